@@ -0,0 +1,51 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+#include "aot.h"
+
+Aot* aot_load(const char *path) {
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) return NULL;
+    const AotBlock *blocks = (const AotBlock*) dlsym(handle, "macnes_aot_blocks");
+    const uint32_t *count = (const uint32_t*) dlsym(handle, "macnes_aot_count");
+    const uint64_t *prg_hash = (const uint64_t*) dlsym(handle, "macnes_aot_prg_hash");
+    const uint64_t *prg_size = (const uint64_t*) dlsym(handle, "macnes_aot_prg_size");
+    Aot *aot = (Aot*) calloc(1, sizeof(Aot));
+    if (aot) aot->index = (uint32_t*) calloc(0x10000, sizeof(uint32_t));
+    if (!blocks || !count || !prg_hash || !prg_size || !aot || !aot->index) {
+        if (aot) free(aot->index);
+        free(aot);
+        dlclose(handle);
+        return NULL;
+    }
+
+    aot->handle = handle;
+    aot->blocks = blocks;
+    aot->count = *count;
+    aot->prg_hash = *prg_hash;
+    aot->prg_size = (size_t) *prg_size;
+    for (uint32_t i = 0; i < aot->count; i++)
+        aot->index[blocks[i].address] = i + 1;
+    return aot;
+}
+
+void aot_unload(Aot *aot) {
+    if (!aot) return;
+    dlclose(aot->handle);
+    free(aot->index);
+    free(aot);
+}
+
+// FNV-1a, 64 bit.
+uint64_t aot_prg_hash(const uint8_t *prg, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= prg[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+bool aot_matches(const Aot *aot, const Cartridge *cartridge) {
+    return cartridge && cartridge->prg_size == aot->prg_size
+        && aot_prg_hash(cartridge->prg, cartridge->prg_size) == aot->prg_hash;
+}
@@ -0,0 +1,32 @@
+#ifndef MACNES_AOT_H
+#define MACNES_AOT_H
+
+#include "defs.h"
+
+// Loader for ROM-specific shared objects built by recompile_build. Code
+// found ahead of time runs as straight-line C; everything else, including
+// code in RAM and banks that were not mapped at power-on, stays with the
+// interpreter.
+
+Aot* aot_load(const char *path);
+
+void aot_unload(Aot *aot);
+
+// Hash over a PRG ROM image, embedded in the shared object so it is only
+// attached to the cartridge it was compiled from.
+uint64_t aot_prg_hash(const uint8_t *prg, size_t size);
+
+bool aot_matches(const Aot *aot, const Cartridge *cartridge);
+
+// Block starting at `pc`, if the bank it was compiled from is still mapped
+// there.
+static inline const AotBlock* aot_find(const Aot *aot, const Bus *bus, uint16_t pc) {
+    uint32_t index = aot->index[pc];
+    if (!index) return NULL;
+    const AotBlock *block = &aot->blocks[index - 1];
+    const uint8_t *page = bus->read_map[pc >> 8];
+    if (!page || page + (pc & 0xFF) != bus->cartridge->prg + block->prg_offset) return NULL;
+    return block;
+}
+
+#endif
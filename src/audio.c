@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "audio.h"
+
+static float PULSE_TABLE[AUDIO_PULSE_LEVELS];
+static float TND_TABLE[AUDIO_TND_LEVELS];
+static pthread_once_t audio_tables_once = PTHREAD_ONCE_INIT;
+
+static void audio_init_tables() {
+    PULSE_TABLE[0] = 0.0f;
+    for (int n = 1; n < AUDIO_PULSE_LEVELS; n++)
+        PULSE_TABLE[n] = (float) (95.52 / (8128.0 / n + 100.0));
+    TND_TABLE[0] = 0.0f;
+    for (int n = 1; n < AUDIO_TND_LEVELS; n++)
+        TND_TABLE[n] = (float) (163.67 / (24329.0 / n + 100.0));
+}
+
+
+
+// Mixer
+
+// Levels past the channels' ranges clamp to the loudest table entry.
+static inline float audio_mix_levels(const AudioChannels *c) {
+    unsigned pulse = (unsigned) c->pulse1 + c->pulse2;
+    unsigned tnd = 3u * c->triangle + 2u * c->noise + c->dmc;
+    return PULSE_TABLE[pulse < AUDIO_PULSE_LEVELS ? pulse : AUDIO_PULSE_LEVELS - 1]
+         + TND_TABLE[tnd < AUDIO_TND_LEVELS ? tnd : AUDIO_TND_LEVELS - 1];
+}
+
+float audio_mix(AudioChannels channels) {
+    pthread_once(&audio_tables_once, audio_init_tables);
+    return audio_mix_levels(&channels);
+}
+
+void audio_mix_block(const AudioChannels *channels, float *out, size_t count) {
+    pthread_once(&audio_tables_once, audio_init_tables);
+    for (size_t i = 0; i < count; i++)
+        out[i] = audio_mix_levels(&channels[i]);
+}
+
+
+
+// Resampler
+
+static void resampler_init_kernel(Resampler *r) {
+    double mid_rate = (double) r->in_rate / r->decimation;
+    double cutoff = (double) r->out_rate / mid_rate;
+    if (cutoff > 1.0) cutoff = 1.0;
+    cutoff *= 0.9;
+
+    int half = RESAMPLER_TAPS / 2;
+    for (int p = 0; p < RESAMPLER_PHASES; p++) {
+        double frac = (double) p / RESAMPLER_PHASES;
+        double sum = 0.0;
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            double t = k - (half - 1) - frac;
+            double x = t / half;
+            double window = x <= -1.0 || x >= 1.0 ? 0.0
+                          : 0.42 + 0.5 * cos(M_PI * x) + 0.08 * cos(2.0 * M_PI * x);
+            double sinc = t == 0.0 ? 1.0 : sin(M_PI * cutoff * t) / (M_PI * cutoff * t);
+            double h = cutoff * sinc * window;
+            r->kernel[p][k] = (float) h;
+            sum += h;
+        }
+        for (int k = 0; k < RESAMPLER_TAPS; k++)
+            r->kernel[p][k] = (float) (r->kernel[p][k] / sum);
+    }
+}
+
+Resampler* resampler_init(uint32_t in_rate, uint32_t out_rate) {
+    if (in_rate == 0 || out_rate == 0) return NULL;
+    Resampler *r = (Resampler*) calloc(1, sizeof(Resampler));
+    if (!r) return NULL;
+    r->in_rate = in_rate;
+    r->out_rate = out_rate;
+    r->decimation = in_rate / (2 * out_rate);
+    if (r->decimation == 0) r->decimation = 1;
+    r->step = ((uint64_t) in_rate << 32) / ((uint64_t) r->decimation * out_rate);
+    resampler_init_kernel(r);
+    resampler_reset(r);
+    return r;
+}
+
+void resampler_destroy(Resampler *resampler) {
+    free(resampler);
+}
+
+void resampler_reset(Resampler *resampler) {
+    resampler->state.acc = 0.0f;
+    resampler->state.acc_count = 0;
+    resampler->state.pos = 0;
+    resampler->state.fill = RESAMPLER_TAPS - 1;
+    memset(resampler->state.history, 0, sizeof(resampler->state.history));
+}
+
+// Runs the filter over every output position whose window is complete in
+// history. Taps are summed in four independent lanes so the compiler can map
+// each row onto vector multiply-adds without reassociating a serial sum.
+static size_t resampler_drain(Resampler *r, float *out, size_t capacity, size_t produced) {
+    ResamplerState *state = &r->state;
+    while ((uint32_t) (state->pos >> 32) + RESAMPLER_TAPS <= state->fill) {
+        const float *window = &state->history[state->pos >> 32];
+        const float *taps = r->kernel[(state->pos >> (32 - RESAMPLER_PHASE_BITS)) & (RESAMPLER_PHASES - 1)];
+        float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < RESAMPLER_TAPS; k += 4) {
+            lanes[0] += taps[k + 0] * window[k + 0];
+            lanes[1] += taps[k + 1] * window[k + 1];
+            lanes[2] += taps[k + 2] * window[k + 2];
+            lanes[3] += taps[k + 3] * window[k + 3];
+        }
+        if (produced < capacity)
+            out[produced] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        produced++;
+        state->pos += r->step;
+    }
+
+    uint32_t consumed = (uint32_t) (state->pos >> 32);
+    if (consumed > state->fill) consumed = state->fill;
+    memmove(state->history, state->history + consumed, (state->fill - consumed) * sizeof(float));
+    state->fill -= consumed;
+    state->pos -= (uint64_t) consumed << 32;
+    return produced;
+}
+
+static size_t resampler_push(Resampler *r, float sample, float *out, size_t capacity, size_t produced) {
+    r->state.history[r->state.fill++] = sample;
+    if (r->state.fill == RESAMPLER_TAPS + RESAMPLER_CHUNK)
+        produced = resampler_drain(r, out, capacity, produced);
+    return produced;
+}
+
+size_t resampler_process(Resampler *resampler, const float *in, size_t count,
+                         float *out, size_t capacity) {
+    size_t produced = 0;
+    float scale = 1.0f / resampler->decimation;
+    for (size_t i = 0; i < count; i++) {
+        resampler->state.acc += in[i];
+        if (++resampler->state.acc_count == resampler->decimation) {
+            produced = resampler_push(resampler, resampler->state.acc * scale, out, capacity, produced);
+            resampler->state.acc = 0.0f;
+            resampler->state.acc_count = 0;
+        }
+    }
+    return resampler_drain(resampler, out, capacity, produced);
+}
+
+size_t resampler_hold(Resampler *resampler, float level, uint32_t count,
+                      float *out, size_t capacity) {
+    size_t produced = 0;
+    while (count > 0) {
+        uint32_t take = resampler->decimation - resampler->state.acc_count;
+        if (take > count) take = count;
+        resampler->state.acc += level * take;
+        resampler->state.acc_count += take;
+        count -= take;
+        if (resampler->state.acc_count == resampler->decimation) {
+            produced = resampler_push(resampler, resampler->state.acc / resampler->decimation,
+                                      out, capacity, produced);
+            resampler->state.acc = 0.0f;
+            resampler->state.acc_count = 0;
+        }
+    }
+    return resampler_drain(resampler, out, capacity, produced);
+}
+
+
+
+// Output stage
+
+Audio* audio_init(uint32_t rate) {
+    Audio *audio = (Audio*) calloc(1, sizeof(Audio));
+    if (!audio) return NULL;
+    audio->resampler = resampler_init(NES_CPU_RATE, rate);
+    if (!audio->resampler) {
+        free(audio);
+        return NULL;
+    }
+    return audio;
+}
+
+Audio* audio_clone(const Audio *audio) {
+    Audio *clone = (Audio*) malloc(sizeof(Audio));
+    if (!clone) return NULL;
+    clone->channels = audio->channels;
+    clone->resampler = (Resampler*) malloc(sizeof(Resampler));
+    if (!clone->resampler) {
+        free(clone);
+        return NULL;
+    }
+    *clone->resampler = *audio->resampler;
+    return clone;
+}
+
+void audio_destroy(Audio *audio) {
+    if (!audio) return;
+    resampler_destroy(audio->resampler);
+    free(audio);
+}
+
+bool audio_set_rate(Audio *audio, uint32_t rate) {
+    Resampler *resampler = resampler_init(NES_CPU_RATE, rate);
+    if (!resampler) return false;
+    resampler_destroy(audio->resampler);
+    audio->resampler = resampler;
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef MACNES_AUDIO_H
+#define MACNES_AUDIO_H
+
+#include <stddef.h>
+#include "defs.h"
+
+// Non-linear APU mixer, see https://www.nesdev.org/wiki/APU_Mixer.
+// Output is in the range [0, 1).
+
+float audio_mix(AudioChannels channels);
+
+void audio_mix_block(const AudioChannels *channels, float *out, size_t count);
+
+// Polyphase resampler from in_rate to out_rate. Large ratios (APU rate to
+// host rate) are first box-decimated by an integer factor, then filtered.
+// Output is written straight into the caller's buffer; both process calls
+// return the number of samples produced, which is larger than capacity when
+// the buffer was too small (the excess is dropped).
+
+Resampler* resampler_init(uint32_t in_rate, uint32_t out_rate);
+
+void resampler_destroy(Resampler *resampler);
+
+void resampler_reset(Resampler *resampler);
+
+size_t resampler_process(Resampler *resampler, const float *in, size_t count,
+                         float *out, size_t capacity);
+
+size_t resampler_hold(Resampler *resampler, float level, uint32_t count,
+                      float *out, size_t capacity);
+
+// Machine audio output stage: channel levels mixed at the CPU rate and
+// resampled to the host rate.
+
+Audio* audio_init(uint32_t rate);
+
+Audio* audio_clone(const Audio *audio);
+
+void audio_destroy(Audio *audio);
+
+bool audio_set_rate(Audio *audio, uint32_t rate);
+
+#endif
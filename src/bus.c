@@ -1,12 +1,26 @@
 #include <stdlib.h>
+#include <string.h>
 #include "bus.h"
 #include "ram.h"
+#include "controller.h"
+#include "cartridge.h"
+#include "mapper.h"
+#include "debug.h"
+#include "coroutine.h"
 
 Bus* bus_init() {
-    return (Bus*) calloc(1, sizeof(Bus));
+    Bus *bus = (Bus*) calloc(1, sizeof(Bus));
+    if (!bus) return NULL;
+    bus->mapper_state.next_event = MAPPER_NO_EVENT;
+    bus->trap_map[0x4016 >> 8] = BUS_TRAP_IO;
+    return bus;
 }
 
 void bus_destroy(Bus *bus) {
+    if (!bus) return;
+    if (bus->debug) bus->debug->bus = NULL;
+    cartridge_release(bus->cartridge);
+    scheduler_destroy(bus->scheduler);
     free(bus);
 }
 
@@ -18,10 +32,77 @@ void bus_connect_cpu(Bus *bus, CPU *cpu) {
     cpu->bus = bus;
 }
 
+void bus_connect_controller(Bus *bus, Controller *controller) {
+    bus->controller = controller;
+}
+
+bool bus_insert_cartridge(Bus *bus, Cartridge *cartridge, uint64_t clock) {
+    const Mapper *mapper = cartridge ? mapper_find(cartridge->mapper) : NULL;
+    if (cartridge && !mapper) return false;
+    cartridge_retain(cartridge);
+    cartridge_release(bus->cartridge);
+    bus->cartridge = cartridge;
+    bus->mapper = mapper;
+    bus->aot = NULL;
+    memset(bus->read_map, 0, sizeof(bus->read_map));
+    memset(bus->rom_map, 0, sizeof(bus->rom_map));
+    memset(bus->chr_map, 0, sizeof(bus->chr_map));
+    memset(&bus->mapper_state, 0, sizeof(bus->mapper_state));
+    bus->mapper_state.next_event = MAPPER_NO_EVENT;
+    if (mapper) mapper_power(bus, clock);
+    return true;
+}
+
+uint8_t bus_peek(const Bus *bus, uint16_t address) {
+    const uint8_t *page = bus->rom_map[address >> 8];
+    return page ? page[address & 0xFF] : ram_read(bus->ram, address);
+}
+
+void bus_trap_page(Bus *bus, uint8_t page, bool trapped) {
+    if (trapped) bus->trap_map[page] |= BUS_TRAP_WATCH;
+    else bus->trap_map[page] &= (uint8_t) ~BUS_TRAP_WATCH;
+    bus->read_map[page] = bus->trap_map[page] ? NULL : bus->rom_map[page];
+}
+
+// Everything that is neither ROM nor plain RAM. A trapped ROM page is still
+// read from rom_map and written through the mapper.
+static uint8_t bus_read_trap(Bus *bus, uint16_t address) {
+    const uint8_t *page = bus->rom_map[address >> 8];
+    uint8_t data;
+    if (page) data = page[address & 0xFF];
+    else if ((address & 0xFFFE) == 0x4016 && bus->controller)
+        data = controller_read(bus->controller, address & 1);
+    else data = ram_read(bus->ram, address);
+    if (bus->debug) debug_trap_read(bus->debug, address, data);
+    return data;
+}
+
+static void bus_write_trap(Bus *bus, uint16_t address, uint8_t data) {
+    if (bus->debug) debug_trap_write(bus->debug, address, data);
+    if (bus->rom_map[address >> 8]) {
+        if (bus->mapper) bus->mapper->write(bus, address, data);
+        return;
+    }
+    if (address == 0x4016 && bus->controller)
+        controller_write(bus->controller, data);
+    ram_write(bus->ram, address, data);
+}
+
 uint8_t bus_read(Bus *bus, uint16_t address) {
+    const uint8_t *page = bus->read_map[address >> 8];
+    if (page) return page[address & 0xFF];
+    if (bus->trap_map[address >> 8]) return bus_read_trap(bus, address);
     return ram_read(bus->ram, address);
 }
 
 void bus_write(Bus *bus, uint16_t address, uint8_t data) {
+    if (bus->read_map[address >> 8]) {
+        if (bus->mapper) bus->mapper->write(bus, address, data);
+        return;
+    }
+    if (bus->trap_map[address >> 8]) {
+        bus_write_trap(bus, address, data);
+        return;
+    }
     ram_write(bus->ram, address, data);
-}
\ No newline at end of file
+}
@@ -11,6 +11,27 @@ void bus_connect_ram(Bus *bus, RAM *ram);
 
 void bus_connect_cpu(Bus *bus, CPU *cpu);
 
+void bus_connect_controller(Bus *bus, Controller *controller);
+
+// Maps the cartridge's ROM pages straight into the address space and
+// powers on its mapper; NULL removes it. Returns false, leaving the bus as
+// it was, if the mapper is not supported. The bus holds a reference until
+// it is destroyed or replaced. Compiled code attached to the bus is
+// detached.
+bool bus_insert_cartridge(Bus *bus, Cartridge *cartridge, uint64_t clock);
+
+// Memory as the CPU would read it, without I/O side effects or traps, for
+// tools looking at code.
+uint8_t bus_peek(const Bus *bus, uint16_t address);
+
+// Sets or clears a watchpoint trap on `page`. A trapped page leaves
+// read_map, so its accesses take the slow path through the debugger while
+// every other page keeps the same code path it had.
+void bus_trap_page(Bus *bus, uint8_t page, bool trapped);
+
+// Pages in `read_map` are read from there directly, and writes to them go
+// to the mapper. Pages in `trap_map` go to I/O or the debugger; everything
+// else goes to RAM.
 uint8_t bus_read(Bus *bus, uint16_t address);
 
 void bus_write(Bus *bus, uint16_t address, uint8_t data);
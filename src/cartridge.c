@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cartridge.h"
+
+static const uint8_t CARTRIDGE_MAGIC[4] = {'N', 'E', 'S', 0x1A};
+
+// NES 2.0 ROM size: a 12-bit unit count, or with the high nibble at $F an
+// exponent-multiplier pair 2^E * (2M + 1) in the low byte.
+static uint64_t cartridge_rom_size(uint8_t lsb, uint8_t msb, size_t unit) {
+    if (msb == 0xF) return ((uint64_t) 1 << (lsb >> 2)) * ((lsb & 3) * 2 + 1);
+    return ((uint64_t) msb << 8 | lsb) * unit;
+}
+
+static size_t cartridge_shift_size(uint8_t shift) {
+    return shift ? (size_t) 64 << shift : 0;
+}
+
+enum CartridgeError cartridge_parse(const uint8_t *data, size_t size, Cartridge *cartridge) {
+    if (size < CARTRIDGE_HEADER_SIZE || memcmp(data, CARTRIDGE_MAGIC, sizeof(CARTRIDGE_MAGIC)) != 0)
+        return CARTRIDGE_ERROR_MAGIC;
+
+    uint8_t flags6 = data[6], flags7 = data[7];
+    uint64_t prg_size, chr_size;
+    cartridge->nes2 = (flags7 & 0x0C) == 0x08;
+    cartridge->mapper = flags6 >> 4;
+    cartridge->submapper = 0;
+    cartridge->battery = flags6 & 0x02;
+    cartridge->mirroring = flags6 & 0x08 ? MIRROR_FOUR_SCREEN : flags6 & 0x01 ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
+    if (cartridge->nes2) {
+        cartridge->mapper |= (uint16_t) ((flags7 & 0xF0) | (data[8] & 0x0F) << 8);
+        cartridge->submapper = data[8] >> 4;
+        prg_size = cartridge_rom_size(data[4], data[9] & 0x0F, CARTRIDGE_PRG_UNIT);
+        chr_size = cartridge_rom_size(data[5], data[9] >> 4, CARTRIDGE_CHR_UNIT);
+        cartridge->prg_ram_size = cartridge_shift_size(data[10] & 0x0F) + cartridge_shift_size(data[10] >> 4);
+        cartridge->chr_ram_size = cartridge_shift_size(data[11] & 0x0F) + cartridge_shift_size(data[11] >> 4);
+    } else {
+        // Old dumps with text in bytes 12-15 also have garbage in byte 7.
+        static const uint8_t zero[4] = {0, 0, 0, 0};
+        if ((flags7 & 0x0C) == 0 && memcmp(data + 12, zero, sizeof(zero)) == 0)
+            cartridge->mapper |= flags7 & 0xF0;
+        prg_size = (uint64_t) data[4] * CARTRIDGE_PRG_UNIT;
+        chr_size = (uint64_t) data[5] * CARTRIDGE_CHR_UNIT;
+        cartridge->prg_ram_size = (size_t) (data[8] ? data[8] : 1) * 8 * 1024;
+        cartridge->chr_ram_size = chr_size ? 0 : CARTRIDGE_CHR_UNIT;
+    }
+
+    uint64_t offset = CARTRIDGE_HEADER_SIZE + (flags6 & 0x04 ? CARTRIDGE_TRAINER_SIZE : 0);
+    // Exponent sizes go up to 2^63, so each is checked against what is left.
+    if (offset > size || prg_size > size - offset || chr_size > size - offset - prg_size)
+        return CARTRIDGE_ERROR_TRUNCATED;
+    if (prg_size == 0 || prg_size % CARTRIDGE_PRG_UNIT != 0 || chr_size % CARTRIDGE_CHR_PAGE_SIZE != 0)
+        return CARTRIDGE_ERROR_UNSUPPORTED;
+    cartridge->prg = data + offset;
+    cartridge->prg_size = (size_t) prg_size;
+    cartridge->chr = chr_size ? data + offset + prg_size : NULL;
+    cartridge->chr_size = (size_t) chr_size;
+    return CARTRIDGE_OK;
+}
+
+Cartridge* cartridge_from_map(void *map, size_t size, enum CartridgeError *error) {
+    Cartridge *cartridge = (Cartridge*) calloc(1, sizeof(Cartridge));
+    enum CartridgeError status = cartridge ? cartridge_parse((const uint8_t*) map, size, cartridge)
+                                           : CARTRIDGE_ERROR_IO;
+    if (error) *error = status;
+    if (status != CARTRIDGE_OK) {
+        free(cartridge);
+        return NULL;
+    }
+    cartridge->refs = 1;
+    cartridge->map = map;
+    cartridge->map_size = size;
+    return cartridge;
+}
+
+Cartridge* cartridge_open(const char *path, enum CartridgeError *error) {
+    if (error) *error = CARTRIDGE_ERROR_IO;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    Cartridge *cartridge = cartridge_from_map(map, (size_t) info.st_size, error);
+    if (!cartridge) munmap(map, (size_t) info.st_size);
+    return cartridge;
+}
+
+Cartridge* cartridge_retain(Cartridge *cartridge) {
+    if (cartridge) __atomic_add_fetch(&cartridge->refs, 1, __ATOMIC_RELAXED);
+    return cartridge;
+}
+
+void cartridge_release(Cartridge *cartridge) {
+    if (!cartridge) return;
+    if (__atomic_sub_fetch(&cartridge->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        munmap(cartridge->map, cartridge->map_size);
+        free(cartridge);
+    }
+}
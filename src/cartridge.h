@@ -0,0 +1,25 @@
+#ifndef MACNES_CARTRIDGE_H
+#define MACNES_CARTRIDGE_H
+
+#include "defs.h"
+
+// iNES and NES 2.0 cartridge images. The file is mapped read-only and
+// `prg`/`chr` point straight into the mapping, which is shared by every
+// machine the cartridge is inserted into and unmapped when the last
+// reference is released.
+
+Cartridge* cartridge_open(const char *path, enum CartridgeError *error);
+
+// Wraps an existing read-only mapping of a whole image. On success the
+// cartridge owns `map` and munmaps it when released.
+Cartridge* cartridge_from_map(void *map, size_t size, enum CartridgeError *error);
+
+// Parses a header and checks `size` covers the ROM it describes. `prg` and
+// `chr` are left pointing into `data`. PRG ROM must be whole 16KB banks.
+enum CartridgeError cartridge_parse(const uint8_t *data, size_t size, Cartridge *cartridge);
+
+Cartridge* cartridge_retain(Cartridge *cartridge);
+
+void cartridge_release(Cartridge *cartridge);
+
+#endif
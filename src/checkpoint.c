@@ -0,0 +1,457 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "savestate.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CHECKPOINT_HAVE_IO_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+enum CheckpointStage {
+    CHECKPOINT_STAGE_OPEN,
+    CHECKPOINT_STAGE_WRITE,
+    CHECKPOINT_STAGE_CLOSE,
+};
+
+static CheckpointRequest* checkpoint_request(const char *path, const NesState *state,
+                                             CheckpointCallback callback, void *context) {
+    CheckpointRequest *request = (CheckpointRequest*) calloc(1, sizeof(CheckpointRequest));
+    if (!request) return NULL;
+    size_t path_size = strlen(path) + 1;
+    request->path = (char*) malloc(path_size);
+    request->head = (uint8_t*) malloc(savestate_head_size());
+    if (!request->path || !request->head) {
+        free(request->path);
+        free(request->head);
+        free(request);
+        return NULL;
+    }
+    memcpy(request->path, path, path_size);
+    request->state = state;
+    request->callback = callback;
+    request->context = context;
+    request->fd = -1;
+
+    request->iov[0].iov_base = request->head;
+    request->iov[0].iov_len = savestate_encode_head(state, request->head);
+    request->iov[1].iov_base = (void*) state->ram;
+    request->iov[1].iov_len = RAM_SIZE;
+    request->iov_count = 2;
+    return request;
+}
+
+static void checkpoint_append(CheckpointRequest **head, CheckpointRequest **tail, CheckpointRequest *request) {
+    request->next = NULL;
+    if (*tail) (*tail)->next = request;
+    else *head = request;
+    *tail = request;
+}
+
+static CheckpointRequest* checkpoint_pop(CheckpointRequest **head, CheckpointRequest **tail) {
+    CheckpointRequest *request = *head;
+    if (!request) return NULL;
+    *head = request->next;
+    if (!*head) *tail = NULL;
+    return request;
+}
+
+// Drops `written` bytes from the front of the request's iovecs. Returns
+// true once nothing is left.
+static bool checkpoint_advance(CheckpointRequest *request, size_t written) {
+    request->offset += written;
+    int first = 2 - request->iov_count;
+    while (request->iov_count > 0 && written >= request->iov[first].iov_len) {
+        written -= request->iov[first].iov_len;
+        first++;
+        request->iov_count--;
+    }
+    if (request->iov_count > 0) {
+        request->iov[first].iov_base = (uint8_t*) request->iov[first].iov_base + written;
+        request->iov[first].iov_len -= written;
+    }
+    return request->iov_count == 0;
+}
+
+static struct iovec* checkpoint_remaining(CheckpointRequest *request) {
+    return &request->iov[2 - request->iov_count];
+}
+
+static void checkpoint_finish(Checkpoint *checkpoint, CheckpointRequest *request) {
+    if (request->callback) request->callback(request->context, request->path, request->error);
+    checkpoint->pending--;
+    free(request->path);
+    free(request->head);
+    free(request);
+}
+
+
+
+// Thread pool
+
+static void checkpoint_write_blocking(CheckpointRequest *request) {
+    request->fd = open(request->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (request->fd < 0) {
+        request->error = errno;
+        return;
+    }
+    while (request->iov_count > 0) {
+        ssize_t written = writev(request->fd, checkpoint_remaining(request), request->iov_count);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            request->error = written < 0 ? errno : EIO;
+            break;
+        }
+        checkpoint_advance(request, (size_t) written);
+    }
+    if (close(request->fd) != 0 && !request->error) request->error = errno;
+}
+
+static void* checkpoint_worker(void *context) {
+    Checkpoint *checkpoint = (Checkpoint*) context;
+    pthread_mutex_lock(&checkpoint->lock);
+    for (;;) {
+        CheckpointRequest *request = checkpoint_pop(&checkpoint->jobs, &checkpoint->jobs_tail);
+        if (!request) {
+            if (checkpoint->stopping) break;
+            pthread_cond_wait(&checkpoint->work, &checkpoint->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&checkpoint->lock);
+        checkpoint_write_blocking(request);
+        pthread_mutex_lock(&checkpoint->lock);
+        checkpoint_append(&checkpoint->done, &checkpoint->done_tail, request);
+        pthread_cond_signal(&checkpoint->finished);
+    }
+    pthread_mutex_unlock(&checkpoint->lock);
+    return NULL;
+}
+
+static bool checkpoint_threads_init(Checkpoint *checkpoint, uint32_t depth) {
+    checkpoint->worker_count = depth ? depth : 1;
+    checkpoint->workers = (pthread_t*) calloc(checkpoint->worker_count, sizeof(pthread_t));
+    if (!checkpoint->workers) return false;
+    for (unsigned i = 0; i < checkpoint->worker_count; i++) {
+        if (pthread_create(&checkpoint->workers[i], NULL, checkpoint_worker, checkpoint) != 0) {
+            checkpoint->worker_count = i;
+            return i > 0;
+        }
+    }
+    return true;
+}
+
+static uint32_t checkpoint_threads_poll(Checkpoint *checkpoint, bool wait) {
+    pthread_mutex_lock(&checkpoint->lock);
+    while (wait && !checkpoint->done)
+        pthread_cond_wait(&checkpoint->finished, &checkpoint->lock);
+    CheckpointRequest *done = checkpoint->done;
+    checkpoint->done = checkpoint->done_tail = NULL;
+    pthread_mutex_unlock(&checkpoint->lock);
+
+    uint32_t count = 0;
+    while (done) {
+        CheckpointRequest *next = done->next;
+        checkpoint_finish(checkpoint, done);
+        done = next;
+        count++;
+    }
+    return count;
+}
+
+
+
+// io_uring
+
+#ifdef CHECKPOINT_HAVE_IO_URING
+
+// Rings exist since 5.1 but OPENAT and CLOSE only since 5.6, the same
+// release that added the probe, so older kernels fail the probe itself.
+static bool checkpoint_ring_supported(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe*) calloc(1, size);
+    if (!probe) return false;
+    static const uint8_t NEEDED[] = {IORING_OP_OPENAT, IORING_OP_WRITEV, IORING_OP_CLOSE};
+    bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) >= 0;
+    for (size_t i = 0; supported && i < sizeof(NEEDED); i++)
+        supported = NEEDED[i] <= probe->last_op && (probe->ops[NEEDED[i]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+static bool checkpoint_ring_init(CheckpointRing *ring, uint32_t depth) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int) syscall(__NR_io_uring_setup, depth ? depth : 1, &params);
+    if (ring->fd < 0 || !checkpoint_ring_supported(ring->fd)) return false;
+    ring->entries = params.sq_entries;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = single ? ring->sq_ring
+                           : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) return false;
+
+    uint8_t *sq = (uint8_t*) ring->sq_ring, *cq = (uint8_t*) ring->cq_ring;
+    ring->sq_head = (uint32_t*) (sq + params.sq_off.head);
+    ring->sq_tail = (uint32_t*) (sq + params.sq_off.tail);
+    ring->sq_mask = (uint32_t*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*) (sq + params.sq_off.array);
+    ring->cq_head = (uint32_t*) (cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t*) (cq + params.cq_off.tail);
+    ring->cq_mask = (uint32_t*) (cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+    return true;
+}
+
+static void checkpoint_ring_destroy(CheckpointRing *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+// Fills the next submission slot with the request's current stage. The
+// slot only reaches the kernel with the next checkpoint_ring_enter.
+static void checkpoint_ring_prepare(CheckpointRing *ring, CheckpointRequest *request) {
+    uint32_t tail = *ring->sq_tail;
+    uint32_t index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe*) ring->sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (uint64_t) (uintptr_t) request;
+    switch (request->stage) {
+        case CHECKPOINT_STAGE_OPEN:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t) (uintptr_t) request->path;
+            sqe->len = 0644;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case CHECKPOINT_STAGE_WRITE:
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = request->fd;
+            sqe->addr = (uint64_t) (uintptr_t) checkpoint_remaining(request);
+            sqe->len = (uint32_t) request->iov_count;
+            sqe->off = request->offset;
+            break;
+        case CHECKPOINT_STAGE_CLOSE:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = request->fd;
+            break;
+    }
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+}
+
+static int checkpoint_ring_enter(CheckpointRing *ring, bool wait) {
+    int submitted = (int) syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, wait ? 1 : 0,
+                                  wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (submitted > 0) ring->unsubmitted -= (uint32_t) submitted;
+    return submitted;
+}
+
+// Puts the request's next operation in the ring, or behind the others if
+// the ring is full.
+static void checkpoint_ring_queue(Checkpoint *checkpoint, CheckpointRequest *request) {
+    if (checkpoint->in_flight < checkpoint->ring.entries && !checkpoint->backlog && !checkpoint->ring.error) {
+        checkpoint_ring_prepare(&checkpoint->ring, request);
+        checkpoint->in_flight++;
+    } else {
+        checkpoint_append(&checkpoint->backlog, &checkpoint->backlog_tail, request);
+    }
+}
+
+static uint32_t checkpoint_ring_reap(Checkpoint *checkpoint) {
+    CheckpointRing *ring = &checkpoint->ring;
+    uint32_t head = *ring->cq_head;
+    uint32_t count = 0;
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &((struct io_uring_cqe*) ring->cqes)[head & *ring->cq_mask];
+        CheckpointRequest *request = (CheckpointRequest*) (uintptr_t) cqe->user_data;
+        int result = cqe->res;
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        checkpoint->in_flight--;
+
+        switch (request->stage) {
+            case CHECKPOINT_STAGE_OPEN:
+                if (result < 0) {
+                    request->error = -result;
+                    checkpoint_finish(checkpoint, request);
+                    count++;
+                    continue;
+                }
+                request->fd = result;
+                request->stage = CHECKPOINT_STAGE_WRITE;
+                break;
+            case CHECKPOINT_STAGE_WRITE:
+                if (result <= 0) {
+                    request->error = result < 0 ? -result : EIO;
+                    request->stage = CHECKPOINT_STAGE_CLOSE;
+                } else if (checkpoint_advance(request, (size_t) result)) {
+                    request->stage = CHECKPOINT_STAGE_CLOSE;
+                }
+                break;
+            case CHECKPOINT_STAGE_CLOSE:
+                if (result < 0 && !request->error) request->error = -result;
+                checkpoint_finish(checkpoint, request);
+                count++;
+                continue;
+        }
+        checkpoint_ring_queue(checkpoint, request);
+    }
+
+    while (checkpoint->backlog && checkpoint->in_flight < ring->entries && !ring->error) {
+        CheckpointRequest *request = checkpoint_pop(&checkpoint->backlog, &checkpoint->backlog_tail);
+        checkpoint_ring_prepare(ring, request);
+        checkpoint->in_flight++;
+    }
+    return count;
+}
+
+// Closes what the request has open and calls it back with `error`.
+static void checkpoint_ring_abort(Checkpoint *checkpoint, CheckpointRequest *request, int error) {
+    if (request->fd >= 0 && close(request->fd) != 0 && !request->error) request->error = errno;
+    if (!request->error) request->error = error;
+    checkpoint_finish(checkpoint, request);
+}
+
+// After io_uring_enter fails for good, operations the kernel has not taken
+// yet are taken back from the ring and failed with the backlog. Those it
+// already has still complete into the ring.
+static uint32_t checkpoint_ring_fail(Checkpoint *checkpoint) {
+    CheckpointRing *ring = &checkpoint->ring;
+    uint32_t tail = *ring->sq_tail;
+    uint32_t count = 0;
+    for (; ring->unsubmitted > 0; ring->unsubmitted--, count++) {
+        tail--;
+        struct io_uring_sqe *sqe = &((struct io_uring_sqe*) ring->sqes)[ring->sq_array[tail & *ring->sq_mask]];
+        checkpoint->in_flight--;
+        checkpoint_ring_abort(checkpoint, (CheckpointRequest*) (uintptr_t) sqe->user_data, ring->error);
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    CheckpointRequest *request;
+    while ((request = checkpoint_pop(&checkpoint->backlog, &checkpoint->backlog_tail))) {
+        checkpoint_ring_abort(checkpoint, request, ring->error);
+        count++;
+    }
+    return count;
+}
+
+static uint32_t checkpoint_ring_poll(Checkpoint *checkpoint, bool wait) {
+    CheckpointRing *ring = &checkpoint->ring;
+    bool waiting = wait && checkpoint->in_flight > 0;
+    bool failed = !ring->error && checkpoint_ring_enter(ring, waiting) < 0;
+    if (failed && errno != EINTR && errno != EAGAIN && errno != EBUSY) ring->error = errno;
+    uint32_t count = checkpoint_ring_reap(checkpoint);
+    if (ring->error) count += checkpoint_ring_fail(checkpoint);
+    else if (ring->unsubmitted) checkpoint_ring_enter(ring, false);
+
+    // Without a working wait, back off instead of spinning on the ring.
+    if (waiting && count == 0 && (failed || ring->error)) {
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, NULL);
+    }
+    return count;
+}
+
+#endif
+
+
+
+Checkpoint* checkpoint_init(uint32_t depth, enum CheckpointBackend backend) {
+    Checkpoint *checkpoint = (Checkpoint*) calloc(1, sizeof(Checkpoint));
+    if (!checkpoint) return NULL;
+    checkpoint->ring.fd = -1;
+    pthread_mutex_init(&checkpoint->lock, NULL);
+    pthread_cond_init(&checkpoint->work, NULL);
+    pthread_cond_init(&checkpoint->finished, NULL);
+
+#ifdef CHECKPOINT_HAVE_IO_URING
+    if (backend != CHECKPOINT_THREADS) {
+        if (checkpoint_ring_init(&checkpoint->ring, depth)) {
+            checkpoint->backend = CHECKPOINT_IO_URING;
+            return checkpoint;
+        }
+        checkpoint_ring_destroy(&checkpoint->ring);
+        memset(&checkpoint->ring, 0, sizeof(checkpoint->ring));
+        checkpoint->ring.fd = -1;
+    }
+#endif
+    if (backend == CHECKPOINT_IO_URING || !checkpoint_threads_init(checkpoint, depth)) {
+        checkpoint_destroy(checkpoint);
+        return NULL;
+    }
+    checkpoint->backend = CHECKPOINT_THREADS;
+    return checkpoint;
+}
+
+void checkpoint_destroy(Checkpoint *checkpoint) {
+    if (!checkpoint) return;
+    checkpoint_drain(checkpoint);
+    pthread_mutex_lock(&checkpoint->lock);
+    checkpoint->stopping = true;
+    pthread_cond_broadcast(&checkpoint->work);
+    pthread_mutex_unlock(&checkpoint->lock);
+    for (unsigned i = 0; i < checkpoint->worker_count; i++)
+        pthread_join(checkpoint->workers[i], NULL);
+    free(checkpoint->workers);
+#ifdef CHECKPOINT_HAVE_IO_URING
+    checkpoint_ring_destroy(&checkpoint->ring);
+#endif
+    pthread_cond_destroy(&checkpoint->finished);
+    pthread_cond_destroy(&checkpoint->work);
+    pthread_mutex_destroy(&checkpoint->lock);
+    free(checkpoint);
+}
+
+bool checkpoint_write(Checkpoint *checkpoint, const char *path, const NesState *state,
+                      CheckpointCallback callback, void *context) {
+    CheckpointRequest *request = checkpoint_request(path, state, callback, context);
+    if (!request) return false;
+    checkpoint->pending++;
+#ifdef CHECKPOINT_HAVE_IO_URING
+    if (checkpoint->backend == CHECKPOINT_IO_URING) {
+        checkpoint_ring_queue(checkpoint, request);
+        return true;
+    }
+#endif
+    pthread_mutex_lock(&checkpoint->lock);
+    checkpoint_append(&checkpoint->jobs, &checkpoint->jobs_tail, request);
+    pthread_cond_signal(&checkpoint->work);
+    pthread_mutex_unlock(&checkpoint->lock);
+    return true;
+}
+
+static uint32_t checkpoint_poll_once(Checkpoint *checkpoint, bool wait) {
+#ifdef CHECKPOINT_HAVE_IO_URING
+    if (checkpoint->backend == CHECKPOINT_IO_URING) return checkpoint_ring_poll(checkpoint, wait);
+#endif
+    return checkpoint_threads_poll(checkpoint, wait);
+}
+
+uint32_t checkpoint_poll(Checkpoint *checkpoint) {
+    return checkpoint_poll_once(checkpoint, false);
+}
+
+void checkpoint_drain(Checkpoint *checkpoint) {
+    while (checkpoint->pending > 0)
+        checkpoint_poll_once(checkpoint, true);
+}
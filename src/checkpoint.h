@@ -0,0 +1,41 @@
+#ifndef MACNES_CHECKPOINT_H
+#define MACNES_CHECKPOINT_H
+
+#include "defs.h"
+
+// Asynchronous save-state writer. Each checkpoint is written as a save
+// state file (see savestate.h): the small head is encoded per request and
+// the RAM chunk goes to disk straight from the caller's NesState, which
+// must stay untouched until its callback has run.
+//
+// With io_uring the open, write and close of every request are ring
+// operations, and requests queued between two polls go to the kernel in a
+// single submission. Otherwise a small thread pool does plain blocking I/O.
+// Either way callbacks only run inside checkpoint_poll and
+// checkpoint_drain, on the calling thread, and checkpoint_write never
+// waits for storage. The ring is used when the kernel supports every
+// operation the writer needs (5.6 and later).
+//
+// A writer belongs to one thread: checkpoint_write, checkpoint_poll and
+// checkpoint_drain must not be called concurrently on the same writer.
+// If the ring stops accepting submissions, writes it has not taken fail
+// with that error and later ones fail at the next poll.
+
+// `depth` bounds the operations kept in the io_uring submission queue, or
+// is the number of threads for the fallback.
+Checkpoint* checkpoint_init(uint32_t depth, enum CheckpointBackend backend);
+
+// Waits for every outstanding write, running their callbacks.
+void checkpoint_destroy(Checkpoint *checkpoint);
+
+bool checkpoint_write(Checkpoint *checkpoint, const char *path, const NesState *state,
+                      CheckpointCallback callback, void *context);
+
+// Submits queued work and runs the callbacks of finished writes without
+// blocking. Returns the number of callbacks run.
+uint32_t checkpoint_poll(Checkpoint *checkpoint);
+
+// Blocks until every write so far has finished and called back.
+void checkpoint_drain(Checkpoint *checkpoint);
+
+#endif
@@ -0,0 +1,113 @@
+#include <string.h>
+#include "stdbool.h"
+#include "codec.h"
+
+#define CODEC_MIN_RUN 4
+
+size_t codec_bound(size_t size) {
+    return size * 2 + 16;
+}
+
+static size_t codec_put_varint(uint8_t *out, size_t at, size_t value) {
+    while (value >= 0x80) {
+        out[at++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    out[at++] = (uint8_t) value;
+    return at;
+}
+
+static size_t codec_get_varint(const uint8_t *in, size_t size, size_t *at, size_t *value) {
+    size_t result = 0;
+    for (int shift = 0; *at < size && shift < 64; shift += 7) {
+        uint8_t byte = in[(*at)++];
+        result |= (size_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline uint8_t codec_byte(const uint8_t *in, const uint8_t *base, size_t i) {
+    return base ? in[i] ^ base[i] : in[i];
+}
+
+static size_t codec_zero_run(const uint8_t *in, const uint8_t *base, size_t i, size_t size) {
+    size_t start = i;
+    while (i + 8 <= size) {
+        uint64_t a, b = 0;
+        memcpy(&a, in + i, 8);
+        if (base) memcpy(&b, base + i, 8);
+        if (a != b) break;
+        i += 8;
+    }
+    while (i < size && codec_byte(in, base, i) == 0) i++;
+    return i - start;
+}
+
+size_t codec_compress_xor(const uint8_t *in, const uint8_t *base, size_t size,
+                          uint8_t *out, size_t capacity) {
+    if (capacity < codec_bound(size)) return 0;
+    size_t at = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = codec_zero_run(in, base, i, size);
+        i += zeros;
+
+        size_t literal = i;
+        size_t run = 0;
+        size_t end = size;
+        for (size_t j = i; j < size; j++) {
+            run = codec_byte(in, base, j) == 0 ? run + 1 : 0;
+            if (run == CODEC_MIN_RUN) {
+                end = j + 1 - CODEC_MIN_RUN;
+                break;
+            }
+        }
+
+        at = codec_put_varint(out, at, zeros);
+        at = codec_put_varint(out, at, end - literal);
+        for (size_t j = literal; j < end; j++)
+            out[at++] = codec_byte(in, base, j);
+        i = end;
+    }
+    return at;
+}
+
+size_t codec_compress(const uint8_t *in, size_t size, uint8_t *out, size_t capacity) {
+    return codec_compress_xor(in, NULL, size, out, capacity);
+}
+
+static size_t codec_decode(const uint8_t *in, size_t size, uint8_t *out, size_t capacity, bool xor) {
+    size_t at = 0;
+    size_t produced = 0;
+    while (at < size) {
+        size_t zeros, literal;
+        if (!codec_get_varint(in, size, &at, &zeros)) return 0;
+        if (!codec_get_varint(in, size, &at, &literal)) return 0;
+        if (zeros > capacity - produced || literal > capacity - produced - zeros) return 0;
+        if (literal > size - at) return 0;
+
+        if (!xor) memset(out + produced, 0, zeros);
+        produced += zeros;
+        if (xor) {
+            for (size_t j = 0; j < literal; j++)
+                out[produced + j] ^= in[at + j];
+        } else {
+            memcpy(out + produced, in + at, literal);
+        }
+        produced += literal;
+        at += literal;
+    }
+    return produced;
+}
+
+size_t codec_decompress(const uint8_t *in, size_t size, uint8_t *out, size_t capacity) {
+    return codec_decode(in, size, out, capacity, false);
+}
+
+size_t codec_apply_xor(const uint8_t *in, size_t size, uint8_t *out, size_t capacity) {
+    return codec_decode(in, size, out, capacity, true);
+}
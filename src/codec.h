@@ -0,0 +1,26 @@
+#ifndef MACNES_CODEC_H
+#define MACNES_CODEC_H
+
+#include <stddef.h>
+#include "stdint.h"
+
+// Zero-run byte codec for machine state deltas. The stream is a sequence of
+// (varint zero count, varint literal count, literal bytes) tokens. Both
+// compress calls return 0 if `capacity` is too small; codec_bound(size)
+// is always enough.
+
+size_t codec_bound(size_t size);
+
+size_t codec_compress(const uint8_t *in, size_t size, uint8_t *out, size_t capacity);
+
+// Compresses in XOR base without materialising the delta.
+size_t codec_compress_xor(const uint8_t *in, const uint8_t *base, size_t size,
+                          uint8_t *out, size_t capacity);
+
+// Both return the number of bytes produced, or 0 on a malformed stream.
+size_t codec_decompress(const uint8_t *in, size_t size, uint8_t *out, size_t capacity);
+
+// XORs a compressed delta onto out; zero runs are skipped.
+size_t codec_apply_xor(const uint8_t *in, size_t size, uint8_t *out, size_t capacity);
+
+#endif
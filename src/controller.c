@@ -0,0 +1,34 @@
+#include <stdlib.h>
+#include "controller.h"
+
+Controller* controller_init() {
+    return (Controller*) calloc(1, sizeof(Controller));
+}
+
+void controller_destroy(Controller *controller) {
+    free(controller);
+}
+
+void controller_set(Controller *controller, uint8_t port, uint8_t buttons) {
+    controller->buttons[port & 1] = buttons;
+    if (controller->strobe) controller->shift[port & 1] = buttons;
+}
+
+void controller_write(Controller *controller, uint8_t data) {
+    controller->strobe = data & 1;
+    if (controller->strobe) {
+        controller->shift[0] = controller->buttons[0];
+        controller->shift[1] = controller->buttons[1];
+    }
+}
+
+// Buttons are shifted out A first; after eight reads the official pads
+// return 1. Upper bits are open bus, which reads back as 0x40 here.
+uint8_t controller_read(Controller *controller, uint8_t port) {
+    port &= 1;
+    controller->polled = true;
+    if (controller->strobe) return 0x40 | (controller->buttons[port] & 1);
+    uint8_t bit = controller->shift[port] & 1;
+    controller->shift[port] = (controller->shift[port] >> 1) | 0x80;
+    return 0x40 | bit;
+}
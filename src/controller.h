@@ -0,0 +1,17 @@
+#ifndef MACNES_CONTROLLER_H
+#define MACNES_CONTROLLER_H
+
+#include "stdint.h"
+#include "defs.h"
+
+Controller* controller_init();
+
+void controller_destroy(Controller *controller);
+
+void controller_set(Controller *controller, uint8_t port, uint8_t buttons);
+
+void controller_write(Controller *controller, uint8_t data);
+
+uint8_t controller_read(Controller *controller, uint8_t port);
+
+#endif
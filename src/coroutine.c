@@ -0,0 +1,238 @@
+#if !defined(__x86_64__) || defined(MACNES_COROUTINE_UCONTEXT)
+#define COROUTINE_UCONTEXT 1
+#define _XOPEN_SOURCE 700
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "coroutine.h"
+
+#ifdef COROUTINE_UCONTEXT
+#include <ucontext.h>
+#endif
+
+#ifdef __APPLE__
+#define COROUTINE_SYMBOL(name) "_" #name
+#else
+#define COROUTINE_SYMBOL(name) #name
+#endif
+
+static void coroutine_main(Coroutine *coroutine);
+
+
+
+// Context switching
+
+#ifndef COROUTINE_UCONTEXT
+
+void macnes_coroutine_swap(void **save_sp, void *load_sp);
+void macnes_coroutine_boot(void);
+
+// Saves the System V callee-saved registers on the current stack, stores
+// its pointer in `save_sp` and returns into the stack at `load_sp`.
+// A new coroutine's first switch returns into the boot stub, which calls
+// coroutine_main(rbx) through r12 on an aligned stack.
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    COROUTINE_SYMBOL(macnes_coroutine_swap) ":\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".p2align 4\n"
+    COROUTINE_SYMBOL(macnes_coroutine_boot) ":\n"
+    "    movq %rbx, %rdi\n"
+    "    andq $-16, %rsp\n"
+    "    call *%r12\n"
+    "    ud2\n"
+);
+
+static void coroutine_prepare(Coroutine *coroutine) {
+    void **sp = (void**) (((uintptr_t) (coroutine->stack + coroutine->stack_size)) & ~(uintptr_t) 15);
+    *--sp = NULL;
+    *--sp = (void*) macnes_coroutine_boot;
+    *--sp = NULL;                               // rbp
+    *--sp = coroutine;                          // rbx
+    *--sp = (void*) coroutine_main;             // r12
+    *--sp = NULL;                               // r13
+    *--sp = NULL;                               // r14
+    *--sp = NULL;                               // r15
+    coroutine->sp = sp;
+}
+
+static inline void coroutine_enter(Coroutine *coroutine) {
+    macnes_coroutine_swap(&coroutine->caller_sp, coroutine->sp);
+}
+
+static inline void coroutine_leave(Coroutine *coroutine) {
+    macnes_coroutine_swap(&coroutine->sp, coroutine->caller_sp);
+}
+
+#else
+
+typedef struct {
+    ucontext_t  self;
+    ucontext_t  caller;
+} CoroutineFallback;
+
+// makecontext only passes ints, so the pointer travels in two halves.
+static void coroutine_fallback_main(unsigned int hi, unsigned int lo) {
+    coroutine_main((Coroutine*) (uintptr_t) (((uint64_t) hi << 32) | lo));
+}
+
+static void coroutine_prepare(Coroutine *coroutine) {
+    CoroutineFallback *fallback = (CoroutineFallback*) calloc(1, sizeof(CoroutineFallback));
+    coroutine->fallback = fallback;
+    if (!fallback || getcontext(&fallback->self) != 0) return;
+    fallback->self.uc_stack.ss_sp = coroutine->stack;
+    fallback->self.uc_stack.ss_size = coroutine->stack_size;
+    fallback->self.uc_link = NULL;
+    uint64_t address = (uint64_t) (uintptr_t) coroutine;
+    makecontext(&fallback->self, (void (*)(void)) coroutine_fallback_main, 2,
+                (unsigned int) (address >> 32), (unsigned int) address);
+    coroutine->sp = coroutine->stack;
+}
+
+static inline void coroutine_enter(Coroutine *coroutine) {
+    CoroutineFallback *fallback = (CoroutineFallback*) coroutine->fallback;
+    swapcontext(&fallback->caller, &fallback->self);
+}
+
+static inline void coroutine_leave(Coroutine *coroutine) {
+    CoroutineFallback *fallback = (CoroutineFallback*) coroutine->fallback;
+    swapcontext(&fallback->self, &fallback->caller);
+}
+
+#endif
+
+static void coroutine_main(Coroutine *coroutine) {
+    coroutine->entry(coroutine->context);
+    coroutine->done = true;
+    coroutine_leave(coroutine);
+}
+
+Coroutine* coroutine_init(CoroutineEntry entry, void *context, size_t stack_size) {
+    Coroutine *coroutine = (Coroutine*) calloc(1, sizeof(Coroutine));
+    if (!coroutine) return NULL;
+    coroutine->stack_size = stack_size ? stack_size : COROUTINE_STACK_SIZE;
+    coroutine->stack = (uint8_t*) malloc(coroutine->stack_size);
+    coroutine->entry = entry;
+    coroutine->context = context;
+    if (coroutine->stack) coroutine_prepare(coroutine);
+    if (!coroutine->sp) {
+        coroutine_destroy(coroutine);
+        return NULL;
+    }
+    return coroutine;
+}
+
+void coroutine_destroy(Coroutine *coroutine) {
+    if (!coroutine) return;
+    free(coroutine->fallback);
+    free(coroutine->stack);
+    free(coroutine);
+}
+
+bool coroutine_resume(Coroutine *coroutine) {
+    if (coroutine->done) return false;
+    coroutine_enter(coroutine);
+    return !coroutine->done;
+}
+
+void coroutine_yield(Coroutine *coroutine) {
+    coroutine_leave(coroutine);
+}
+
+
+
+// Scheduler
+
+Scheduler* scheduler_init() {
+    return (Scheduler*) calloc(1, sizeof(Scheduler));
+}
+
+void scheduler_destroy(Scheduler *scheduler) {
+    if (!scheduler) return;
+    for (uint32_t i = 0; i < scheduler->count; i++)
+        coroutine_destroy(scheduler->components[i].coroutine);
+    free(scheduler);
+}
+
+// First resumed with `running` naming it.
+static void scheduler_component_main(void *context) {
+    Scheduler *scheduler = (Scheduler*) context;
+    uint32_t component = scheduler->running;
+    scheduler->components[component].entry(scheduler, component, scheduler->components[component].context);
+}
+
+int scheduler_add(Scheduler *scheduler, SchedulerEntry entry, void *context, size_t stack_size) {
+    if (scheduler->count == SCHEDULER_COMPONENTS) return -1;
+    Coroutine *coroutine = coroutine_init(scheduler_component_main, scheduler, stack_size);
+    if (!coroutine) return -1;
+    SchedulerComponent *component = &scheduler->components[scheduler->count];
+    component->coroutine = coroutine;
+    component->clock = 0;
+    component->entry = entry;
+    component->context = context;
+    component->busy = false;
+    return (int) scheduler->count++;
+}
+
+static bool scheduler_others_behind(const Scheduler *scheduler, uint32_t component) {
+    uint64_t clock = scheduler->components[component].clock;
+    for (uint32_t i = 0; i < scheduler->count; i++) {
+        const SchedulerComponent *other = &scheduler->components[i];
+        if (i == component || other->coroutine->done) continue;
+        if (other->clock < clock || (other->clock == clock && i < component)) return true;
+    }
+    return false;
+}
+
+static bool scheduler_any_busy(const Scheduler *scheduler) {
+    for (uint32_t i = 0; i < scheduler->count; i++)
+        if (scheduler->components[i].busy && !scheduler->components[i].coroutine->done) return true;
+    return false;
+}
+
+void scheduler_sync(Scheduler *scheduler, uint32_t component) {
+    scheduler->components[component].busy = false;
+    while ((scheduler->components[component].clock >= scheduler->until && !scheduler_any_busy(scheduler))
+           || scheduler_others_behind(scheduler, component))
+        coroutine_yield(scheduler->components[component].coroutine);
+}
+
+void scheduler_wait(Scheduler *scheduler, uint32_t component) {
+    scheduler->components[component].busy = true;
+    while (scheduler_others_behind(scheduler, component))
+        coroutine_yield(scheduler->components[component].coroutine);
+}
+
+void scheduler_run(Scheduler *scheduler, uint64_t until) {
+    scheduler->until = until;
+    scheduler->active = true;
+    for (;;) {
+        int next = -1;
+        for (uint32_t i = 0; i < scheduler->count; i++) {
+            const SchedulerComponent *component = &scheduler->components[i];
+            if (component->coroutine->done) continue;
+            if (next < 0 || component->clock < scheduler->components[next].clock) next = (int) i;
+        }
+        if (next < 0 || (scheduler->components[next].clock >= until && !scheduler_any_busy(scheduler))) break;
+        scheduler->running = (uint32_t) next;
+        scheduler->switches++;
+        coroutine_resume(scheduler->components[next].coroutine);
+    }
+    scheduler->active = false;
+}
@@ -0,0 +1,60 @@
+#ifndef MACNES_COROUTINE_H
+#define MACNES_COROUTINE_H
+
+#include "defs.h"
+
+// Cooperative coroutines on their own small stacks, so a component can be
+// written as straight-line code that suspends in the middle of an
+// instruction instead of as a per-cycle state machine. On x86-64 a switch
+// saves and restores the callee-saved registers and the stack pointer and
+// nothing else, a few nanoseconds; other targets fall back to ucontext.
+
+Coroutine* coroutine_init(CoroutineEntry entry, void *context, size_t stack_size);
+
+// Frees the stack. A coroutine that has not finished is simply dropped.
+void coroutine_destroy(Coroutine *coroutine);
+
+// Runs the coroutine until it yields or its entry returns. Returns false
+// once it has finished.
+bool coroutine_resume(Coroutine *coroutine);
+
+// Called on the coroutine's own stack: suspends it, returning from the
+// coroutine_resume that ran it.
+void coroutine_yield(Coroutine *coroutine);
+
+
+
+// Components as coroutines, each with its own clock in a common time base.
+// A component advances its clock as it works and calls scheduler_sync
+// before any access another component must have caught up to; it is only
+// suspended if some other component really is behind it, so components
+// that never touch each other's state run without switching.
+
+Scheduler* scheduler_init();
+
+void scheduler_destroy(Scheduler *scheduler);
+
+// Adds a component starting at clock 0. Returns its index, or -1 if the
+// scheduler is full or the stack cannot be allocated.
+int scheduler_add(Scheduler *scheduler, SchedulerEntry entry, void *context, size_t stack_size);
+
+static inline void scheduler_advance(Scheduler *scheduler, uint32_t component, uint64_t cycles) {
+    scheduler->components[component].clock += cycles;
+}
+
+// Suspends the component while any other is behind it, or once it has
+// reached the end of the current scheduler_run. At equal clocks the
+// component added first counts as behind.
+void scheduler_sync(Scheduler *scheduler, uint32_t component);
+
+// scheduler_sync for a point a run must not end at, such as the middle of
+// a CPU instruction: only waits for components behind it, and the run goes
+// on past `until` until the component gets back to a scheduler_sync.
+void scheduler_wait(Scheduler *scheduler, uint32_t component);
+
+// Resumes the component furthest behind until every unfinished component
+// has reached `until` and none is between a scheduler_wait and its next
+// scheduler_sync. `active` is set for the length of the call.
+void scheduler_run(Scheduler *scheduler, uint64_t until);
+
+#endif
@@ -1,16 +1,29 @@
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include "cpu.h"
 #include "bus.h"
 
+static void cpu_counters_prepare(CpuCounters *counters);
+
 uint8_t cpu_get_flag(CPU *cpu, enum CpuFlag flag);
 void cpu_set_flag(CPU *cpu, enum CpuFlag flag, bool value);
 
 CPU* cpu_init() {
-    return (CPU*) calloc(1, sizeof(CPU));
+    CPU *cpu = (CPU*) calloc(1, sizeof(CPU));
+    if (cpu && CPU_COUNTING) {
+        cpu->counters = (CpuCounters*) calloc(1, sizeof(CpuCounters));
+        if (!cpu->counters) {
+            free(cpu);
+            return NULL;
+        }
+        cpu_counters_prepare(cpu->counters);
+    }
+    return cpu;
 }
 
 void cpu_destroy(CPU *cpu) {
+    if (cpu) free(cpu->counters);
     free(cpu);
 }
 
@@ -29,10 +42,6 @@ void cpu_reset(CPU *cpu) {
     cpu->cycles = 8;
 }
 
-uint8_t cpu_fetch_operand(CPU *cpu) {
-    return cpu->is_am_imm ? cpu->a : bus_read(cpu->bus, cpu->addr_abs);
-}
-
 
 
 // Flags
@@ -48,658 +57,225 @@ void cpu_set_flag(CPU *cpu, enum CpuFlag flag, bool value) {
 
 
 
-// Addressing modes
-
-uint8_t am_IMP(CPU *cpu) {
-    cpu->is_am_imm = true;
-    return 0;
-}
-
-uint8_t am_IMM(CPU *cpu) {
-    cpu->addr_abs = cpu->pc++;
-    return 0;
-}
-
-uint8_t am_ZP0(CPU *cpu) {
-    cpu->addr_abs = bus_read(cpu->bus, cpu->pc++);
-    cpu->addr_abs &= 0x00FF;
-    return 0;
-}
-
-uint8_t am_ZPX(CPU *cpu) {
-    cpu->addr_abs = cpu->x + bus_read(cpu->bus, cpu->pc++);
-    cpu->addr_abs &= 0x00FF;
-    return 0;
-}
-
-uint8_t am_ZPY(CPU *cpu) {
-    cpu->addr_abs = cpu->y + bus_read(cpu->bus, cpu->pc++);
-    cpu->addr_abs &= 0x00FF;
-    return 0;
-}
-
-uint8_t am_REL(CPU *cpu) {
-    cpu->addr_rel = bus_read(cpu->bus, cpu->pc++);
-    if (cpu->addr_rel & 0x80) cpu->addr_rel |= 0xFF00;
-    return 0;
-}
-
-uint8_t am_ABS(CPU *cpu) {
-    uint8_t lo = bus_read(cpu->bus, cpu->pc++);
-    uint8_t hi = bus_read(cpu->bus, cpu->pc++);
-    cpu->addr_abs = (hi << 8) | lo;
-    return 0;
-}
-
-uint8_t am_ABX(CPU *cpu) {
-    uint8_t lo = bus_read(cpu->bus, cpu->pc++);
-    uint8_t hi = bus_read(cpu->bus, cpu->pc++);
-    cpu->addr_abs = ((hi << 8) | lo) + cpu->x;
-    return (cpu->addr_abs & 0xFF00) != (hi << 8) ? 1 : 0;
-}
-
-uint8_t am_ABY(CPU *cpu) {
-    uint8_t lo = bus_read(cpu->bus, cpu->pc++);
-    uint8_t hi = bus_read(cpu->bus, cpu->pc++);
-    cpu->addr_abs = ((hi << 8) | lo) + cpu->y;
-    return (cpu->addr_abs & 0xFF00) != (hi << 8) ? 1 : 0;
-}
-
-uint8_t am_IND(CPU *cpu) {
-    uint16_t ptr_lo = bus_read(cpu->bus, cpu->pc++);
-    uint16_t ptr_hi = bus_read(cpu->bus, cpu->pc++);
-    uint16_t ptr = (ptr_hi << 8) | ptr_lo;
-    if (ptr_lo == 0x00FF)
-        cpu->addr_abs = (bus_read(cpu->bus, ptr & 0xFF00) << 8)
-                        | bus_read(cpu->bus, ptr);
-    else
-        cpu->addr_abs = (bus_read(cpu->bus, ptr + 1) << 8)
-                        | bus_read(cpu->bus, ptr);
-    return 0;
-}
-
-uint8_t am_IZX(CPU *cpu) {
-    uint16_t t = bus_read(cpu->bus, cpu->pc++);
-    uint16_t lo = bus_read(cpu->bus, (uint16_t)(t + (uint16_t) cpu->x) & 0x00FF);
-    uint16_t hi = bus_read(cpu->bus, (uint16_t)(t + (uint16_t) cpu->x + 1) & 0x00FF);
-    cpu->addr_abs = (hi << 8) | lo;
-    return 0;
-}
-
-uint8_t am_IZY(CPU *cpu) {
-    uint16_t t = bus_read(cpu->bus, cpu->pc++);
-    uint16_t lo = bus_read(cpu->bus, t & 0x00FF);
-    uint16_t hi = bus_read(cpu->bus, (t + 1) & 0x00FF);
-    cpu->addr_abs = cpu->y + ((hi << 8) | lo);
-    return (cpu->addr_abs & 0xFF00) != (hi << 8) ? 1 : 0;
-}
-
-
-
-// Instructions
-
-uint8_t i_ADC(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp = (uint16_t) cpu->a + (uint16_t) op + (uint16_t) cpu_get_flag(cpu, C);
-    cpu_set_flag(cpu, C, temp > 0xFF);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, V, (~((uint16_t) cpu->a ^ (uint16_t) op) & ((uint16_t) cpu->a ^ (uint16_t)temp)) & 0x0080);
-    cpu_set_flag(cpu, N, (temp & 0x80));
-    cpu->a = temp & 0x00FF;
-    return 1;
-}
-
-uint8_t i_SBC(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t value = (uint16_t) op ^ 0x00FF;
-    uint16_t temp = (uint16_t) cpu->a + value + (uint16_t) cpu_get_flag(cpu, C);
-    cpu_set_flag(cpu, C, temp > 0xFF);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, V, (temp ^ (uint16_t) cpu->a) & (temp ^ value) & 0x0080);
-    cpu_set_flag(cpu, N, temp & 0x80);
-    cpu->a = temp & 0x00FF;
-    return 1;
-}
-
-uint8_t i_AND(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    cpu->a &= op;
-    cpu_set_flag(cpu, Z, cpu->a == 0);
-    cpu_set_flag(cpu, N, cpu->a & 0x80);
-    return 1;
-}
-
-uint8_t i_ASL(CPU *cpu) {
-    uint16_t op = cpu_fetch_operand(cpu);
-    uint16_t value = op << 1;
-    cpu_set_flag(cpu, C, value & 0xFF00);
-    cpu_set_flag(cpu, Z, (value & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, value & 0x80);
-    if (cpu->is_am_imm) cpu->a = value & 0x00FF;
-    else bus_write(cpu->bus, cpu->addr_abs, value & 0x00FF);
-    return 0;
-}
-
-uint8_t cpu_branch_conditional(CPU *cpu, bool condition) {
-    if (!condition) return 0;
-    cpu->cycles++;
-    cpu->addr_abs = cpu->pc + cpu->addr_rel;
-    if ((cpu->addr_abs & 0xFF00) != (cpu->pc & 0xFF00))
-        cpu->cycles++;
-    cpu->pc = cpu->addr_abs;
-    return 0;
-}
-
-uint8_t i_BCC(CPU *cpu) {
-    return cpu_branch_conditional(cpu, !cpu_get_flag(cpu, C));
-}
-
-uint8_t i_BCS(CPU *cpu) {
-    return cpu_branch_conditional(cpu, cpu_get_flag(cpu, C));
-}
+// Fast tier
+
+// Whole instructions at once: the bus sees only the accesses that carry
+// data, and the clock moves when the instruction is done.
+#define CPU_INSTRUCTION_BEGIN(cpu) ((void) 0)
+#define CPU_READ(cpu, address) (CPU_COUNT_READ(cpu), bus_read((cpu)->bus, address))
+#define CPU_WRITE(cpu, address, data) bus_write((cpu)->bus, address, data)
+#define CPU_DUMMY_READ(cpu, address) ((void) 0)
+#define CPU_DUMMY_WRITE(cpu, address, data) ((void) 0)
+#define am_ABXW am_ABX
+#define am_ABYW am_ABY
+#define am_IZYW am_IZY
+
+#include "cpu_core.h"
+
+CpuInstruction cpu_instruction(uint8_t opcode) {
+    return CPU_INSTRUCTION_LOOKUP[opcode];
+}
+
+typedef struct {
+    CpuOperation    function;
+    const char      *name;
+} CpuFunctionName;
+
+static const CpuFunctionName CPU_FUNCTION_NAMES[] = {
+    {am_IMP, "am_IMP"}, {am_IMM, "am_IMM"}, {am_ZP0, "am_ZP0"}, {am_ZPX, "am_ZPX"},
+    {am_ZPY, "am_ZPY"}, {am_REL, "am_REL"}, {am_ABS, "am_ABS"}, {am_ABX, "am_ABX"},
+    {am_ABY, "am_ABY"}, {am_IND, "am_IND"}, {am_IZX, "am_IZX"}, {am_IZY, "am_IZY"},
+    {i_ADC, "i_ADC"}, {i_AND, "i_AND"}, {i_ASL, "i_ASL"}, {i_BCC, "i_BCC"}, {i_BCS, "i_BCS"},
+    {i_BEQ, "i_BEQ"}, {i_BIT, "i_BIT"}, {i_BMI, "i_BMI"}, {i_BNE, "i_BNE"}, {i_BPL, "i_BPL"},
+    {i_BRK, "i_BRK"}, {i_BVC, "i_BVC"}, {i_BVS, "i_BVS"}, {i_CLC, "i_CLC"}, {i_CLD, "i_CLD"},
+    {i_CLI, "i_CLI"}, {i_CLV, "i_CLV"}, {i_CMP, "i_CMP"}, {i_CPX, "i_CPX"}, {i_CPY, "i_CPY"},
+    {i_DEC, "i_DEC"}, {i_DEX, "i_DEX"}, {i_DEY, "i_DEY"}, {i_EOR, "i_EOR"}, {i_INC, "i_INC"},
+    {i_INX, "i_INX"}, {i_INY, "i_INY"}, {i_JMP, "i_JMP"}, {i_JSR, "i_JSR"}, {i_LDA, "i_LDA"},
+    {i_LDX, "i_LDX"}, {i_LDY, "i_LDY"}, {i_LSR, "i_LSR"}, {i_NOP, "i_NOP"}, {i_ORA, "i_ORA"},
+    {i_PHA, "i_PHA"}, {i_PHP, "i_PHP"}, {i_PLA, "i_PLA"}, {i_PLP, "i_PLP"}, {i_ROL, "i_ROL"},
+    {i_ROR, "i_ROR"}, {i_RTI, "i_RTI"}, {i_RTS, "i_RTS"}, {i_SBC, "i_SBC"}, {i_SEC, "i_SEC"},
+    {i_SED, "i_SED"}, {i_SEI, "i_SEI"}, {i_STA, "i_STA"}, {i_STX, "i_STX"}, {i_STY, "i_STY"},
+    {i_TAX, "i_TAX"}, {i_TAY, "i_TAY"}, {i_TSX, "i_TSX"}, {i_TXA, "i_TXA"}, {i_TXS, "i_TXS"},
+    {i_TYA, "i_TYA"},
+};
 
-uint8_t i_BEQ(CPU *cpu) {
-    return cpu_branch_conditional(cpu, cpu_get_flag(cpu, Z));
+const char* cpu_function_name(CpuOperation function) {
+    for (size_t i = 0; i < sizeof(CPU_FUNCTION_NAMES) / sizeof(CPU_FUNCTION_NAMES[0]); i++)
+        if (CPU_FUNCTION_NAMES[i].function == function) return CPU_FUNCTION_NAMES[i].name;
+    return NULL;
 }
 
-uint8_t i_BIT(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp = cpu->a & op;
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, op & (1 << 7));
-    cpu_set_flag(cpu, V, op & (1 << 6));
-    return 0;
+void cpu_clock(CPU *cpu) {
+    if (cpu->cycles == 0) cpu_execute(cpu);
+    cpu->cycles--;
+    cpu->clock_count++;
 }
 
-uint8_t i_BMI(CPU *cpu) {
-    return cpu_branch_conditional(cpu, cpu_get_flag(cpu, N));
-}
 
-uint8_t i_BNE(CPU *cpu) {
-    return cpu_branch_conditional(cpu, !cpu_get_flag(cpu, Z));
-}
 
-uint8_t i_BPL(CPU *cpu) {
-    return cpu_branch_conditional(cpu, !cpu_get_flag(cpu, N));
-}
+// Fused dispatch
 
-uint8_t i_BRK(CPU *cpu) {
+// cpu_execute and cpu_step's bookkeeping for an opcode already fetched. With
+// a constant opcode the lookup folds away and the handlers are called, and
+// usually inlined, directly.
+static inline void cpu_run_opcode(CPU *cpu, uint8_t opcode) {
+    CpuInstruction instruction = CPU_INSTRUCTION_LOOKUP[opcode];
+    CPU_COUNT_BEGIN(cpu);
+    CPU_COUNT_READ(cpu);
+    cpu->opcode = opcode;
+    CPU_COUNT_DECODE(cpu);
+    cpu_set_flag(cpu, U, true);
     cpu->pc++;
-    cpu_set_flag(cpu, I, true);
-    bus_write(cpu->bus, 0x0100 + cpu->sp, (cpu->pc >> 8) & 0x00FF);
-    cpu->sp--;
-    bus_write(cpu->bus, 0x0100 + cpu->sp, cpu->pc & 0x00FF);
-    cpu->sp--;
-    cpu_set_flag(cpu, B, true);
-    cpu->pc = (uint16_t) bus_read(cpu->bus, 0xFFFE)
-            | ((uint16_t) bus_read(cpu->bus, 0xFFFF) << 8);
-    return 0;
-}
-
-uint8_t i_BVC(CPU *cpu) {
-    return cpu_branch_conditional(cpu, !cpu_get_flag(cpu, V));
-}
-
-uint8_t i_BVS(CPU *cpu) {
-    return cpu_branch_conditional(cpu, cpu_get_flag(cpu, V));
-}
-
-uint8_t i_CLC(CPU *cpu) {
-    cpu_set_flag(cpu, C, false);
-    return 0;
-}
-
-uint8_t i_CLD(CPU *cpu) {
-    cpu_set_flag(cpu, D, false);
-    return 0;
-}
-
-uint8_t i_CLI(CPU *cpu) {
-    cpu_set_flag(cpu, I, false);
-    return 0;
-}
-
-uint8_t i_CLV(CPU *cpu) {
-    cpu_set_flag(cpu, V, false);
-    return 0;
-}
-
-uint8_t i_CMP(CPU *cpu) {
-    uint8_t  op = cpu_fetch_operand(cpu);
-    uint16_t temp =  (uint16_t) cpu->a - (uint16_t) op;
-    cpu_set_flag(cpu, C, cpu->a >= op);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    return 1;
-}
+    cpu->is_am_imm = false;
+    cpu->cycles = instruction.cycles;
+    uint8_t additional_cycles_am = instruction.am(cpu);
+    uint8_t additional_cycles_i = instruction.op(cpu);
+    if (additional_cycles_am & additional_cycles_i) CPU_COUNT_PAGE_CROSS(cpu);
+    cpu->cycles += additional_cycles_am & additional_cycles_i;
+    cpu_set_flag(cpu, U, true);
+    CPU_COUNT_RETIRE(cpu);
+    cpu->clock_count += cpu->cycles;
+    cpu->cycles = 0;
+}
+
+// The second half of a pair runs only where the interpreter would have gone
+// straight on to it: before `until`, the next mapper event or an IRQ, which
+// a write in the first half may have moved or raised.
+static inline bool cpu_pair_continues(CPU *cpu, uint64_t until, uint8_t second) {
+    const Bus *bus = cpu->bus;
+    if (cpu->clock_count >= until || cpu->clock_count >= bus->mapper_state.next_event) return false;
+    return !bus->mapper_state.irq && bus_read(cpu->bus, cpu->pc) == second;
+}
+
+#define CPU_PAIR(first, second) \
+    static uint8_t cpu_pair_##first##_##second(CPU *cpu, uint64_t until) { \
+        uint64_t start = cpu->clock_count; \
+        cpu_run_opcode(cpu, 0x##first); \
+        if (cpu_pair_continues(cpu, until, 0x##second)) cpu_run_opcode(cpu, 0x##second); \
+        return (uint8_t) (cpu->clock_count - start); \
+    }
 
-uint8_t i_CPX(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp =  (uint16_t) cpu->x - (uint16_t) op;
-    cpu_set_flag(cpu, C, cpu->x >= op);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    return 0;
+// The most frequent pair for each first opcode in cpu_profile_top's output
+// for an NROM frame loop (OAM clear, table copy, object update, delay), with
+// each pair's share of all pairs. Other programs will differ; profile them
+// with nes_profile_pairs before changing the table.
+CPU_PAIR(88, D0)    // DEY       BNE         38.5%
+CPU_PAIR(D0, 88)    // BNE       DEY         38.0%
+CPU_PAIR(9D, E8)    // STA abs,X INX          6.0%
+CPU_PAIR(E8, D0)    // INX       BNE          4.8%
+CPU_PAIR(BD, 9D)    // LDA abs,X STA abs,X    1.2%
+CPU_PAIR(E0, D0)    // CPX #     BNE          1.2%
+CPU_PAIR(18, 69)    // CLC       ADC #        0.3%
+CPU_PAIR(69, 99)    // ADC #     STA abs,Y    0.3%
+CPU_PAIR(99, 88)    // STA abs,Y DEY          0.3%
+
+uint8_t cpu_step_fused(CPU *cpu, uint64_t until) {
+    if (cpu->cycles) return cpu_step(cpu);
+    uint8_t opcode = bus_read(cpu->bus, cpu->pc);
+    switch (opcode) {
+        case 0x88: return cpu_pair_88_D0(cpu, until);
+        case 0xD0: return cpu_pair_D0_88(cpu, until);
+        case 0x9D: return cpu_pair_9D_E8(cpu, until);
+        case 0xE8: return cpu_pair_E8_D0(cpu, until);
+        case 0xBD: return cpu_pair_BD_9D(cpu, until);
+        case 0xE0: return cpu_pair_E0_D0(cpu, until);
+        case 0x18: return cpu_pair_18_69(cpu, until);
+        case 0x69: return cpu_pair_69_99(cpu, until);
+        case 0x99: return cpu_pair_99_88(cpu, until);
+    }
+    uint64_t start = cpu->clock_count;
+    cpu_run_opcode(cpu, opcode);
+    return (uint8_t) (cpu->clock_count - start);
 }
 
-uint8_t i_CPY(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp = (uint16_t) cpu->y - (uint16_t) op;
-    cpu_set_flag(cpu, C, cpu->y >= op);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    return 0;
-}
 
-uint8_t i_DEC(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp = op - 1;
-    bus_write(cpu->bus, cpu->addr_abs, temp & 0x00FF);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    return 0;
-}
 
-uint8_t i_DEX(CPU *cpu) {
-    cpu->x--;
-    cpu_set_flag(cpu, Z, cpu->x == 0x00);
-    cpu_set_flag(cpu, N, cpu->x & 0x80);
-    return 0;
-}
+// Pair profiling
 
-uint8_t i_DEY(CPU *cpu) {
-    cpu->y--;
-    cpu_set_flag(cpu, Z, cpu->y == 0x00);
-    cpu_set_flag(cpu, N, cpu->y & 0x80);
-    return 0;
+void cpu_profile_reset(CpuPairProfile *profile) {
+    memset(profile->counts, 0, sizeof(profile->counts));
+    profile->previous = -1;
 }
 
-uint8_t i_EOR(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    cpu->a ^= op;
-    cpu_set_flag(cpu, Z, cpu->a == 0x00);
-    cpu_set_flag(cpu, N, cpu->a & 0x80);
-    return 1;
+uint8_t cpu_step_profiled(CPU *cpu, CpuPairProfile *profile) {
+    if (cpu->cycles) return cpu_step(cpu);
+    uint8_t cycles = cpu_step(cpu);
+    if (profile->previous >= 0) profile->counts[profile->previous][cpu->opcode]++;
+    profile->previous = cpu->opcode;
+    return cycles;
 }
 
-uint8_t i_INC(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp = op + 1;
-    bus_write(cpu->bus, cpu->addr_abs, temp & 0x00FF);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0x0000);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    return 0;
+size_t cpu_profile_top(const CpuPairProfile *profile, CpuPairCount *top, size_t count) {
+    size_t found = 0;
+    for (int first = 0; first < 256; first++) {
+        for (int second = 0; second < 256; second++) {
+            uint64_t n = profile->counts[first][second];
+            if (!n || (found == count && n <= top[count - 1].count)) continue;
+            size_t i = found < count ? found++ : count - 1;
+            for (; i > 0 && top[i - 1].count < n; i--) top[i] = top[i - 1];
+            top[i].first = (uint8_t) first;
+            top[i].second = (uint8_t) second;
+            top[i].count = n;
+        }
+    }
+    return found;
 }
 
-uint8_t i_INX(CPU *cpu) {
-    cpu->x++;
-    cpu_set_flag(cpu, Z, cpu->x == 0);
-    cpu_set_flag(cpu, N, cpu->x & 0x80);
-    return 0;
-}
 
-uint8_t i_INY(CPU *cpu) {
-    cpu->y++;
-    cpu_set_flag(cpu, Z, cpu->y == 0);
-    cpu_set_flag(cpu, N, cpu->y & 0x80);
-    return 0;
-}
 
-uint8_t i_JMP(CPU *cpu) {
-    cpu->pc = cpu->addr_abs;
-    return 0;
-}
+// Interrupts
 
-uint8_t i_JSR(CPU *cpu) {
-    cpu->pc--;
+// Takes a pending IRQ unless interrupts are disabled. Must be called at an
+// instruction boundary; the seven cycles are counted like cpu_step's.
+bool cpu_irq(CPU *cpu) {
+    if (cpu_get_flag(cpu, I)) return false;
     bus_write(cpu->bus, 0x0100 + cpu->sp, (cpu->pc >> 8) & 0x00FF);
     cpu->sp--;
     bus_write(cpu->bus, 0x0100 + cpu->sp, cpu->pc & 0x00FF);
     cpu->sp--;
-    cpu->pc = cpu->addr_abs;
-    return 0;
-}
-
-uint8_t i_LDA(CPU *cpu) {
-    cpu->a = cpu_fetch_operand(cpu);
-    cpu_set_flag(cpu, Z, cpu->a == 0x00);
-    cpu_set_flag(cpu, N, cpu->a & 0x80);
-    return 0;
-}
-
-uint8_t i_LDX(CPU *cpu) {
-    cpu->x = cpu_fetch_operand(cpu);
-    cpu_set_flag(cpu, Z, cpu->x == 0x00);
-    cpu_set_flag(cpu, N, cpu->x & 0x80);
-    return 0;
-}
-
-uint8_t i_LDY(CPU *cpu) {
-    cpu->y = cpu_fetch_operand(cpu);
-    cpu_set_flag(cpu, Z, cpu->y == 0x00);
-    cpu_set_flag(cpu, N, cpu->y & 0x80);
-    return 0;
-}
-
-uint8_t i_LSR(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    cpu_set_flag(cpu, C, op & 0x0001);
-    uint16_t temp = op >> 1;
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    if (cpu->is_am_imm) cpu->a = temp & 0x00FF;
-    else bus_write(cpu->bus, cpu->addr_abs, temp & 0x00FF);
-    return 0;
-}
-
-uint8_t i_NOP(CPU *cpu) {
-    switch (cpu->opcode) {
-        case 0x1C:
-        case 0x3C:
-        case 0x5C:
-        case 0x7C:
-        case 0xDC:
-        case 0xFC:
-            return 1;
-        default:
-            return 0;
-    }
-}
-
-uint8_t i_ORA(CPU *cpu) {
-    cpu->a |= cpu_fetch_operand(cpu);
-    cpu_set_flag(cpu, Z, cpu->a == 0x00);
-    cpu_set_flag(cpu, N, cpu->a & 0x80);
-    return 0;
-}
-
-uint8_t i_PHA(CPU *cpu) {
-    bus_write(cpu->bus, 0x0100 + cpu->sp, cpu->a);
-    cpu->sp--;
-    return 0;
-}
-
-uint8_t i_PHP(CPU *cpu) {
-    cpu_set_flag(cpu, B, true);
-    cpu_set_flag(cpu, U, true);
-    bus_write(cpu->bus, 0x0100 + cpu->sp, cpu->status);
+    bus_write(cpu->bus, 0x0100 + cpu->sp, (cpu->status & ~B) | U);
     cpu->sp--;
-    return 0;
-}
-
-uint8_t i_PLA(CPU *cpu) {
-    cpu->sp++;
-    cpu->a = bus_read(cpu->bus, 0x0100 + cpu->sp);
-    cpu_set_flag(cpu, Z, cpu->a == 0x00);
-    cpu_set_flag(cpu, N, cpu->a * 0x80);
-    return 0;
-}
-
-uint8_t i_PLP(CPU *cpu) {
-    cpu->sp++;
-    cpu->status = bus_read(cpu->bus, 010100 + cpu->sp);
-    cpu_set_flag(cpu, U, true);
-    return 0;
-}
-
-uint8_t i_ROL(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp = (uint16_t) (op << 1) | cpu_get_flag(cpu, C);
-    cpu_set_flag(cpu, C, temp & 0xFF00);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    if (cpu->is_am_imm) cpu->a = temp & 0x00FF;
-    else bus_write(cpu->bus, cpu->addr_abs, temp & 0x00FF);
-    return 0;
-}
-
-uint8_t i_ROR(CPU *cpu) {
-    uint8_t op = cpu_fetch_operand(cpu);
-    uint16_t temp = (uint16_t) (cpu_get_flag(cpu, C) << 7) | (op >> 1);
-    cpu_set_flag(cpu, C, op & 0x01);
-    cpu_set_flag(cpu, Z, (temp & 0x00FF) == 0);
-    cpu_set_flag(cpu, N, temp & 0x0080);
-    if (cpu->is_am_imm) cpu->a = temp & 0x00FF;
-    else bus_write(cpu->bus, cpu->addr_abs, temp & 0x00FF);
-    return 0;
-}
-
-uint8_t i_RTI(CPU *cpu) {
-    cpu->sp++;
-    cpu->status = bus_read(cpu->bus, 0x0100 + cpu->sp);
-    cpu->status &= ~B;
-    cpu->status &= ~U;
-    cpu->sp++;
-    cpu->pc = (uint16_t) bus_read(cpu->bus, 0x0100 + cpu->sp);
-    cpu->sp++;
-    cpu->pc |= (uint16_t) bus_read(cpu->bus, 0x0100 + cpu->sp) << 8;
-    return 0;
-}
-
-uint8_t i_RTS(CPU *cpu) {
-    cpu->sp++;
-    cpu->pc = bus_read(cpu->bus, 0x0100 + cpu->sp);
-    cpu->sp++;
-    cpu->pc |= bus_read(cpu->bus, 0x0100 + cpu->sp) << 8;
-    cpu->pc++;
-    return 0;
-}
-
-uint8_t i_SEC(CPU *cpu) {
-    cpu_set_flag(cpu, C, true);
-    return 0;
-}
-
-uint8_t i_SED(CPU *cpu) {
-    cpu_set_flag(cpu, D, true);
-    return 0;
-}
-
-uint8_t i_SEI(CPU *cpu) {
     cpu_set_flag(cpu, I, true);
-    return 0;
-}
-
-uint8_t i_STA(CPU *cpu) {
-    bus_write(cpu->bus, cpu->addr_abs, cpu->a);
-    return 0;
+    cpu->pc = (uint16_t) bus_read(cpu->bus, 0xFFFE)
+            | ((uint16_t) bus_read(cpu->bus, 0xFFFF) << 8);
+    cpu->clock_count += 7;
+    return true;
 }
 
-uint8_t i_STX(CPU *cpu) {
-    bus_write(cpu->bus, cpu->addr_abs, cpu->x);
-    return 0;
-}
 
-uint8_t i_STY(CPU *cpu) {
-    bus_write(cpu->bus, cpu->addr_abs, cpu->y);
-    return 0;
-}
 
-uint8_t i_TAX(CPU *cpu) {
-    cpu->x = cpu->a;
-    cpu_set_flag(cpu, Z, cpu->x == 0x00);
-    cpu_set_flag(cpu, N, cpu->x & 0x80);
-    return 0;
-}
+// Instrumentation counters
 
-uint8_t i_TAY(CPU *cpu) {
-    cpu->y = cpu->a;
-    cpu_set_flag(cpu, Z, cpu->y == 0x00);
-    cpu_set_flag(cpu, N, cpu->y & 0x80);
-    return 0;
-}
-
-uint8_t i_TSX(CPU *cpu) {
-    cpu->x = cpu->sp;
-    cpu_set_flag(cpu, Z, cpu->x == 0x00);
-    cpu_set_flag(cpu, N, cpu->x & 0x80);
-    return 0;
-}
+static const CpuAddressMode CPU_MODES[CPU_MODE_COUNT] = {
+    am_IMP, am_IMM, am_ZP0, am_ZPX, am_ZPY, am_REL, am_ABS, am_ABX, am_ABY, am_IND, am_IZX, am_IZY,
+};
 
-uint8_t i_TXA(CPU *cpu) {
-    cpu->a = cpu->x;
-    cpu_set_flag(cpu, Z, cpu->a == 0x00);
-    cpu_set_flag(cpu, N, cpu->a & 0x80);
-    return 0;
+static void cpu_counters_prepare(CpuCounters *counters) {
+    cpu_counters_reset(counters);
+    for (int opcode = 0; opcode < 256; opcode++) {
+        CpuAddressMode am = CPU_INSTRUCTION_LOOKUP[opcode].am;
+        for (uint8_t mode = 0; mode < CPU_MODE_COUNT; mode++)
+            if (CPU_MODES[mode] == am) counters->mode_of[opcode] = mode;
+    }
 }
 
-uint8_t i_TXS(CPU *cpu) {
-    cpu->sp = cpu->x;
-    return 0;
+void cpu_counters_reset(CpuCounters *counters) {
+    memset(counters, 0, offsetof(CpuCounters, mode));
 }
 
-uint8_t i_TYA(CPU *cpu) {
-    cpu->a = cpu->y;
-    cpu_set_flag(cpu, Z, cpu->a == 0x00);
-    cpu_set_flag(cpu, N, cpu->a & 0x80);
-    return 0;
+void cpu_counters_add(CpuCounters *total, const CpuCounters *counters) {
+    for (int opcode = 0; opcode < 256; opcode++) {
+        total->executed[opcode] += counters->executed[opcode];
+        total->page_crosses[opcode] += counters->page_crosses[opcode];
+        total->taken[opcode] += counters->taken[opcode];
+        total->not_taken[opcode] += counters->not_taken[opcode];
+    }
+    for (int mode = 0; mode <= CPU_MODE_COUNT; mode++) total->reads[mode] += counters->reads[mode];
+    for (int bucket = 0; bucket < CPU_CYCLE_BUCKETS; bucket++) total->cycles[bucket] += counters->cycles[bucket];
 }
 
-uint8_t i_XXX(CPU *cpu) {
-    return 0;
+uint64_t cpu_counters_instructions(const CpuCounters *counters) {
+    uint64_t total = 0;
+    for (int opcode = 0; opcode < 256; opcode++) total += counters->executed[opcode];
+    return total;
 }
-
-static const CpuInstruction CPU_INSTRUCTION_LOOKUP[256] = {
-        {i_BRK, am_IMM, 7}, {i_ORA, am_IZX, 6},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 3}, {i_ORA, am_ZP0, 3},
-        {i_ASL, am_ZP0, 5}, {i_XXX, am_IMP, 5},
-        {i_PHP, am_IMP, 3}, {i_ORA, am_IMM, 2},
-        {i_ASL, am_IMP, 2}, {i_XXX, am_IMP, 2},
-        {i_NOP, am_IMP, 4}, {i_ORA, am_ABS, 4},
-        {i_ASL, am_ABS, 6}, {i_XXX, am_IMP, 6},
-        {i_BPL, am_REL, 2}, {i_ORA, am_IZY, 5},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 4}, {i_ORA, am_ZPX, 4},
-        {i_ASL, am_ZPX, 6}, {i_XXX, am_IMP, 6},
-        {i_CLC, am_IMP, 2}, {i_ORA, am_ABY, 4},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 7},
-        {i_NOP, am_IMP, 4}, {i_ORA, am_ABX, 4},
-        {i_ASL, am_ABX, 7}, {i_XXX, am_IMP, 7},
-        {i_JSR, am_ABS, 6}, {i_AND, am_IZX, 6},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_BIT, am_ZP0, 3}, {i_AND, am_ZP0, 3},
-        {i_ROL, am_ZP0, 5}, {i_XXX, am_IMP, 5},
-        {i_PLP, am_IMP, 4}, {i_AND, am_IMM, 2},
-        {i_ROL, am_IMP, 2}, {i_XXX, am_IMP, 2},
-        {i_BIT, am_ABS, 4}, {i_AND, am_ABS, 4},
-        {i_ROL, am_ABS, 6}, {i_XXX, am_IMP, 6},
-        {i_BMI, am_REL, 2}, {i_AND, am_IZY, 5},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 4}, {i_AND, am_ZPX, 4},
-        {i_ROL, am_ZPX, 6}, {i_XXX, am_IMP, 6},
-        {i_SEC, am_IMP, 2}, {i_AND, am_ABY, 4},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 7},
-        {i_NOP, am_IMP, 4}, {i_AND, am_ABX, 4},
-        {i_ROL, am_ABX, 7}, {i_XXX, am_IMP, 7},
-        {i_RTI, am_IMP, 6}, {i_EOR, am_IZX, 6},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 3}, {i_EOR, am_ZP0, 3},
-        {i_LSR, am_ZP0, 5}, {i_XXX, am_IMP, 5},
-        {i_PHA, am_IMP, 3}, {i_EOR, am_IMM, 2},
-        {i_LSR, am_IMP, 2}, {i_XXX, am_IMP, 2},
-        {i_JMP, am_ABS, 3}, {i_EOR, am_ABS, 4},
-        {i_LSR, am_ABS, 6}, {i_XXX, am_IMP, 6},
-        {i_BVC, am_REL, 2}, {i_EOR, am_IZY, 5},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 4}, {i_EOR, am_ZPX, 4},
-        {i_LSR, am_ZPX, 6}, {i_XXX, am_IMP, 6},
-        {i_CLI, am_IMP, 2}, {i_EOR, am_ABY, 4},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 7},
-        {i_NOP, am_IMP, 4}, {i_EOR, am_ABX, 4},
-        {i_LSR, am_ABX, 7}, {i_XXX, am_IMP, 7},
-        {i_RTS, am_IMP, 6}, {i_ADC, am_IZX, 6},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 3}, {i_ADC, am_ZP0, 3},
-        {i_ROR, am_ZP0, 5}, {i_XXX, am_IMP, 5},
-        {i_PLA, am_IMP, 4}, {i_ADC, am_IMM, 2},
-        {i_ROR, am_IMP, 2}, {i_XXX, am_IMP, 2},
-        {i_JMP, am_IND, 5}, {i_ADC, am_ABS, 4},
-        {i_ROR, am_ABS, 6}, {i_XXX, am_IMP, 6},
-        {i_BVS, am_REL, 2}, {i_ADC, am_IZY, 5},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 4}, {i_ADC, am_ZPX, 4},
-        {i_ROR, am_ZPX, 6}, {i_XXX, am_IMP, 6},
-        {i_SEI, am_IMP, 2}, {i_ADC, am_ABY, 4},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 7},
-        {i_NOP, am_IMP, 4}, {i_ADC, am_ABX, 4},
-        {i_ROR, am_ABX, 7}, {i_XXX, am_IMP, 7},
-        {i_NOP, am_IMP, 2}, {i_STA, am_IZX, 6},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 6},
-        {i_STY, am_ZP0, 3}, {i_STA, am_ZP0, 3},
-        {i_STX, am_ZP0, 3}, {i_XXX, am_IMP, 3},
-        {i_DEY, am_IMP, 2}, {i_NOP, am_IMP, 2},
-        {i_TXA, am_IMP, 2}, {i_XXX, am_IMP, 2},
-        {i_STY, am_ABS, 4}, {i_STA, am_ABS, 4},
-        {i_STX, am_ABS, 4}, {i_XXX, am_IMP, 4},
-        {i_BCC, am_REL, 2}, {i_STA, am_IZY, 6},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 6},
-        {i_STY, am_ZPX, 4}, {i_STA, am_ZPX, 4},
-        {i_STX, am_ZPY, 4}, {i_XXX, am_IMP, 4},
-        {i_TYA, am_IMP, 2}, {i_STA, am_ABY, 5},
-        {i_TXS, am_IMP, 2}, {i_XXX, am_IMP, 5},
-        {i_NOP, am_IMP, 5}, {i_STA, am_ABX, 5},
-        {i_XXX, am_IMP, 5}, {i_XXX, am_IMP, 5},
-        {i_LDY, am_IMM, 2}, {i_LDA, am_IZX, 6},
-        {i_LDX, am_IMM, 2}, {i_XXX, am_IMP, 6},
-        {i_LDY, am_ZP0, 3}, {i_LDA, am_ZP0, 3},
-        {i_LDX, am_ZP0, 3}, {i_XXX, am_IMP, 3},
-        {i_TAY, am_IMP, 2}, {i_LDA, am_IMM, 2},
-        {i_TAX, am_IMP, 2}, {i_XXX, am_IMP, 2},
-        {i_LDY, am_ABS, 4}, {i_LDA, am_ABS, 4},
-        {i_LDX, am_ABS, 4}, {i_XXX, am_IMP, 4},
-        {i_BCS, am_REL, 2}, {i_LDA, am_IZY, 5},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 5},
-        {i_LDY, am_ZPX, 4}, {i_LDA, am_ZPX, 4},
-        {i_LDX, am_ZPY, 4}, {i_XXX, am_IMP, 4},
-        {i_CLV, am_IMP, 2}, {i_LDA, am_ABY, 4},
-        {i_TSX, am_IMP, 2}, {i_XXX, am_IMP, 4},
-        {i_LDY, am_ABX, 4}, {i_LDA, am_ABX, 4},
-        {i_LDX, am_ABY, 4}, {i_XXX, am_IMP, 4},
-        {i_CPY, am_IMM, 2}, {i_CMP, am_IZX, 6},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_CPY, am_ZP0, 3}, {i_CMP, am_ZP0, 3},
-        {i_DEC, am_ZP0, 5}, {i_XXX, am_IMP, 5},
-        {i_INY, am_IMP, 2}, {i_CMP, am_IMM, 2},
-        {i_DEX, am_IMP, 2}, {i_XXX, am_IMP, 2},
-        {i_CPY, am_ABS, 4}, {i_CMP, am_ABS, 4},
-        {i_DEC, am_ABS, 6}, {i_XXX, am_IMP, 6},
-        {i_BNE, am_REL, 2}, {i_CMP, am_IZY, 5},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 4}, {i_CMP, am_ZPX, 4},
-        {i_DEC, am_ZPX, 6}, {i_XXX, am_IMP, 6},
-        {i_CLD, am_IMP, 2}, {i_CMP, am_ABY, 4},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 7},
-        {i_NOP, am_IMP, 4}, {i_CMP, am_ABX, 4},
-        {i_DEC, am_ABX, 7}, {i_XXX, am_IMP, 7},
-        {i_CPX, am_IMM, 2}, {i_SBC, am_IZX, 6},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_CPX, am_ZP0, 3}, {i_SBC, am_ZP0, 3},
-        {i_INC, am_ZP0, 5}, {i_XXX, am_IMP, 5},
-        {i_INX, am_IMP, 2}, {i_SBC, am_IMM, 2},
-        {i_NOP, am_IMP, 2}, {i_SBC, am_IMP, 2},
-        {i_CPX, am_ABS, 4}, {i_SBC, am_ABS, 4},
-        {i_INC, am_ABS, 6}, {i_XXX, am_IMP, 6},
-        {i_BEQ, am_REL, 2}, {i_SBC, am_IZY, 5},
-        {i_XXX, am_IMP, 2}, {i_XXX, am_IMP, 8},
-        {i_NOP, am_IMP, 4}, {i_SBC, am_ZPX, 4},
-        {i_INC, am_ZPX, 6}, {i_XXX, am_IMP, 6},
-        {i_SED, am_IMP, 2}, {i_SBC, am_ABY, 4},
-        {i_NOP, am_IMP, 2}, {i_XXX, am_IMP, 7},
-        {i_NOP, am_IMP, 4}, {i_SBC, am_ABX, 4},
-        {i_INC, am_ABX, 7}, {i_XXX, am_IMP, 7}
-};
-
-void cpu_clock(CPU *cpu) {
-    if (cpu->cycles == 0) {
-        cpu->opcode = bus_read(cpu->bus, cpu->pc);
-        cpu_set_flag(cpu, U, true);
-        cpu->pc++;
-        CpuInstruction instruction = CPU_INSTRUCTION_LOOKUP[cpu->opcode];
-        uint8_t additional_cycles_am = instruction.am(cpu);
-        uint8_t additional_cycles_i = instruction.op(cpu);
-        cpu->cycles = instruction.cycles + (additional_cycles_am & additional_cycles_i);
-        cpu_set_flag(cpu, U, true);
-    }
-    cpu->cycles--;
-}
\ No newline at end of file
@@ -3,10 +3,132 @@
 
 #include "defs.h"
 
+// 1 in builds configured with MACNES_PROFILE, where every CPU counts what
+// it executes into cpu->counters; otherwise 0, the hooks compile to
+// nothing and cpu->counters stays NULL.
+#ifdef MACNES_PROFILE
+#define CPU_COUNTING 1
+#else
+#define CPU_COUNTING 0
+#endif
+
 CPU* cpu_init();
 
 void cpu_destroy(CPU *cpu);
 
+void cpu_reset(CPU *cpu);
+
 void cpu_clock(CPU *cpu);
 
+uint8_t cpu_step(CPU *cpu);
+
+bool cpu_irq(CPU *cpu);
+
+// cpu_step built as the accurate tier: dummy reads and writes reach the bus,
+// and mapper events due between two accesses of an instruction run there.
+// Cycle counts and results otherwise match cpu_step.
+uint8_t cpu_step_accurate(CPU *cpu);
+
+// Like cpu_step, but a fused opcode pair at pc runs both instructions from
+// one dispatch unless the clock reaches `until` between them. Results are
+// identical to two cpu_steps. Only call it with no IRQ pending.
+uint8_t cpu_step_fused(CPU *cpu, uint64_t until);
+
+// Clears the counts; a fresh profile must be reset before use.
+void cpu_profile_reset(CpuPairProfile *profile);
+
+// cpu_step that also counts the pair formed with the previous instruction.
+uint8_t cpu_step_profiled(CPU *cpu, CpuPairProfile *profile);
+
+// The `count` most executed pairs, most frequent first. Returns how many
+// were filled in.
+size_t cpu_profile_top(const CpuPairProfile *profile, CpuPairCount *top, size_t count);
+
+void cpu_counters_reset(CpuCounters *counters);
+
+// Adds `counters` into a zeroed or earlier `total`, to combine machines.
+void cpu_counters_add(CpuCounters *total, const CpuCounters *counters);
+
+uint64_t cpu_counters_instructions(const CpuCounters *counters);
+
+// Decode table entry for an opcode, for tools that translate 6502 code.
+CpuInstruction cpu_instruction(uint8_t opcode);
+
+// C name of an addressing mode or operation below, such as "am_IMP" or
+// "i_ADC"; NULL for i_XXX.
+const char* cpu_function_name(CpuOperation function);
+
+// Addressing modes and operations, in the order cpu_execute calls them.
+// Recompiled code calls these directly.
+uint8_t am_IMP(CPU *cpu);
+uint8_t am_IMM(CPU *cpu);
+uint8_t am_ZP0(CPU *cpu);
+uint8_t am_ZPX(CPU *cpu);
+uint8_t am_ZPY(CPU *cpu);
+uint8_t am_REL(CPU *cpu);
+uint8_t am_ABS(CPU *cpu);
+uint8_t am_ABX(CPU *cpu);
+uint8_t am_ABY(CPU *cpu);
+uint8_t am_IND(CPU *cpu);
+uint8_t am_IZX(CPU *cpu);
+uint8_t am_IZY(CPU *cpu);
+
+uint8_t i_ADC(CPU *cpu);
+uint8_t i_AND(CPU *cpu);
+uint8_t i_ASL(CPU *cpu);
+uint8_t i_BCC(CPU *cpu);
+uint8_t i_BCS(CPU *cpu);
+uint8_t i_BEQ(CPU *cpu);
+uint8_t i_BIT(CPU *cpu);
+uint8_t i_BMI(CPU *cpu);
+uint8_t i_BNE(CPU *cpu);
+uint8_t i_BPL(CPU *cpu);
+uint8_t i_BRK(CPU *cpu);
+uint8_t i_BVC(CPU *cpu);
+uint8_t i_BVS(CPU *cpu);
+uint8_t i_CLC(CPU *cpu);
+uint8_t i_CLD(CPU *cpu);
+uint8_t i_CLI(CPU *cpu);
+uint8_t i_CLV(CPU *cpu);
+uint8_t i_CMP(CPU *cpu);
+uint8_t i_CPX(CPU *cpu);
+uint8_t i_CPY(CPU *cpu);
+uint8_t i_DEC(CPU *cpu);
+uint8_t i_DEX(CPU *cpu);
+uint8_t i_DEY(CPU *cpu);
+uint8_t i_EOR(CPU *cpu);
+uint8_t i_INC(CPU *cpu);
+uint8_t i_INX(CPU *cpu);
+uint8_t i_INY(CPU *cpu);
+uint8_t i_JMP(CPU *cpu);
+uint8_t i_JSR(CPU *cpu);
+uint8_t i_LDA(CPU *cpu);
+uint8_t i_LDX(CPU *cpu);
+uint8_t i_LDY(CPU *cpu);
+uint8_t i_LSR(CPU *cpu);
+uint8_t i_NOP(CPU *cpu);
+uint8_t i_ORA(CPU *cpu);
+uint8_t i_PHA(CPU *cpu);
+uint8_t i_PHP(CPU *cpu);
+uint8_t i_PLA(CPU *cpu);
+uint8_t i_PLP(CPU *cpu);
+uint8_t i_ROL(CPU *cpu);
+uint8_t i_ROR(CPU *cpu);
+uint8_t i_RTI(CPU *cpu);
+uint8_t i_RTS(CPU *cpu);
+uint8_t i_SBC(CPU *cpu);
+uint8_t i_SEC(CPU *cpu);
+uint8_t i_SED(CPU *cpu);
+uint8_t i_SEI(CPU *cpu);
+uint8_t i_STA(CPU *cpu);
+uint8_t i_STX(CPU *cpu);
+uint8_t i_STY(CPU *cpu);
+uint8_t i_TAX(CPU *cpu);
+uint8_t i_TAY(CPU *cpu);
+uint8_t i_TSX(CPU *cpu);
+uint8_t i_TXA(CPU *cpu);
+uint8_t i_TXS(CPU *cpu);
+uint8_t i_TYA(CPU *cpu);
+uint8_t i_XXX(CPU *cpu);
+
 #endif
@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include "cpu.h"
+#include "bus.h"
+#include "mapper.h"
+#include "coroutine.h"
+
+uint8_t cpu_get_flag(CPU *cpu, enum CpuFlag flag);
+void cpu_set_flag(CPU *cpu, enum CpuFlag flag, bool value);
+
+// Accurate tier
+
+// Every bus access, dummy or not, happens on its own cycle, counted from
+// the opcode fetch. Mapper timers are brought up to that cycle before the
+// access, so a mapper sees reads and writes in order with its own events
+// even in the middle of an instruction: under nes_run_frame's scheduler by
+// waiting for the mapper component, otherwise by calling it directly.
+static inline void cpu_accurate_sync(CPU *cpu) {
+    Bus *bus = cpu->bus;
+    uint64_t clock = cpu->clock_count + cpu->access++;
+    Scheduler *scheduler = bus->scheduler;
+    if (scheduler && scheduler->active) {
+        scheduler->components[NES_COMPONENT_CPU].clock = clock;
+        scheduler_wait(scheduler, NES_COMPONENT_CPU);
+    } else if (clock >= bus->mapper_state.next_event) {
+        mapper_event(bus, clock);
+    }
+}
+
+static inline uint8_t cpu_accurate_read(CPU *cpu, uint16_t address) {
+    cpu_accurate_sync(cpu);
+    return bus_read(cpu->bus, address);
+}
+
+static inline void cpu_accurate_write(CPU *cpu, uint16_t address, uint8_t data) {
+    cpu_accurate_sync(cpu);
+    bus_write(cpu->bus, address, data);
+}
+
+#define CPU_INSTRUCTION_BEGIN(cpu) ((cpu)->access = 0)
+#define CPU_READ(cpu, address) (CPU_COUNT_READ(cpu), cpu_accurate_read(cpu, address))
+#define CPU_WRITE(cpu, address, data) cpu_accurate_write(cpu, address, data)
+#define CPU_DUMMY_READ(cpu, address) (CPU_COUNT_READ(cpu), (void) cpu_accurate_read(cpu, address))
+#define CPU_DUMMY_WRITE(cpu, address, data) cpu_accurate_write(cpu, address, data)
+#define CPU_WRITE_MODES
+
+// The core's handlers get their own names in this tier.
+#define cpu_fetch_operand cpu_fetch_operand_accurate
+#define cpu_branch_conditional cpu_branch_conditional_accurate
+#define cpu_execute cpu_execute_accurate
+#define cpu_step cpu_step_accurate
+#define CPU_INSTRUCTION_LOOKUP CPU_ACCURATE_INSTRUCTION_LOOKUP
+#define am_IMP am_IMP_accurate
+#define am_IMM am_IMM_accurate
+#define am_ZP0 am_ZP0_accurate
+#define am_ZPX am_ZPX_accurate
+#define am_ZPY am_ZPY_accurate
+#define am_REL am_REL_accurate
+#define am_ABS am_ABS_accurate
+#define am_ABX am_ABX_accurate
+#define am_ABY am_ABY_accurate
+#define am_IND am_IND_accurate
+#define am_IZX am_IZX_accurate
+#define am_IZY am_IZY_accurate
+#define am_ABXW am_ABXW_accurate
+#define am_ABYW am_ABYW_accurate
+#define am_IZYW am_IZYW_accurate
+#define i_ADC i_ADC_accurate
+#define i_AND i_AND_accurate
+#define i_ASL i_ASL_accurate
+#define i_BCC i_BCC_accurate
+#define i_BCS i_BCS_accurate
+#define i_BEQ i_BEQ_accurate
+#define i_BIT i_BIT_accurate
+#define i_BMI i_BMI_accurate
+#define i_BNE i_BNE_accurate
+#define i_BPL i_BPL_accurate
+#define i_BRK i_BRK_accurate
+#define i_BVC i_BVC_accurate
+#define i_BVS i_BVS_accurate
+#define i_CLC i_CLC_accurate
+#define i_CLD i_CLD_accurate
+#define i_CLI i_CLI_accurate
+#define i_CLV i_CLV_accurate
+#define i_CMP i_CMP_accurate
+#define i_CPX i_CPX_accurate
+#define i_CPY i_CPY_accurate
+#define i_DEC i_DEC_accurate
+#define i_DEX i_DEX_accurate
+#define i_DEY i_DEY_accurate
+#define i_EOR i_EOR_accurate
+#define i_INC i_INC_accurate
+#define i_INX i_INX_accurate
+#define i_INY i_INY_accurate
+#define i_JMP i_JMP_accurate
+#define i_JSR i_JSR_accurate
+#define i_LDA i_LDA_accurate
+#define i_LDX i_LDX_accurate
+#define i_LDY i_LDY_accurate
+#define i_LSR i_LSR_accurate
+#define i_NOP i_NOP_accurate
+#define i_ORA i_ORA_accurate
+#define i_PHA i_PHA_accurate
+#define i_PHP i_PHP_accurate
+#define i_PLA i_PLA_accurate
+#define i_PLP i_PLP_accurate
+#define i_ROL i_ROL_accurate
+#define i_ROR i_ROR_accurate
+#define i_RTI i_RTI_accurate
+#define i_RTS i_RTS_accurate
+#define i_SBC i_SBC_accurate
+#define i_SEC i_SEC_accurate
+#define i_SED i_SED_accurate
+#define i_SEI i_SEI_accurate
+#define i_STA i_STA_accurate
+#define i_STX i_STX_accurate
+#define i_STY i_STY_accurate
+#define i_TAX i_TAX_accurate
+#define i_TAY i_TAY_accurate
+#define i_TSX i_TSX_accurate
+#define i_TXA i_TXA_accurate
+#define i_TXS i_TXS_accurate
+#define i_TYA i_TYA_accurate
+#define i_XXX i_XXX_accurate
+
+#include "cpu_core.h"
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include "debug.h"
+#include "bus.h"
+
+static inline bool debug_bit(const uint64_t *bitmap, uint16_t address) {
+    return (bitmap[address >> 6] >> (address & 63)) & 1;
+}
+
+static inline void debug_set_bit(uint64_t *bitmap, uint16_t address, bool set) {
+    uint64_t mask = (uint64_t) 1 << (address & 63);
+    if (set) bitmap[address >> 6] |= mask;
+    else bitmap[address >> 6] &= ~mask;
+}
+
+static bool debug_report(Debug *debug, enum DebugEvent event, uint16_t address, uint8_t value) {
+    return debug->callback ? debug->callback(debug->context, event, address, value) : true;
+}
+
+Debug* debug_init(DebugCallback callback, void *context) {
+    Debug *debug = (Debug*) calloc(1, sizeof(Debug));
+    if (!debug) return NULL;
+    debug->callback = callback;
+    debug->context = context;
+    debug->resume_pc = -1;
+    return debug;
+}
+
+void debug_destroy(Debug *debug) {
+    if (!debug) return;
+    debug_attach(debug, NULL);
+    free(debug);
+}
+
+static void debug_trap_pages(Debug *debug, bool trapped) {
+    for (uint32_t page = 0; page < RAM_PAGE_COUNT; page++)
+        if (debug->page_watches[page]) bus_trap_page(debug->bus, (uint8_t) page, trapped);
+}
+
+void debug_attach(Debug *debug, Bus *bus) {
+    if (debug->bus == bus) return;
+    if (debug->bus) {
+        debug_trap_pages(debug, false);
+        debug->bus->debug = NULL;
+    }
+    debug->bus = bus;
+    debug->resume_pc = -1;
+    debug->stop = false;
+    if (!bus) return;
+    if (bus->debug) debug_attach(bus->debug, NULL);
+    bus->debug = debug;
+    debug_trap_pages(debug, true);
+}
+
+void debug_watch(Debug *debug, uint16_t address, unsigned events) {
+    bool was = debug_bit(debug->reads, address) || debug_bit(debug->writes, address);
+    bool is = (events & (DEBUG_READ | DEBUG_WRITE)) != 0;
+    debug_set_bit(debug->reads, address, events & DEBUG_READ);
+    debug_set_bit(debug->writes, address, events & DEBUG_WRITE);
+    if (was == is) return;
+
+    uint8_t page = address >> 8;
+    if (is) {
+        if (debug->page_watches[page]++ == 0 && debug->bus) bus_trap_page(debug->bus, page, true);
+    } else if (--debug->page_watches[page] == 0 && debug->bus) bus_trap_page(debug->bus, page, false);
+}
+
+void debug_break(Debug *debug, uint16_t pc, bool enabled) {
+    if (debug_bit(debug->breakpoints, pc) == enabled) return;
+    debug_set_bit(debug->breakpoints, pc, enabled);
+    if (enabled) debug->breakpoint_count++;
+    else debug->breakpoint_count--;
+}
+
+void debug_trap_read(Debug *debug, uint16_t address, uint8_t data) {
+    if (debug_bit(debug->reads, address) && debug_report(debug, DEBUG_READ, address, data))
+        debug->stop = true;
+}
+
+void debug_trap_write(Debug *debug, uint16_t address, uint8_t data) {
+    if (debug_bit(debug->writes, address) && debug_report(debug, DEBUG_WRITE, address, data))
+        debug->stop = true;
+}
+
+bool debug_check_break(Debug *debug, uint16_t pc) {
+    if (!debug->breakpoint_count) return false;
+    bool resuming = debug->resume_pc == (int32_t) pc;
+    debug->resume_pc = -1;
+    if (resuming || !debug_bit(debug->breakpoints, pc)) return false;
+    if (!debug_report(debug, DEBUG_EXECUTE, pc, bus_peek(debug->bus, pc))) return false;
+    debug->resume_pc = pc;
+    return true;
+}
+
+bool debug_take_stop(Debug *debug) {
+    bool stop = debug->stop;
+    debug->stop = false;
+    return stop;
+}
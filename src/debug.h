@@ -0,0 +1,43 @@
+#ifndef MACNES_DEBUG_H
+#define MACNES_DEBUG_H
+
+#include "defs.h"
+
+// Read/write watchpoints and execution breakpoints for one machine.
+//
+// A watched address traps its whole page: the page leaves bus->read_map and
+// its accesses take the bus's slow path, where only watched addresses reach
+// the callback. Breakpoints are checked between instructions by a separate
+// frame loop that runs while a debugger is attached. Without one, the bus
+// and the frame loop run exactly as they otherwise would.
+
+Debug* debug_init(DebugCallback callback, void *context);
+
+// Detaches it first.
+void debug_destroy(Debug *debug);
+
+// Traps the bus's watched pages and takes over its frame loop; NULL
+// detaches. A bus has at most one debugger, and destroying the bus detaches
+// it.
+void debug_attach(Debug *debug, Bus *bus);
+
+// Watches `address` for `events` (DEBUG_READ and/or DEBUG_WRITE),
+// replacing any earlier watch on it; 0 removes it.
+void debug_watch(Debug *debug, uint16_t address, unsigned events);
+
+void debug_break(Debug *debug, uint16_t pc, bool enabled);
+
+// Called by the bus for an access to a trapped page.
+void debug_trap_read(Debug *debug, uint16_t address, uint8_t data);
+
+void debug_trap_write(Debug *debug, uint16_t address, uint8_t data);
+
+// Called before the instruction at pc. Returns true, and reports it once,
+// if a breakpoint there stops the frame; the instruction then runs when the
+// frame resumes without breaking again.
+bool debug_check_break(Debug *debug, uint16_t pc);
+
+// True once if a watchpoint callback asked to stop.
+bool debug_take_stop(Debug *debug);
+
+#endif
@@ -3,19 +3,241 @@
 
 #include "stdint.h"
 #include "stdbool.h"
+#include "stddef.h"
+#include <pthread.h>
+#include <sys/uio.h>
 
-#define RAM_SIZE 64 * 1024
+#define RAM_SIZE (64 * 1024)
+#define RAM_PAGE_SIZE 256
+#define RAM_PAGE_COUNT (RAM_SIZE / RAM_PAGE_SIZE)
+#define RAM_DIRTY_WORDS (RAM_PAGE_COUNT / 64)
+
+#define NES_CPU_RATE 1789773
+#define NES_FRAME_CYCLES_X2 59561
+#define NES_AUDIO_RATE 48000
+#define NES_VIDEO_WIDTH 256
+#define NES_VIDEO_HEIGHT 240
+
+typedef struct {
+    uint32_t    refs;
+    uint8_t     *data;
+} RamImage;
 
 typedef struct {
-    uint8_t data[RAM_SIZE];
+    uint8_t     *data;
+    uint8_t     *read_page[RAM_PAGE_COUNT];
+    uint8_t     *write_page[RAM_PAGE_COUNT];
+    RamImage    *image;
+    bool        track_dirty;
+    uint64_t    dirty[RAM_DIRTY_WORDS];
 } RAM;
 
+enum ControllerButton {
+    BUTTON_A      = (1 << 0),
+    BUTTON_B      = (1 << 1),
+    BUTTON_SELECT = (1 << 2),
+    BUTTON_START  = (1 << 3),
+    BUTTON_UP     = (1 << 4),
+    BUTTON_DOWN   = (1 << 5),
+    BUTTON_LEFT   = (1 << 6),
+    BUTTON_RIGHT  = (1 << 7),
+};
+
+typedef struct {
+    uint8_t     buttons[2];
+    uint8_t     shift[2];
+    bool        strobe;
+    bool        polled;
+} Controller;
+
+#define CARTRIDGE_HEADER_SIZE 16
+#define CARTRIDGE_TRAINER_SIZE 512
+#define CARTRIDGE_PRG_UNIT (16 * 1024)
+#define CARTRIDGE_CHR_UNIT (8 * 1024)
+#define CARTRIDGE_CHR_PAGE_SIZE 1024
+#define CARTRIDGE_CHR_PAGES 8
+
+enum CartridgeMirroring {
+    MIRROR_HORIZONTAL,
+    MIRROR_VERTICAL,
+    MIRROR_FOUR_SCREEN,
+    MIRROR_SINGLE_LOWER,
+    MIRROR_SINGLE_UPPER,
+};
+
+enum CartridgeError {
+    CARTRIDGE_OK,
+    CARTRIDGE_ERROR_IO,
+    CARTRIDGE_ERROR_MAGIC,
+    CARTRIDGE_ERROR_TRUNCATED,
+    CARTRIDGE_ERROR_UNSUPPORTED,
+};
+
+typedef struct {
+    uint32_t        refs;
+    void            *map;
+    size_t          map_size;
+    const uint8_t   *prg;
+    size_t          prg_size;
+    const uint8_t   *chr;
+    size_t          chr_size;
+    size_t          prg_ram_size;
+    size_t          chr_ram_size;
+    uint16_t        mapper;
+    uint8_t         submapper;
+    uint8_t         mirroring;
+    bool            battery;
+    bool            nes2;
+} Cartridge;
+
+typedef struct {
+    uint64_t    hash[2];
+    size_t      size;
+    Cartridge   *cartridge;
+    bool        shared;
+} RomCacheEntry;
+
+// A file already opened through the cache, by identity and modification
+// time, and the cached image it holds.
+typedef struct {
+    uint64_t    device;
+    uint64_t    inode;
+    uint64_t    size;
+    int64_t     mtime_sec;
+    int64_t     mtime_nsec;
+    Cartridge   *cartridge;
+} RomCacheFile;
+
+typedef struct {
+    char            *shm_prefix;
+    RomCacheEntry   *entries;
+    size_t          count;
+    size_t          capacity;
+    RomCacheFile    *files;
+    size_t          file_count;
+    size_t          file_capacity;
+    pthread_mutex_t lock;
+} RomCache;
+
+#define MAPPER_NO_EVENT UINT64_MAX
+
+typedef struct {
+    uint8_t     shift;
+    uint8_t     shift_count;
+    uint8_t     control;
+    uint8_t     chr[2];
+    uint8_t     prg;
+} Mmc1State;
+
+typedef struct {
+    uint8_t     select;
+    uint8_t     banks[8];
+    uint8_t     prg_ram;
+    uint8_t     irq_latch;
+    uint8_t     irq_counter;
+    bool        irq_reload;
+    bool        irq_enabled;
+} Mmc3State;
+
 typedef struct {
-    RAM *ram;
+    uint16_t    id;
+    uint8_t     bank;
+    uint8_t     mirroring;
+    bool        irq;
+    uint64_t    next_event;
+    Mmc1State   mmc1;
+    Mmc3State   mmc3;
+} MapperState;
+
+struct Bus;
+struct Aot;
+struct Scheduler;
+
+typedef struct {
+    uint16_t    id;
+    const char  *name;
+    void        (*power)(struct Bus *bus, uint64_t clock);
+    void        (*write)(struct Bus *bus, uint16_t address, uint8_t data);
+    void        (*sync)(struct Bus *bus);
+    void        (*event)(struct Bus *bus, uint64_t clock);
+} Mapper;
+
+// Why a page in Bus.trap_map leaves the fast path: it holds I/O
+// registers, or a watchpoint (see debug.h).
+enum BusTrap {
+    BUS_TRAP_IO     = (1 << 0),
+    BUS_TRAP_WATCH  = (1 << 1),
+};
+
+typedef struct Bus {
+    RAM             *ram;
+    Controller      *controller;
+    Cartridge       *cartridge;
+    const Mapper    *mapper;
+    MapperState     mapper_state;
+    const uint8_t   *read_map[RAM_PAGE_COUNT];
+    const uint8_t   *rom_map[RAM_PAGE_COUNT];
+    uint8_t         trap_map[RAM_PAGE_COUNT];
+    const uint8_t   *chr_map[CARTRIDGE_CHR_PAGES];
+    const struct Aot *aot;
+    struct Debug    *debug;
+    struct Scheduler *scheduler;
 } Bus;
 
+// CPU core build, chosen per machine. The fast tier runs each instruction
+// atomically; the accurate tier makes every bus access of the real 6502,
+// including the dummy ones, on its own cycle (see cpu_core.h).
+enum CpuTier {
+    CPU_TIER_FAST,
+    CPU_TIER_ACCURATE,
+};
+
+// How nes_run_frame drives the CPU. Fused dispatch runs the common opcode
+// pairs listed in cpu.c as one handler each.
+enum CpuDispatch {
+    CPU_DISPATCH_SINGLE,
+    CPU_DISPATCH_FUSED,
+};
+
+// Executed opcode pairs, indexed [first][second].
+typedef struct {
+    uint64_t    counts[256][256];
+    int         previous;
+} CpuPairProfile;
+
+typedef struct {
+    uint8_t     first;
+    uint8_t     second;
+    uint64_t    count;
+} CpuPairCount;
+
+#define CPU_MODE_COUNT 12
+#define CPU_CYCLE_BUCKETS 16
+
+// Instrumentation counters, kept per machine in builds configured with
+// MACNES_PROFILE. Addressing modes are indexed in cpu.h's am_ order; reads
+// are the bus reads made by instructions of each mode, with opcode fetches
+// in the extra last slot. Page crosses count the extra cycle of indexed
+// reads and of taken branches. `cycles` is a histogram of cycles per
+// instruction, the last bucket collecting the rest.
+typedef struct {
+    uint64_t    executed[256];
+    uint64_t    page_crosses[256];
+    uint64_t    taken[256];
+    uint64_t    not_taken[256];
+    uint64_t    reads[CPU_MODE_COUNT + 1];
+    uint64_t    cycles[CPU_CYCLE_BUCKETS];
+    uint8_t     mode;
+    uint8_t     mode_of[256];
+} CpuCounters;
+
 typedef struct {
     Bus         *bus;
+    enum CpuTier tier;
+    enum CpuDispatch dispatch;
+    CpuPairProfile *profile;
+    struct Trace *trace;
+    CpuCounters *counters;
 
     uint8_t     a;
     uint8_t     x;
@@ -26,9 +248,11 @@ typedef struct {
 
     uint8_t     opcode;
     uint8_t     cycles;
+    uint64_t    clock_count;
     uint16_t    addr_abs;
     uint16_t    addr_rel;
     bool        is_am_imm;
+    uint8_t     access;
 } CPU;
 
 enum CpuFlag {
@@ -50,10 +274,605 @@ typedef struct {
     uint8_t cycles;
 } CpuInstruction;
 
+// Ahead-of-time compiled code. Each block runs whole instructions from
+// `address` until it ends or the clock reaches `until`, and is valid only
+// while `prg_offset` is the PRG ROM byte mapped at `address`.
+typedef void (*AotBlockFunction)(CPU *cpu, uint64_t until);
+
+typedef struct {
+    uint16_t            address;
+    uint32_t            prg_offset;
+    AotBlockFunction    run;
+} AotBlock;
+
+typedef struct Aot {
+    void            *handle;
+    const AotBlock  *blocks;
+    uint32_t        count;
+    uint64_t        prg_hash;
+    size_t          prg_size;
+    uint32_t        *index;
+} Aot;
+
+typedef struct {
+    uint32_t    blocks;
+    uint32_t    instructions;
+    uint32_t    bytes;
+} RecompileStats;
+
+#define AUDIO_PULSE_LEVELS 31
+#define AUDIO_TND_LEVELS 203
+
 typedef struct {
-    RAM *ram;
-    Bus *bus;
-    CPU *cpu;
+    uint8_t     pulse1;
+    uint8_t     pulse2;
+    uint8_t     triangle;
+    uint8_t     noise;
+    uint8_t     dmc;
+} AudioChannels;
+
+#define RESAMPLER_TAPS 16
+#define RESAMPLER_PHASE_BITS 6
+#define RESAMPLER_PHASES (1 << RESAMPLER_PHASE_BITS)
+#define RESAMPLER_CHUNK 256
+
+typedef struct {
+    uint32_t    acc_count;
+    float       acc;
+    uint64_t    pos;
+    uint32_t    fill;
+    float       history[RESAMPLER_TAPS + RESAMPLER_CHUNK];
+} ResamplerState;
+
+typedef struct {
+    uint32_t        in_rate;
+    uint32_t        out_rate;
+    uint32_t        decimation;
+    uint64_t        step;
+    ResamplerState  state;
+    float           kernel[RESAMPLER_PHASES][RESAMPLER_TAPS];
+} Resampler;
+
+typedef struct {
+    AudioChannels   channels;
+    Resampler       *resampler;
+} Audio;
+
+typedef struct {
+    RAM         *ram;
+    Bus         *bus;
+    CPU         *cpu;
+    Controller  *controller;
+    Audio       *audio;
 } NES;
 
+typedef struct {
+    uint8_t     buttons[2];
+} NesInput;
+
+typedef struct {
+    uint8_t     *video;
+    float       *audio;
+    size_t      audio_capacity;
+} NesFrame;
+
+enum NesEvent {
+    NES_EVENT_INPUT_POLLED  = (1 << 0),
+    NES_EVENT_AUDIO_OVERRUN = (1 << 1),
+    NES_EVENT_BREAK         = (1 << 2),
+};
+
+typedef struct {
+    uint32_t    cycles;
+    uint32_t    events;
+    size_t      audio_samples;
+} NesFrameResult;
+
+typedef struct {
+    CPU             cpu;
+    Controller      controller;
+    AudioChannels   channels;
+    ResamplerState  resampler;
+    MapperState     mapper;
+    uint8_t         ram[RAM_SIZE];
+} NesState;
+
+#define SAVESTATE_VERSION 3
+#define SAVESTATE_ALIGN 64
+#define SAVESTATE_FOURCC(a, b, c, d) \
+    ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+enum SaveStateChunkId {
+    SAVESTATE_CHUNK_CPU  = SAVESTATE_FOURCC('C', 'P', 'U', ' '),
+    SAVESTATE_CHUNK_CTRL = SAVESTATE_FOURCC('C', 'T', 'R', 'L'),
+    SAVESTATE_CHUNK_APU  = SAVESTATE_FOURCC('A', 'P', 'U', ' '),
+    SAVESTATE_CHUNK_MAPR = SAVESTATE_FOURCC('M', 'A', 'P', 'R'),
+    SAVESTATE_CHUNK_RAM  = SAVESTATE_FOURCC('R', 'A', 'M', ' '),
+};
+
+enum SaveStateError {
+    SAVESTATE_OK,
+    SAVESTATE_ERROR_IO,
+    SAVESTATE_ERROR_MAGIC,
+    SAVESTATE_ERROR_VERSION,
+    SAVESTATE_ERROR_CORRUPT,
+};
+
+typedef struct {
+    char        magic[4];
+    uint16_t    version;
+    uint16_t    chunk_count;
+    uint64_t    size;
+    uint64_t    checksum;
+    uint8_t     reserved[40];
+} SaveStateHeader;
+
+typedef struct {
+    uint32_t    id;
+    uint32_t    size;
+    uint64_t    offset;
+} SaveStateChunk;
+
+typedef struct {
+    uint16_t    pc;
+    uint16_t    addr_abs;
+    uint16_t    addr_rel;
+    uint8_t     a;
+    uint8_t     x;
+    uint8_t     y;
+    uint8_t     sp;
+    uint8_t     status;
+    uint8_t     opcode;
+    uint8_t     cycles;
+    uint8_t     is_am_imm;
+    uint8_t     reserved[2];
+    uint64_t    clock_count;
+} SaveStateCpu;
+
+typedef struct {
+    uint8_t     buttons[2];
+    uint8_t     shift[2];
+    uint8_t     strobe;
+    uint8_t     polled;
+    uint8_t     reserved[2];
+} SaveStateController;
+
+typedef struct {
+    uint8_t     pulse1;
+    uint8_t     pulse2;
+    uint8_t     triangle;
+    uint8_t     noise;
+    uint8_t     dmc;
+    uint8_t     reserved[3];
+    uint32_t    acc_count;
+    float       acc;
+    uint64_t    pos;
+    uint32_t    fill;
+    uint32_t    reserved2;
+    float       history[RESAMPLER_TAPS + RESAMPLER_CHUNK];
+} SaveStateApu;
+
+typedef struct {
+    uint16_t    id;
+    uint8_t     bank;
+    uint8_t     mirroring;
+    uint8_t     irq;
+    uint8_t     mmc1_shift;
+    uint8_t     mmc1_shift_count;
+    uint8_t     mmc1_control;
+    uint8_t     mmc1_chr[2];
+    uint8_t     mmc1_prg;
+    uint8_t     mmc3_select;
+    uint8_t     mmc3_banks[8];
+    uint8_t     mmc3_prg_ram;
+    uint8_t     mmc3_irq_latch;
+    uint8_t     mmc3_irq_counter;
+    uint8_t     mmc3_irq_reload;
+    uint8_t     mmc3_irq_enabled;
+    uint8_t     reserved[7];
+    uint64_t    next_event;
+} SaveStateMapper;
+
+typedef struct {
+    void                        *map;
+    size_t                      size;
+    const SaveStateHeader       *header;
+    const SaveStateCpu          *cpu;
+    const SaveStateController   *controller;
+    const SaveStateApu          *apu;
+    const SaveStateMapper       *mapper;
+    const uint8_t               *ram;
+} SaveStateFile;
+
+enum CheckpointBackend {
+    CHECKPOINT_AUTO,
+    CHECKPOINT_IO_URING,
+    CHECKPOINT_THREADS,
+};
+
+// `error` is 0 or an errno value.
+typedef void (*CheckpointCallback)(void *context, const char *path, int error);
+
+typedef struct CheckpointRequest {
+    struct CheckpointRequest    *next;
+    char                        *path;
+    const NesState              *state;
+    uint8_t                     *head;
+    struct iovec                iov[2];
+    int                         iov_count;
+    uint64_t                    offset;
+    int                         fd;
+    uint8_t                     stage;
+    int                         error;
+    CheckpointCallback          callback;
+    void                        *context;
+} CheckpointRequest;
+
+typedef struct {
+    int         fd;
+    uint32_t    entries;
+    void        *sq_ring;
+    size_t      sq_ring_size;
+    void        *cq_ring;
+    size_t      cq_ring_size;
+    void        *sqes;
+    size_t      sqes_size;
+    uint32_t    *sq_head;
+    uint32_t    *sq_tail;
+    uint32_t    *sq_mask;
+    uint32_t    *sq_array;
+    uint32_t    *cq_head;
+    uint32_t    *cq_tail;
+    uint32_t    *cq_mask;
+    void        *cqes;
+    uint32_t    unsubmitted;
+    int         error;
+} CheckpointRing;
+
+typedef struct {
+    uint8_t             backend;
+    uint32_t            pending;
+
+    CheckpointRing      ring;
+    uint32_t            in_flight;
+    CheckpointRequest   *backlog;
+    CheckpointRequest   *backlog_tail;
+
+    pthread_t           *workers;
+    unsigned            worker_count;
+    pthread_mutex_t     lock;
+    pthread_cond_t      work;
+    pthread_cond_t      finished;
+    CheckpointRequest   *jobs;
+    CheckpointRequest   *jobs_tail;
+    CheckpointRequest   *done;
+    CheckpointRequest   *done_tail;
+    bool                stopping;
+} Checkpoint;
+
+typedef struct {
+    uint32_t    frames;
+    NesState    *state;
+} RunAhead;
+
+#define NETPLAY_HISTORY 16
+#define NETPLAY_QUEUE 256
+
+typedef struct {
+    void    *context;
+    void    (*send)(void *context, uint32_t frame, uint8_t buttons);
+    bool    (*receive)(void *context, uint32_t *frame, uint8_t *buttons);
+} NetplayTransport;
+
+typedef struct {
+    NES                 nes;
+    uint8_t             local_port;
+    NetplayTransport    transport;
+
+    uint32_t            frame;
+    uint32_t            confirmed;
+
+    NesState            *states[NETPLAY_HISTORY];
+    uint8_t             local[NETPLAY_HISTORY];
+    uint8_t             used_remote[NETPLAY_HISTORY];
+
+    uint8_t             remote[NETPLAY_HISTORY * 2];
+    uint32_t            remote_frame[NETPLAY_HISTORY * 2];
+    bool                remote_known[NETPLAY_HISTORY * 2];
+
+    uint32_t            rollbacks;
+    uint32_t            resimulated;
+} Netplay;
+
+typedef struct {
+    uint32_t    frames[NETPLAY_QUEUE];
+    uint8_t     buttons[NETPLAY_QUEUE];
+    uint32_t    head;
+    uint32_t    tail;
+} NetplayQueue;
+
+typedef struct {
+    NetplayQueue    *in;
+    NetplayQueue    *out;
+} NetplayEndpoint;
+
+typedef struct {
+    NetplayQueue    queues[2];
+    NetplayEndpoint endpoints[2];
+} NetplayLoopback;
+
+typedef struct {
+    uint64_t    lo;
+    uint64_t    hi;
+} StateHash;
+
+typedef struct {
+    StateHash   pages[RAM_PAGE_COUNT];
+    StateHash   ram;
+} Fingerprint;
+
+typedef struct {
+    size_t      offset;
+    uint32_t    size;
+    bool        keyframe;
+} RewindEntry;
+
+typedef struct {
+    uint8_t     *buffer;
+    size_t      budget;
+    size_t      head;
+
+    RewindEntry *entries;
+    uint32_t    capacity;
+    uint32_t    first;
+    uint32_t    count;
+
+    uint32_t    keyframe_interval;
+    uint32_t    since_keyframe;
+    NesState    *keyframe;
+    NesState    *scratch;
+    uint8_t     *packed;
+    size_t      packed_capacity;
+} Rewind;
+
+#define MOVIE_VERSION 1
+
+typedef struct {
+    char        magic[4];
+    uint16_t    version;
+    uint16_t    ports;
+    uint32_t    length;
+    uint32_t    reserved;
+} MovieHeader;
+
+typedef struct {
+    NesInput    *inputs;
+    uint32_t    length;
+    uint32_t    capacity;
+} Movie;
+
+typedef struct {
+    size_t      offset;
+    uint32_t    size;
+} MovieKeyframe;
+
+typedef struct {
+    NES             nes;
+    const Movie     *movie;
+    uint32_t        frame;
+    uint32_t        interval;
+
+    MovieKeyframe   *keyframes;
+    uint32_t        keyframe_count;
+    uint32_t        keyframe_capacity;
+    uint8_t         *index;
+    size_t          index_size;
+    size_t          index_capacity;
+
+    NesState        *scratch;
+    uint8_t         *packed;
+    size_t          packed_capacity;
+} MoviePlayer;
+
+enum RegressStatus {
+    REGRESS_PASS,
+    REGRESS_FAIL,
+    REGRESS_RECORDED,
+    REGRESS_ERROR_ROM,
+    REGRESS_ERROR_MOVIE,
+    REGRESS_ERROR_HASHES,
+    REGRESS_ERROR_MEMORY,
+};
+
+typedef struct {
+    char        *rom;
+    char        *movie;
+    char        *hashes;
+    uint32_t    frames;
+} RegressEntry;
+
+typedef struct {
+    uint8_t     status;
+    uint32_t    frames;
+    uint32_t    mismatches;
+    uint32_t    first_mismatch;
+    double      seconds;
+} RegressResult;
+
+typedef struct {
+    RegressEntry    *entries;
+    RegressResult   *results;
+    size_t          count;
+    size_t          capacity;
+} Regress;
+
+enum RamWatchDecode {
+    RAMWATCH_U8,
+    RAMWATCH_U16LE,
+    RAMWATCH_BCD,
+    RAMWATCH_DIGITS,
+};
+
+typedef struct {
+    uint8_t     decode;
+    uint8_t     width;
+    uint32_t    first;
+} RamWatchFeature;
+
+typedef struct {
+    uint16_t        *addresses;
+    size_t          address_count;
+    size_t          address_capacity;
+    RamWatchFeature *features;
+    size_t          feature_count;
+    size_t          feature_capacity;
+    bool            raw;
+} RamWatch;
+
+enum VecEnvObservation {
+    VECENV_OBS_RAM,
+    VECENV_OBS_WATCH,
+};
+
+typedef float (*VecEnvReward)(NES nes, void *context);
+
+typedef struct {
+    enum VecEnvObservation  observation;
+    const uint16_t          *ram_addresses;
+    size_t                  ram_count;
+    const RamWatch          *watch;
+    VecEnvReward            reward;
+    void                    *reward_context;
+} VecEnvConfig;
+
+typedef struct {
+    NES             *machines;
+    size_t          count;
+    VecEnvConfig    config;
+    size_t          observation_size;
+    size_t          rewards_offset;
+    size_t          buffer_size;
+} VecEnv;
+
+#define COROUTINE_STACK_SIZE (64 * 1024)
+#define SCHEDULER_COMPONENTS 4
+
+typedef void (*CoroutineEntry)(void *context);
+
+typedef struct {
+    void            *sp;
+    void            *caller_sp;
+    void            *fallback;
+    uint8_t         *stack;
+    size_t          stack_size;
+    CoroutineEntry  entry;
+    void            *context;
+    bool            done;
+} Coroutine;
+
+typedef void (*SchedulerEntry)(struct Scheduler *scheduler, uint32_t component, void *context);
+
+typedef struct {
+    Coroutine       *coroutine;
+    uint64_t        clock;
+    SchedulerEntry  entry;
+    void            *context;
+    bool            busy;
+} SchedulerComponent;
+
+typedef struct Scheduler {
+    SchedulerComponent  components[SCHEDULER_COMPONENTS];
+    uint32_t            count;
+    uint32_t            running;
+    uint64_t            until;
+    uint64_t            switches;
+    bool                active;
+} Scheduler;
+
+// The accurate tier's scheduler components, in the order they were added.
+enum NesComponent {
+    NES_COMPONENT_MAPPER,
+    NES_COMPONENT_CPU,
+};
+
+enum DebugEvent {
+    DEBUG_READ      = (1 << 0),
+    DEBUG_WRITE     = (1 << 1),
+    DEBUG_EXECUTE   = (1 << 2),
+};
+
+// Called on every hit with the accessed address and value (the opcode for
+// DEBUG_EXECUTE); returning true stops the frame.
+typedef bool (*DebugCallback)(void *context, enum DebugEvent event, uint16_t address, uint8_t value);
+
+#define DEBUG_BITMAP_WORDS (65536 / 64)
+
+typedef struct Debug {
+    Bus             *bus;
+    DebugCallback   callback;
+    void            *context;
+    uint64_t        reads[DEBUG_BITMAP_WORDS];
+    uint64_t        writes[DEBUG_BITMAP_WORDS];
+    uint64_t        breakpoints[DEBUG_BITMAP_WORDS];
+    uint16_t        page_watches[RAM_PAGE_COUNT];
+    uint32_t        breakpoint_count;
+    int32_t         resume_pc;
+    bool            stop;
+} Debug;
+
+#define TRACE_VERSION 1
+#define TRACE_CHUNK_RECORDS 4096
+
+typedef struct {
+    char        magic[4];
+    uint16_t    version;
+    uint16_t    record_size;
+    uint32_t    reserved[2];
+} TraceHeader;
+
+// One instruction as the CPU stood before running it. `cycle` holds the low
+// 32 bits of clock_count; readers carry the rest across wraps.
+typedef struct {
+    uint32_t    cycle;
+    uint16_t    pc;
+    uint8_t     opcode;
+    uint8_t     operand[2];
+    uint8_t     a;
+    uint8_t     x;
+    uint8_t     y;
+    uint8_t     status;
+    uint8_t     sp;
+    uint8_t     reserved[2];
+} TraceRecord;
+
+// Predictions shared by the trace writer and reader: the pc that followed
+// each pc last time, and the last record seen at each pc with its cycle
+// replaced by the delta from the record before it.
+typedef struct {
+    uint16_t    *next_pc;
+    TraceRecord *last;
+    TraceRecord previous;
+} TraceModel;
+
+// The machine owns `head` and `tail_seen`, the writer thread `tail`; they
+// sit on separate cache lines.
+typedef struct Trace {
+    TraceRecord     *ring;
+    uint64_t        mask;
+    uint64_t        head __attribute__((aligned(64)));
+    uint64_t        tail_seen;
+    uint64_t        stalls;
+    uint64_t        tail __attribute__((aligned(64)));
+    bool            stopping;
+    bool            failed;
+    int             fd;
+    pthread_t       writer;
+    TraceModel      model;
+    TraceRecord     *staging;
+    uint8_t         *planes;
+    uint8_t         *packed;
+    size_t          packed_capacity;
+    uint64_t        bytes;
+} Trace;
+
 #endif
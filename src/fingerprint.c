@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fingerprint.h"
+#include "ram.h"
+
+#define FINGERPRINT_K1 0x9E3779B97F4A7C15ULL
+#define FINGERPRINT_K2 0xC2B2AE3D27D4EB4FULL
+
+static inline uint64_t fingerprint_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static StateHash fingerprint_page(const uint8_t *page, uint16_t index) {
+    uint64_t lo = FINGERPRINT_K1 ^ index;
+    uint64_t hi = FINGERPRINT_K2 ^ index;
+    for (int i = 0; i < RAM_PAGE_SIZE; i += 8) {
+        uint64_t word;
+        memcpy(&word, page + i, 8);
+        lo = (lo ^ word) * FINGERPRINT_K1;
+        hi = (hi + word) * FINGERPRINT_K2;
+        hi ^= hi >> 29;
+    }
+    StateHash hash = {fingerprint_mix(lo), fingerprint_mix(hi ^ lo)};
+    return hash;
+}
+
+static void fingerprint_rehash(Fingerprint *fingerprint, RAM *ram, uint16_t page) {
+    StateHash hash = fingerprint_page(ram->read_page[page], page);
+    fingerprint->ram.lo += hash.lo - fingerprint->pages[page].lo;
+    fingerprint->ram.hi += hash.hi - fingerprint->pages[page].hi;
+    fingerprint->pages[page] = hash;
+}
+
+Fingerprint* fingerprint_init(NES nes) {
+    Fingerprint *fingerprint = (Fingerprint*) calloc(1, sizeof(Fingerprint));
+    if (!fingerprint) return NULL;
+    ram_track_dirty(nes.ram, true);
+    for (uint16_t page = 0; page < RAM_PAGE_COUNT; page++)
+        fingerprint_rehash(fingerprint, nes.ram, page);
+    return fingerprint;
+}
+
+void fingerprint_destroy(Fingerprint *fingerprint) {
+    free(fingerprint);
+}
+
+StateHash fingerprint_update(Fingerprint *fingerprint, NES nes) {
+    RAM *ram = nes.ram;
+    for (uint16_t word = 0; word < RAM_DIRTY_WORDS; word++) {
+        uint64_t bits = ram->dirty[word];
+        while (bits) {
+            fingerprint_rehash(fingerprint, ram, (uint16_t) (word * 64 + __builtin_ctzll(bits)));
+            bits &= bits - 1;
+        }
+    }
+    ram_dirty_clear(ram);
+
+    CPU *cpu = nes.cpu;
+    Controller *controller = nes.controller;
+    uint64_t registers = (uint64_t) cpu->pc
+                       | (uint64_t) cpu->a << 16
+                       | (uint64_t) cpu->x << 24
+                       | (uint64_t) cpu->y << 32
+                       | (uint64_t) cpu->sp << 40
+                       | (uint64_t) cpu->status << 48;
+    uint64_t devices = (uint64_t) controller->shift[0]
+                     | (uint64_t) controller->shift[1] << 8
+                     | (uint64_t) controller->strobe << 16;
+
+    // Bank registers decide what the CPU sees next, so they count as state.
+    const MapperState *mapper = &nes.bus->mapper_state;
+    uint64_t mmc3_banks;
+    memcpy(&mmc3_banks, mapper->mmc3.banks, sizeof(mmc3_banks));
+    devices |= (uint64_t) mapper->bank << 24
+             | (uint64_t) mapper->mmc1.control << 32
+             | (uint64_t) mapper->mmc1.prg << 40
+             | (uint64_t) mapper->mmc1.chr[0] << 48
+             | (uint64_t) mapper->mmc1.chr[1] << 56;
+    devices ^= fingerprint_mix(mmc3_banks ^ ((uint64_t) mapper->mmc3.select << 8 | mapper->mmc3.irq_counter));
+
+    StateHash hash;
+    hash.lo = fingerprint_mix(fingerprint->ram.lo ^ fingerprint_mix(registers ^ FINGERPRINT_K1) ^ devices);
+    hash.hi = fingerprint_mix(fingerprint->ram.hi + fingerprint_mix(registers + FINGERPRINT_K2) + devices);
+    return hash;
+}
@@ -0,0 +1,21 @@
+#ifndef MACNES_FINGERPRINT_H
+#define MACNES_FINGERPRINT_H
+
+#include "defs.h"
+
+// 128-bit machine state fingerprint. Each RAM page keeps its own hash and
+// the RAM hash is their position-keyed sum, so an update rehashes only the
+// pages written since the previous one. Registers, controller latches and
+// mapper banks are mixed in on every update; the cycle counter is not, so
+// equal states reached at different times match.
+//
+// The fingerprint owns the RAM dirty bitmap: init turns tracking on and
+// every update clears it.
+
+Fingerprint* fingerprint_init(NES nes);
+
+void fingerprint_destroy(Fingerprint *fingerprint);
+
+StateHash fingerprint_update(Fingerprint *fingerprint, NES nes);
+
+#endif
@@ -1,8 +1,75 @@
-#include "nes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "regress.h"
 
-int main() {
-    NES nes = nes_init();
-    cpu_clock(nes.cpu);
-    nes_shutdown(nes);
-    return 0;
+static const char *STATUS_NAMES[] = {"pass", "FAIL", "recorded", "bad rom", "bad movie", "bad hashes", "out of memory"};
+
+static void usage() {
+    fprintf(stderr, "usage: macnes [-j threads] [--record] manifest\n");
+}
+
+static double now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool record = false;
+    const char *manifest = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) record = true;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = strtol(argv[++i], NULL, 10);
+        else if (argv[i][0] != '-' && !manifest) manifest = argv[i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (!manifest || threads < 1) {
+        usage();
+        return 2;
+    }
+
+    Regress *regress = regress_init();
+    if (!regress) {
+        fprintf(stderr, "macnes: out of memory\n");
+        return 2;
+    }
+    size_t line = 0;
+    if (!regress_load(regress, manifest, &line)) {
+        if (line) fprintf(stderr, "%s:%zu: malformed entry\n", manifest, line);
+        else fprintf(stderr, "%s: cannot read manifest\n", manifest);
+        regress_destroy(regress);
+        return 2;
+    }
+
+    double start = now();
+    unsigned used = regress_run(regress, (unsigned) threads, record);
+    double seconds = now() - start;
+
+    uint64_t frames = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < regress->count; i++) {
+        const RegressEntry *entry = &regress->entries[i];
+        const RegressResult *result = &regress->results[i];
+        frames += result->frames;
+        if (result->status == REGRESS_PASS || result->status == REGRESS_RECORDED) continue;
+        failed++;
+        if (result->status == REGRESS_FAIL)
+            printf("%s: %u of %u frames differ, first at frame %u\n",
+                   entry->rom, result->mismatches, result->frames, result->first_mismatch);
+        else
+            printf("%s: %s\n", entry->rom, STATUS_NAMES[result->status]);
+    }
+    printf("%zu %s, %zu failed; %llu frames in %.2fs (%.0f frames/s, %u threads)\n",
+           regress->count - failed, record ? "recorded" : "passed", failed,
+           (unsigned long long) frames, seconds, seconds > 0 ? (double) frames / seconds : 0.0, used);
+
+    regress_destroy(regress);
+    return failed ? 1 : 0;
 }
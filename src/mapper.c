@@ -0,0 +1,283 @@
+#include <string.h>
+#include "mapper.h"
+
+// Points `size` bytes of CPU space at `address` at PRG bank `bank`, counted
+// in `size` units; negative banks count back from the last one. A window
+// larger than the whole ROM sees it mirrored.
+static void mapper_map_prg(Bus *bus, uint16_t address, size_t size, int bank) {
+    const Cartridge *cartridge = bus->cartridge;
+    if (cartridge->prg_size < size) {
+        for (size_t offset = 0; offset < size; offset += cartridge->prg_size)
+            mapper_map_prg(bus, (uint16_t) (address + offset), cartridge->prg_size, 0);
+        return;
+    }
+    int count = (int) (cartridge->prg_size / size);
+    bank %= count;
+    if (bank < 0) bank += count;
+    const uint8_t *base = cartridge->prg + (size_t) bank * size;
+    for (size_t offset = 0; offset < size; offset += RAM_PAGE_SIZE) {
+        size_t page = (address + offset) >> 8;
+        bus->rom_map[page] = base + offset;
+        bus->read_map[page] = bus->trap_map[page] ? NULL : base + offset;
+    }
+}
+
+// Same for PPU space, a no-op for CHR RAM boards until a PPU owns that RAM.
+static void mapper_map_chr(Bus *bus, uint16_t address, size_t size, int bank) {
+    const Cartridge *cartridge = bus->cartridge;
+    if (cartridge->chr_size < size) return;
+    int count = (int) (cartridge->chr_size / size);
+    bank %= count;
+    if (bank < 0) bank += count;
+    const uint8_t *base = cartridge->chr + (size_t) bank * size;
+    for (size_t offset = 0; offset < size; offset += CARTRIDGE_CHR_PAGE_SIZE)
+        bus->chr_map[(address + offset) / CARTRIDGE_CHR_PAGE_SIZE] = base + offset;
+}
+
+static void mapper_power_none(Bus *bus, uint64_t clock) {
+    (void) bus;
+    (void) clock;
+}
+
+static void mapper_write_none(Bus *bus, uint16_t address, uint8_t data) {
+    (void) bus;
+    (void) address;
+    (void) data;
+}
+
+static void mapper_event_none(Bus *bus, uint64_t clock) {
+    (void) clock;
+    bus->mapper_state.next_event = MAPPER_NO_EVENT;
+}
+
+
+
+// NROM, UxROM, CNROM
+
+static void nrom_sync(Bus *bus) {
+    mapper_map_prg(bus, 0x8000, CARTRIDGE_PRG_UNIT, 0);
+    mapper_map_prg(bus, 0xC000, CARTRIDGE_PRG_UNIT, -1);
+    mapper_map_chr(bus, 0x0000, CARTRIDGE_CHR_UNIT, 0);
+}
+
+static void uxrom_write(Bus *bus, uint16_t address, uint8_t data) {
+    (void) address;
+    bus->mapper_state.bank = data;
+    mapper_map_prg(bus, 0x8000, CARTRIDGE_PRG_UNIT, data);
+}
+
+static void uxrom_sync(Bus *bus) {
+    mapper_map_prg(bus, 0x8000, CARTRIDGE_PRG_UNIT, bus->mapper_state.bank);
+    mapper_map_prg(bus, 0xC000, CARTRIDGE_PRG_UNIT, -1);
+    mapper_map_chr(bus, 0x0000, CARTRIDGE_CHR_UNIT, 0);
+}
+
+static void cnrom_write(Bus *bus, uint16_t address, uint8_t data) {
+    (void) address;
+    bus->mapper_state.bank = data;
+    mapper_map_chr(bus, 0x0000, CARTRIDGE_CHR_UNIT, data);
+}
+
+static void cnrom_sync(Bus *bus) {
+    mapper_map_prg(bus, 0x8000, CARTRIDGE_PRG_UNIT, 0);
+    mapper_map_prg(bus, 0xC000, CARTRIDGE_PRG_UNIT, -1);
+    mapper_map_chr(bus, 0x0000, CARTRIDGE_CHR_UNIT, bus->mapper_state.bank);
+}
+
+
+
+// MMC1
+
+static void mmc1_sync(Bus *bus) {
+    const Mmc1State *mmc1 = &bus->mapper_state.mmc1;
+    int prg = mmc1->prg & 0x0F;
+    switch ((mmc1->control >> 2) & 3) {
+        case 0:
+        case 1:
+            mapper_map_prg(bus, 0x8000, 2 * CARTRIDGE_PRG_UNIT, prg >> 1);
+            break;
+        case 2:
+            mapper_map_prg(bus, 0x8000, CARTRIDGE_PRG_UNIT, 0);
+            mapper_map_prg(bus, 0xC000, CARTRIDGE_PRG_UNIT, prg);
+            break;
+        case 3:
+            mapper_map_prg(bus, 0x8000, CARTRIDGE_PRG_UNIT, prg);
+            mapper_map_prg(bus, 0xC000, CARTRIDGE_PRG_UNIT, -1);
+            break;
+    }
+    if (mmc1->control & 0x10) {
+        mapper_map_chr(bus, 0x0000, CARTRIDGE_CHR_UNIT / 2, mmc1->chr[0]);
+        mapper_map_chr(bus, 0x1000, CARTRIDGE_CHR_UNIT / 2, mmc1->chr[1]);
+    } else {
+        mapper_map_chr(bus, 0x0000, CARTRIDGE_CHR_UNIT, mmc1->chr[0] >> 1);
+    }
+    static const uint8_t MIRRORING[4] = {MIRROR_SINGLE_LOWER, MIRROR_SINGLE_UPPER, MIRROR_VERTICAL, MIRROR_HORIZONTAL};
+    bus->mapper_state.mirroring = MIRRORING[mmc1->control & 3];
+}
+
+static void mmc1_power(Bus *bus, uint64_t clock) {
+    (void) clock;
+    bus->mapper_state.mmc1.control = 0x0C;
+}
+
+// Registers are loaded serially, one bit per write, and only the fifth
+// write selects which register the bits go to.
+static void mmc1_write(Bus *bus, uint16_t address, uint8_t data) {
+    Mmc1State *mmc1 = &bus->mapper_state.mmc1;
+    if (data & 0x80) {
+        mmc1->shift = 0;
+        mmc1->shift_count = 0;
+        mmc1->control |= 0x0C;
+        mmc1_sync(bus);
+        return;
+    }
+    mmc1->shift |= (uint8_t) ((data & 1) << mmc1->shift_count);
+    if (++mmc1->shift_count < 5) return;
+
+    switch ((address >> 13) & 3) {
+        case 0: mmc1->control = mmc1->shift; break;
+        case 1: mmc1->chr[0] = mmc1->shift; break;
+        case 2: mmc1->chr[1] = mmc1->shift; break;
+        case 3: mmc1->prg = mmc1->shift; break;
+    }
+    mmc1->shift = 0;
+    mmc1->shift_count = 0;
+    mmc1_sync(bus);
+}
+
+
+
+// MMC3
+
+// The scanline counter is clocked by PPU A12 rising, around dot 260 of every
+// rendered line and the pre-render line. The lines are at fixed cycles from
+// the frame boundary, so the next one is computed rather than counted to.
+#define MMC3_DOTS_PER_LINE 341
+#define MMC3_CLOCK_DOT 260
+#define MMC3_PRE_RENDER_LINE 261
+#define MMC3_VISIBLE_LINES 240
+
+static uint64_t mmc3_line_clock(uint64_t frame, uint32_t line) {
+    uint64_t x2 = frame * NES_FRAME_CYCLES_X2 + ((uint64_t) line * MMC3_DOTS_PER_LINE + MMC3_CLOCK_DOT) * 2 / 3;
+    return (x2 + 1) / 2;
+}
+
+static uint64_t mmc3_next_line(uint64_t clock) {
+    uint64_t frame = clock * 2 / NES_FRAME_CYCLES_X2;
+    uint64_t into = clock * 2 - frame * NES_FRAME_CYCLES_X2;
+    uint32_t line = (uint32_t) (into * 3 / 2 / MMC3_DOTS_PER_LINE);
+    line = line > 0 ? line - 1 : 0;
+    for (;;) {
+        if (line >= MMC3_VISIBLE_LINES && line < MMC3_PRE_RENDER_LINE) line = MMC3_PRE_RENDER_LINE;
+        if (line > MMC3_PRE_RENDER_LINE) {
+            frame++;
+            line = 0;
+        }
+        uint64_t at = mmc3_line_clock(frame, line);
+        if (at > clock) return at;
+        line++;
+    }
+}
+
+static void mmc3_sync(Bus *bus) {
+    const Mmc3State *mmc3 = &bus->mapper_state.mmc3;
+    const size_t prg = CARTRIDGE_PRG_UNIT / 2;
+    bool swap = mmc3->select & 0x40;
+    mapper_map_prg(bus, swap ? 0xC000 : 0x8000, prg, mmc3->banks[6]);
+    mapper_map_prg(bus, 0xA000, prg, mmc3->banks[7]);
+    mapper_map_prg(bus, swap ? 0x8000 : 0xC000, prg, -2);
+    mapper_map_prg(bus, 0xE000, prg, -1);
+
+    uint16_t invert = mmc3->select & 0x80 ? 0x1000 : 0x0000;
+    const size_t chr = CARTRIDGE_CHR_PAGE_SIZE;
+    mapper_map_chr(bus, 0x0000 ^ invert, 2 * chr, mmc3->banks[0] >> 1);
+    mapper_map_chr(bus, 0x0800 ^ invert, 2 * chr, mmc3->banks[1] >> 1);
+    for (int i = 0; i < 4; i++)
+        mapper_map_chr(bus, (uint16_t) ((0x1000 + i * chr) ^ invert), chr, mmc3->banks[2 + i]);
+}
+
+static void mmc3_power(Bus *bus, uint64_t clock) {
+    bus->mapper_state.next_event = mmc3_next_line(clock);
+}
+
+static void mmc3_write(Bus *bus, uint16_t address, uint8_t data) {
+    MapperState *state = &bus->mapper_state;
+    Mmc3State *mmc3 = &state->mmc3;
+    switch (address & 0xE001) {
+        case 0x8000:
+            mmc3->select = data;
+            mmc3_sync(bus);
+            break;
+        case 0x8001:
+            mmc3->banks[mmc3->select & 7] = data;
+            mmc3_sync(bus);
+            break;
+        case 0xA000:
+            if (bus->cartridge->mirroring != MIRROR_FOUR_SCREEN)
+                state->mirroring = data & 1 ? MIRROR_HORIZONTAL : MIRROR_VERTICAL;
+            break;
+        case 0xA001:
+            mmc3->prg_ram = data;
+            break;
+        case 0xC000:
+            mmc3->irq_latch = data;
+            break;
+        case 0xC001:
+            mmc3->irq_counter = 0;
+            mmc3->irq_reload = true;
+            break;
+        case 0xE000:
+            mmc3->irq_enabled = false;
+            state->irq = false;
+            break;
+        case 0xE001:
+            mmc3->irq_enabled = true;
+            break;
+    }
+}
+
+static void mmc3_event(Bus *bus, uint64_t clock) {
+    MapperState *state = &bus->mapper_state;
+    Mmc3State *mmc3 = &state->mmc3;
+    if (mmc3->irq_counter == 0 || mmc3->irq_reload) {
+        mmc3->irq_counter = mmc3->irq_latch;
+        mmc3->irq_reload = false;
+    } else {
+        mmc3->irq_counter--;
+    }
+    if (mmc3->irq_counter == 0 && mmc3->irq_enabled) state->irq = true;
+    state->next_event = mmc3_next_line(clock);
+}
+
+
+
+static const Mapper MAPPERS[] = {
+    {0, "NROM", mapper_power_none, mapper_write_none, nrom_sync, mapper_event_none},
+    {1, "MMC1", mmc1_power, mmc1_write, mmc1_sync, mapper_event_none},
+    {2, "UxROM", mapper_power_none, uxrom_write, uxrom_sync, mapper_event_none},
+    {3, "CNROM", mapper_power_none, cnrom_write, cnrom_sync, mapper_event_none},
+    {4, "MMC3", mmc3_power, mmc3_write, mmc3_sync, mmc3_event},
+};
+
+const Mapper* mapper_find(uint16_t id) {
+    for (size_t i = 0; i < sizeof(MAPPERS) / sizeof(MAPPERS[0]); i++) {
+        if (MAPPERS[i].id == id) return &MAPPERS[i];
+    }
+    return NULL;
+}
+
+void mapper_power(Bus *bus, uint64_t clock) {
+    MapperState *state = &bus->mapper_state;
+    memset(state, 0, sizeof(MapperState));
+    state->id = bus->mapper->id;
+    state->mirroring = bus->cartridge->mirroring;
+    state->next_event = MAPPER_NO_EVENT;
+    bus->mapper->power(bus, clock);
+    bus->mapper->sync(bus);
+}
+
+void mapper_restore(Bus *bus, const MapperState *state) {
+    if (!bus->mapper || state->id != bus->mapper->id) return;
+    bus->mapper_state = *state;
+    bus->mapper->sync(bus);
+}
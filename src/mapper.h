@@ -0,0 +1,29 @@
+#ifndef MACNES_MAPPER_H
+#define MACNES_MAPPER_H
+
+#include "defs.h"
+
+// Cartridge mappers: NROM (0), MMC1 (1), UxROM (2), CNROM (3) and MMC3 (4).
+// A mapper only sees writes to its ROM pages. Bank registers live in
+// bus->mapper_state, and a register write repoints the affected entries of
+// bus->rom_map, bus->read_map (unless trapped) and bus->chr_map, so reads
+// never go through the mapper.
+//
+// Mappers that count time ask for a call at mapper_state.next_event (a CPU
+// clock_count) rather than being clocked; an asserted mapper_state.irq is
+// held until the mapper releases it.
+
+// NULL for mappers that are not implemented.
+const Mapper* mapper_find(uint16_t id);
+
+// Power-on state for the cartridge on `bus`, with the banks mapped.
+void mapper_power(Bus *bus, uint64_t clock);
+
+// Loads saved registers and remaps the banks they select.
+void mapper_restore(Bus *bus, const MapperState *state);
+
+static inline void mapper_event(Bus *bus, uint64_t clock) {
+    bus->mapper->event(bus, clock);
+}
+
+#endif
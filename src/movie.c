@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "movie.h"
+#include "codec.h"
+#include "nes.h"
+
+static const char MOVIE_MAGIC[4] = {'M', 'N', 'M', 'V'};
+
+static bool movie_reserve(void **items, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) return true;
+    size_t grown = *capacity ? *capacity * 2 : 1024;
+    while (grown < needed) grown *= 2;
+    void *resized = realloc(*items, grown * size);
+    if (!resized) return false;
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+Movie* movie_init() {
+    return (Movie*) calloc(1, sizeof(Movie));
+}
+
+void movie_destroy(Movie *movie) {
+    if (!movie) return;
+    free(movie->inputs);
+    free(movie);
+}
+
+bool movie_append(Movie *movie, NesInput input) {
+    size_t capacity = movie->capacity;
+    if (!movie_reserve((void**) &movie->inputs, &capacity, (size_t) movie->length + 1, sizeof(NesInput)))
+        return false;
+    movie->capacity = (uint32_t) capacity;
+    movie->inputs[movie->length++] = input;
+    return true;
+}
+
+bool movie_save(const Movie *movie, const char *path) {
+    MovieHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+    header.version = MOVIE_VERSION;
+    header.ports = 2;
+    header.length = movie->length;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(movie->inputs, sizeof(NesInput), movie->length, file) == movie->length;
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
+
+Movie* movie_load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    MovieHeader header;
+    Movie *movie = NULL;
+    struct stat info;
+    if (fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, MOVIE_MAGIC, sizeof(MOVIE_MAGIC)) == 0
+        && header.version == MOVIE_VERSION && header.ports == 2
+        && fstat(fileno(file), &info) == 0
+        && (uint64_t) header.length * sizeof(NesInput) <= (uint64_t) info.st_size - sizeof(header)) {
+        movie = movie_init();
+        size_t capacity = 0;
+        if (movie && movie_reserve((void**) &movie->inputs, &capacity, header.length ? header.length : 1,
+                                   sizeof(NesInput))) {
+            movie->capacity = (uint32_t) capacity;
+            movie->length = header.length;
+            if (fread(movie->inputs, sizeof(NesInput), header.length, file) != header.length) {
+                movie_destroy(movie);
+                movie = NULL;
+            }
+        } else {
+            movie_destroy(movie);
+            movie = NULL;
+        }
+    }
+    fclose(file);
+    return movie;
+}
+
+
+
+// Player
+
+MoviePlayer* movie_player_init(NES nes, const Movie *movie, uint32_t interval) {
+    MoviePlayer *player = (MoviePlayer*) calloc(1, sizeof(MoviePlayer));
+    if (!player) return NULL;
+    player->nes = nes;
+    player->movie = movie;
+    player->interval = interval ? interval : 1;
+    player->packed_capacity = codec_bound(sizeof(NesState));
+    player->scratch = nes_state_init();
+    player->packed = (uint8_t*) malloc(player->packed_capacity);
+    if (!player->scratch || !player->packed) {
+        movie_player_destroy(player);
+        return NULL;
+    }
+    return player;
+}
+
+void movie_player_destroy(MoviePlayer *player) {
+    if (!player) return;
+    free(player->keyframes);
+    free(player->index);
+    nes_state_destroy(player->scratch);
+    free(player->packed);
+    free(player);
+}
+
+// Appends the current state to the index. Keyframes are compressed whole,
+// so any one of them can be restored without the others.
+static bool movie_player_index(MoviePlayer *player) {
+    nes_snapshot(player->nes, player->scratch);
+    size_t size = codec_compress((const uint8_t*) player->scratch, sizeof(NesState),
+                                 player->packed, player->packed_capacity);
+    size_t capacity = player->keyframe_capacity;
+    if (size == 0
+        || !movie_reserve((void**) &player->index, &player->index_capacity, player->index_size + size, 1)
+        || !movie_reserve((void**) &player->keyframes, &capacity, (size_t) player->keyframe_count + 1,
+                          sizeof(MovieKeyframe)))
+        return false;
+    player->keyframe_capacity = (uint32_t) capacity;
+
+    memcpy(player->index + player->index_size, player->packed, size);
+    MovieKeyframe *keyframe = &player->keyframes[player->keyframe_count++];
+    keyframe->offset = player->index_size;
+    keyframe->size = (uint32_t) size;
+    player->index_size += size;
+    return true;
+}
+
+static bool movie_player_restore(MoviePlayer *player, uint32_t key) {
+    const MovieKeyframe *keyframe = &player->keyframes[key];
+    if (codec_decompress(player->index + keyframe->offset, keyframe->size,
+                         (uint8_t*) player->scratch, sizeof(NesState)) != sizeof(NesState))
+        return false;
+    if (!nes_restore(player->nes, player->scratch)) return false;
+    player->frame = key * player->interval;
+    return true;
+}
+
+bool movie_player_step(MoviePlayer *player, NesFrame *out, NesFrameResult *result) {
+    if (player->frame >= player->movie->length) return false;
+    // A failed index append only costs seek time later.
+    if (player->frame == player->keyframe_count * player->interval)
+        movie_player_index(player);
+
+    NesFrameResult frame = nes_run_frame(player->nes, player->movie->inputs[player->frame], out);
+    if (result) *result = frame;
+    player->frame++;
+    return true;
+}
+
+bool movie_player_seek(MoviePlayer *player, uint32_t frame) {
+    if (frame > player->movie->length) return false;
+    if (player->keyframe_count > 0) {
+        uint32_t key = frame / player->interval;
+        if (key >= player->keyframe_count) key = player->keyframe_count - 1;
+        uint32_t start = key * player->interval;
+        if ((player->frame < start || player->frame > frame) && !movie_player_restore(player, key))
+            return false;
+    } else if (player->frame > frame) {
+        return false;
+    }
+    while (player->frame < frame)
+        movie_player_step(player, NULL, NULL);
+    return true;
+}
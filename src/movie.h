@@ -0,0 +1,41 @@
+#ifndef MACNES_MOVIE_H
+#define MACNES_MOVIE_H
+
+#include "defs.h"
+
+// Input movie, version MOVIE_VERSION, little-endian:
+//
+//   MovieHeader     magic "MNMV", version, port count, frame count
+//   uint8_t[2][]    buttons of both pads for every frame
+//
+// A movie starts from whatever state the machine is in when its player is
+// created, normally just after nes_reset.
+
+Movie* movie_init();
+
+void movie_destroy(Movie *movie);
+
+bool movie_append(Movie *movie, NesInput input);
+
+bool movie_save(const Movie *movie, const char *path);
+
+// Returns NULL if the file is missing or not a valid movie.
+Movie* movie_load(const char *path);
+
+// Plays `movie` on `nes`. Every `interval` frames the state is compressed
+// into a keyframe index as it is first reached, so a seek restores the
+// nearest indexed keyframe at or before its target and replays at most
+// `interval` frames past the end of the index.
+
+MoviePlayer* movie_player_init(NES nes, const Movie *movie, uint32_t interval);
+
+void movie_player_destroy(MoviePlayer *player);
+
+// Runs the next frame of the movie. Returns false once it has ended.
+bool movie_player_step(MoviePlayer *player, NesFrame *out, NesFrameResult *result);
+
+// Leaves the machine in the state before frame `frame` runs; `frame` may be
+// the movie's length. Replayed frames produce no output.
+bool movie_player_seek(MoviePlayer *player, uint32_t frame);
+
+#endif
@@ -0,0 +1,269 @@
+#include <string.h>
+#include "nes.h"
+#include "controller.h"
+#include "audio.h"
+#include "mapper.h"
+#include "aot.h"
+#include "debug.h"
+#include "trace.h"
+#include "coroutine.h"
+
+NES nes_init() {
+    Bus *bus = bus_init();
+
+    RAM *ram = ram_init();
+    bus_connect_ram(bus, ram);
+
+    CPU *cpu = cpu_init();
+    bus_connect_cpu(bus, cpu);
+
+    Controller *controller = controller_init();
+    bus_connect_controller(bus, controller);
+
+    Audio *audio = audio_init(NES_AUDIO_RATE);
+
+    NES nes = {ram, bus, cpu, controller, audio};
+    return nes;
+}
+
+void nes_shutdown(NES nes) {
+    ram_destroy(nes.ram);
+    cpu_destroy(nes.cpu);
+    controller_destroy(nes.controller);
+    audio_destroy(nes.audio);
+    bus_destroy(nes.bus);
+}
+
+NES nes_fork(NES parent) {
+    Bus *bus = bus_init();
+
+    RAM *ram = ram_fork(parent.ram);
+    bus_connect_ram(bus, ram);
+
+    CPU *cpu = cpu_init();
+    CpuCounters *counters = cpu->counters;
+    *cpu = *parent.cpu;
+    cpu->profile = NULL;
+    cpu->trace = NULL;
+    cpu->counters = counters;
+    bus_connect_cpu(bus, cpu);
+
+    Controller *controller = controller_init();
+    *controller = *parent.controller;
+    bus_connect_controller(bus, controller);
+
+    // The child shares the parent's ROM mapping and current bank layout.
+    bus_insert_cartridge(bus, parent.bus->cartridge, cpu->clock_count);
+    bus->mapper_state = parent.bus->mapper_state;
+    // Watchpoints stay with the parent, so the child maps every ROM page.
+    memcpy(bus->read_map, parent.bus->rom_map, sizeof(bus->read_map));
+    memcpy(bus->rom_map, parent.bus->rom_map, sizeof(bus->rom_map));
+    memcpy(bus->chr_map, parent.bus->chr_map, sizeof(bus->chr_map));
+    bus->aot = parent.bus->aot;
+
+    Audio *audio = audio_clone(parent.audio);
+
+    NES nes = {ram, bus, cpu, controller, audio};
+    return nes;
+}
+
+bool nes_insert_cartridge(NES nes, Cartridge *cartridge) {
+    if (!bus_insert_cartridge(nes.bus, cartridge, nes.cpu->clock_count)) return false;
+    nes_reset(nes);
+    return true;
+}
+
+void nes_set_tier(NES nes, enum CpuTier tier) {
+    nes.cpu->tier = tier;
+}
+
+void nes_set_dispatch(NES nes, enum CpuDispatch dispatch) {
+    nes.cpu->dispatch = dispatch;
+}
+
+void nes_profile_pairs(NES nes, CpuPairProfile *profile) {
+    nes.cpu->profile = profile;
+}
+
+void nes_trace(NES nes, Trace *trace) {
+    nes.cpu->trace = trace;
+}
+
+CpuCounters* nes_counters(NES nes) {
+    return nes.cpu->counters;
+}
+
+bool nes_attach_aot(NES nes, const Aot *aot) {
+    if (aot && !aot_matches(aot, nes.bus->cartridge)) return false;
+    nes.bus->aot = aot;
+    return true;
+}
+
+void nes_attach_debug(NES nes, Debug *debug) {
+    if (debug) debug_attach(debug, nes.bus);
+    else if (nes.bus->debug) debug_attach(nes.bus->debug, NULL);
+}
+
+void nes_reset(NES nes) {
+    cpu_reset(nes.cpu);
+    resampler_reset(nes.audio->resampler);
+}
+
+// Frame loop while a debugger is attached: interpreted one instruction at a
+// time so breakpoints are seen at every instruction boundary. Returns true
+// if the debugger stopped it before `end`.
+static bool nes_run_debug(NES nes, uint64_t end) {
+    CPU *cpu = nes.cpu;
+    Bus *bus = nes.bus;
+    Debug *debug = bus->debug;
+    while (cpu->clock_count < end) {
+        if (bus->mapper_state.irq) cpu_irq(cpu);
+        if (cpu->cycles == 0 && debug_check_break(debug, cpu->pc)) return true;
+        if (cpu->trace) trace_step(cpu->trace, cpu);
+        else if (cpu->tier == CPU_TIER_ACCURATE) cpu_step_accurate(cpu);
+        else cpu_step(cpu);
+        if (cpu->clock_count >= bus->mapper_state.next_event) mapper_event(bus, cpu->clock_count);
+        if (debug_take_stop(debug)) return true;
+    }
+    return false;
+}
+
+// The accurate tier runs the CPU and the mapper timer as scheduler
+// components. The CPU waits for the timer before each bus access, so the
+// two only switch when an event is due; a run ends with the CPU between
+// instructions, possibly with an event just behind it that the timer takes
+// at the start of the next one.
+static void nes_mapper_component(Scheduler *scheduler, uint32_t component, void *context) {
+    Bus *bus = (Bus*) context;
+    for (;;) {
+        scheduler->components[component].clock = bus->mapper_state.next_event;
+        scheduler_sync(scheduler, component);
+        mapper_event(bus, bus->mapper_state.next_event);
+    }
+}
+
+static void nes_cpu_component(Scheduler *scheduler, uint32_t component, void *context) {
+    CPU *cpu = (CPU*) context;
+    for (;;) {
+        scheduler->components[component].clock = cpu->clock_count;
+        scheduler_sync(scheduler, component);
+        if (cpu->bus->mapper_state.irq) cpu_irq(cpu);
+        if (cpu->trace) trace_step(cpu->trace, cpu);
+        else cpu_step_accurate(cpu);
+    }
+}
+
+// Made on the first accurate frame; NULL if it cannot be, in which case
+// the frame loop syncs the mapper itself.
+static Scheduler* nes_scheduler(NES nes) {
+    Bus *bus = nes.bus;
+    if (bus->scheduler) return bus->scheduler;
+    Scheduler *scheduler = scheduler_init();
+    if (!scheduler || scheduler_add(scheduler, nes_mapper_component, bus, 0) != NES_COMPONENT_MAPPER
+        || scheduler_add(scheduler, nes_cpu_component, nes.cpu, 0) != NES_COMPONENT_CPU) {
+        scheduler_destroy(scheduler);
+        return NULL;
+    }
+    bus->scheduler = scheduler;
+    return scheduler;
+}
+
+NesFrameResult nes_run_frame(NES nes, NesInput input, NesFrame *out) {
+    NesFrameResult result = {0, 0, 0};
+    CPU *cpu = nes.cpu;
+
+    uint64_t start = cpu->clock_count;
+    uint64_t frame = start * 2 / NES_FRAME_CYCLES_X2;
+    uint64_t end = ((frame + 1) * NES_FRAME_CYCLES_X2 + 1) / 2;
+
+    controller_set(nes.controller, 0, input.buttons[0]);
+    controller_set(nes.controller, 1, input.buttons[1]);
+    nes.controller->polled = false;
+
+    // Mapper IRQs are level-triggered and taken between instructions; mapper
+    // timers are only called at the cycle they asked for. Compiled blocks
+    // stop at either, and are not entered while an IRQ is pending so the
+    // interpreter sees the instruction that unmasks it.
+    Bus *bus = nes.bus;
+    Scheduler *scheduler;
+    if (bus->debug) {
+        if (nes_run_debug(nes, end)) result.events |= NES_EVENT_BREAK;
+    } else if (cpu->tier == CPU_TIER_ACCURATE && (scheduler = nes_scheduler(nes))) {
+        // A snapshot may have been restored since the last run.
+        scheduler->components[NES_COMPONENT_MAPPER].clock = bus->mapper_state.next_event;
+        scheduler->components[NES_COMPONENT_CPU].clock = cpu->clock_count;
+        scheduler_run(scheduler, end);
+    } else {
+        while (cpu->clock_count < end) {
+            if (bus->mapper_state.irq) cpu_irq(cpu);
+            const AotBlock *block = bus->aot && !CPU_COUNTING && cpu->tier == CPU_TIER_FAST && cpu->cycles == 0
+                                  && !cpu->trace && !bus->mapper_state.irq ? aot_find(bus->aot, bus, cpu->pc) : NULL;
+            if (block) block->run(cpu, end < bus->mapper_state.next_event ? end : bus->mapper_state.next_event);
+            else if (cpu->trace) trace_step(cpu->trace, cpu);
+            else if (cpu->tier == CPU_TIER_ACCURATE) cpu_step_accurate(cpu);
+            else if (cpu->profile) cpu_step_profiled(cpu, cpu->profile);
+            else if (cpu->dispatch == CPU_DISPATCH_FUSED && !bus->mapper_state.irq) cpu_step_fused(cpu, end);
+            else cpu_step(cpu);
+            if (cpu->clock_count >= bus->mapper_state.next_event) mapper_event(bus, cpu->clock_count);
+        }
+    }
+
+    result.cycles = (uint32_t) (cpu->clock_count - start);
+    if (nes.controller->polled) result.events |= NES_EVENT_INPUT_POLLED;
+
+    // Channel levels only change on APU register writes, so the whole frame
+    // is fed to the resampler as one held level. Frames nobody listens to
+    // leave the resampler where it was.
+    float *audio = out ? out->audio : NULL;
+    if (audio) {
+        size_t produced = resampler_hold(nes.audio->resampler, audio_mix(nes.audio->channels),
+                                         result.cycles, audio, out->audio_capacity);
+        if (produced > out->audio_capacity) {
+            result.events |= NES_EVENT_AUDIO_OVERRUN;
+            produced = out->audio_capacity;
+        }
+        result.audio_samples = produced;
+    }
+
+    return result;
+}
+
+NesState* nes_state_init() {
+    return (NesState*) calloc(1, sizeof(NesState));
+}
+
+void nes_state_destroy(NesState *state) {
+    free(state);
+}
+
+void nes_snapshot(NES nes, NesState *state) {
+    state->cpu = *nes.cpu;
+    state->controller = *nes.controller;
+    state->channels = nes.audio->channels;
+    state->resampler = nes.audio->resampler->state;
+    state->mapper = nes.bus->mapper_state;
+    ram_save(nes.ram, state->ram);
+}
+
+bool nes_restore(NES nes, const NesState *state) {
+    if (!ram_load(nes.ram, state->ram)) return false;
+    CPU *cpu = nes.cpu;
+    Bus *bus = cpu->bus;
+    enum CpuTier tier = cpu->tier;
+    enum CpuDispatch dispatch = cpu->dispatch;
+    CpuPairProfile *profile = cpu->profile;
+    Trace *trace = cpu->trace;
+    CpuCounters *counters = cpu->counters;
+    *cpu = state->cpu;
+    cpu->bus = bus;
+    cpu->tier = tier;
+    cpu->dispatch = dispatch;
+    cpu->profile = profile;
+    cpu->trace = trace;
+    cpu->counters = counters;
+    *nes.controller = state->controller;
+    nes.audio->channels = state->channels;
+    nes.audio->resampler->state = state->resampler;
+    mapper_restore(nes.bus, &state->mapper);
+    return true;
+}
@@ -7,23 +7,78 @@
 #include "bus.h"
 #include "cpu.h"
 
-NES nes_init() {
-    Bus *bus = bus_init();
+NES nes_init();
 
-    RAM *ram = ram_init();
-    bus_connect_ram(bus, ram);
+void nes_shutdown(NES nes);
 
-    CPU *cpu = cpu_init();
-    bus_connect_cpu(bus, cpu);
+// Child machine in the parent's current state. RAM pages are shared
+// copy-on-write, so a fork costs a few small allocations and no copying
+// until either machine writes.
+NES nes_fork(NES parent);
 
-    NES nes = {ram, bus, cpu};
-    return nes;
-}
+void nes_reset(NES nes);
 
-void nes_shutdown(NES nes) {
-    ram_destroy(nes.ram);
-    cpu_destroy(nes.cpu);
-    bus_destroy(nes.bus);
-}
+// Maps a cartridge opened with cartridge_open into the machine and resets
+// it. The ROM is not copied; machines running the same cartridge all read
+// the one file mapping. Returns false if its mapper is not supported.
+bool nes_insert_cartridge(NES nes, Cartridge *cartridge);
+
+// Runs code recompiled ahead of time (see recompile.h) for the inserted
+// cartridge wherever it applies; NULL detaches it. Returns false if `aot`
+// was compiled from a different PRG ROM. `aot` must outlive its use, and
+// the executable must export its symbols to the shared object. Inserting a
+// cartridge detaches it; forks inherit it.
+bool nes_attach_aot(NES nes, const Aot *aot);
+
+// Attaches a debugger (see debug.h), detaching any other; NULL detaches.
+// Forks do not inherit it.
+void nes_attach_debug(NES nes, Debug *debug);
+
+// Selects the CPU core build. The accurate tier ignores the dispatch mode,
+// compiled code and pair profiling, all of which apply to the fast tier.
+// Forks inherit it and restoring a state keeps it.
+void nes_set_tier(NES nes, enum CpuTier tier);
+
+// Selects how the interpreter dispatches instructions. Every mode gives the
+// same results; forks inherit it and restoring a state keeps it.
+void nes_set_dispatch(NES nes, enum CpuDispatch dispatch);
+
+// Counts executed opcode pairs into `profile` (reset it first), overriding
+// the dispatch mode until called with NULL. Forks do not inherit it.
+void nes_profile_pairs(NES nes, CpuPairProfile *profile);
+
+// Records every instruction into `trace` (see trace.h) until called with
+// NULL. Traced code is interpreted one instruction at a time, bypassing
+// compiled code, fused dispatch and pair profiling. Forks do not inherit
+// it and restoring a state keeps it.
+void nes_trace(NES nes, Trace *trace);
+
+// The machine's instrumentation counters (see CpuCounters), or NULL unless
+// built with MACNES_PROFILE. They count from power-on or the last
+// cpu_counters_reset. Forks start from zero and restoring a state leaves
+// them alone. Compiled code is not run while counting.
+CpuCounters* nes_counters(NES nes);
+
+// Runs exactly one NTSC video frame (29780.5 CPU cycles on average) with the
+// given controller state. Video and audio go straight into the caller's
+// buffers in `out`; either may be NULL. `out->video` takes
+// NES_VIDEO_WIDTH * NES_VIDEO_HEIGHT palette indices once a PPU drives it.
+// Without an audio buffer the resampler is skipped and the next frame that
+// has one carries on from where it stopped.
+// With a debugger attached, a breakpoint or watchpoint may stop it early
+// with NES_EVENT_BREAK; the next call runs the rest of the same frame.
+NesFrameResult nes_run_frame(NES nes, NesInput input, NesFrame *out);
+
+// Whole-machine state in one fixed-layout buffer. Allocate it once and reuse
+// it; snapshot and restore are plain copies of each component.
+NesState* nes_state_init();
+
+void nes_state_destroy(NesState *state);
+
+void nes_snapshot(NES nes, NesState *state);
+
+// False, leaving the machine untouched, when its RAM cannot be reallocated
+// (see ram_load).
+bool nes_restore(NES nes, const NesState *state);
 
 #endif
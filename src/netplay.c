@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include "netplay.h"
+#include "nes.h"
+
+Netplay* netplay_init(NES nes, uint8_t local_port, NetplayTransport transport) {
+    Netplay *netplay = (Netplay*) calloc(1, sizeof(Netplay));
+    if (!netplay) return NULL;
+    netplay->nes = nes;
+    netplay->local_port = local_port & 1;
+    netplay->transport = transport;
+    for (int i = 0; i < NETPLAY_HISTORY; i++) {
+        netplay->states[i] = nes_state_init();
+        if (!netplay->states[i]) {
+            netplay_destroy(netplay);
+            return NULL;
+        }
+    }
+    return netplay;
+}
+
+void netplay_destroy(Netplay *netplay) {
+    if (!netplay) return;
+    for (int i = 0; i < NETPLAY_HISTORY; i++)
+        nes_state_destroy(netplay->states[i]);
+    free(netplay);
+}
+
+static bool netplay_remote_known(Netplay *netplay, uint32_t frame) {
+    uint32_t slot = frame % (NETPLAY_HISTORY * 2);
+    return netplay->remote_known[slot] && netplay->remote_frame[slot] == frame;
+}
+
+static uint8_t netplay_remote(Netplay *netplay, uint32_t frame) {
+    if (netplay_remote_known(netplay, frame))
+        return netplay->remote[frame % (NETPLAY_HISTORY * 2)];
+    if (netplay->confirmed == 0) return 0;
+    return netplay->remote[(netplay->confirmed - 1) % (NETPLAY_HISTORY * 2)];
+}
+
+static NesInput netplay_input(Netplay *netplay, uint8_t local, uint8_t remote) {
+    NesInput input;
+    input.buttons[netplay->local_port] = local;
+    input.buttons[netplay->local_port ^ 1] = remote;
+    return input;
+}
+
+void netplay_poll(Netplay *netplay) {
+    uint32_t frame;
+    uint8_t buttons;
+    uint32_t rollback = netplay->frame;
+    while (netplay->transport.receive(netplay->transport.context, &frame, &buttons)) {
+        if (frame < netplay->confirmed || frame >= netplay->confirmed + NETPLAY_HISTORY * 2 - 1) continue;
+        uint32_t slot = frame % (NETPLAY_HISTORY * 2);
+        netplay->remote[slot] = buttons;
+        netplay->remote_frame[slot] = frame;
+        netplay->remote_known[slot] = true;
+        if (frame < rollback && netplay->used_remote[frame % NETPLAY_HISTORY] != buttons)
+            rollback = frame;
+    }
+    while (netplay_remote_known(netplay, netplay->confirmed))
+        netplay->confirmed++;
+    if (rollback == netplay->frame) return;
+
+    NES nes = netplay->nes;
+    nes_restore(nes, netplay->states[rollback % NETPLAY_HISTORY]);
+    for (uint32_t f = rollback; f < netplay->frame; f++) {
+        uint32_t slot = f % NETPLAY_HISTORY;
+        if (f != rollback) nes_snapshot(nes, netplay->states[slot]);
+        netplay->used_remote[slot] = netplay_remote(netplay, f);
+        nes_run_frame(nes, netplay_input(netplay, netplay->local[slot], netplay->used_remote[slot]), NULL);
+    }
+    netplay->rollbacks++;
+    netplay->resimulated += netplay->frame - rollback;
+}
+
+bool netplay_advance(Netplay *netplay, uint8_t buttons, NesFrame *out, NesFrameResult *result) {
+    netplay_poll(netplay);
+    if (netplay->frame >= netplay->confirmed + NETPLAY_HISTORY - 1) return false;
+
+    uint32_t slot = netplay->frame % NETPLAY_HISTORY;
+    nes_snapshot(netplay->nes, netplay->states[slot]);
+    netplay->local[slot] = buttons;
+    netplay->used_remote[slot] = netplay_remote(netplay, netplay->frame);
+    netplay->transport.send(netplay->transport.context, netplay->frame, buttons);
+
+    NesFrameResult frame = nes_run_frame(netplay->nes, netplay_input(netplay, buttons, netplay->used_remote[slot]), out);
+    if (result) *result = frame;
+    netplay->frame++;
+    return true;
+}
+
+
+
+// Loopback transport
+
+static void netplay_loopback_send(void *context, uint32_t frame, uint8_t buttons) {
+    NetplayQueue *queue = ((NetplayEndpoint*) context)->out;
+    if (queue->tail - queue->head == NETPLAY_QUEUE) return;
+    queue->frames[queue->tail % NETPLAY_QUEUE] = frame;
+    queue->buttons[queue->tail % NETPLAY_QUEUE] = buttons;
+    queue->tail++;
+}
+
+static bool netplay_loopback_receive(void *context, uint32_t *frame, uint8_t *buttons) {
+    NetplayQueue *queue = ((NetplayEndpoint*) context)->in;
+    if (queue->head == queue->tail) return false;
+    *frame = queue->frames[queue->head % NETPLAY_QUEUE];
+    *buttons = queue->buttons[queue->head % NETPLAY_QUEUE];
+    queue->head++;
+    return true;
+}
+
+NetplayLoopback* netplay_loopback_init() {
+    NetplayLoopback *loopback = (NetplayLoopback*) calloc(1, sizeof(NetplayLoopback));
+    if (!loopback) return NULL;
+    loopback->endpoints[0].in = &loopback->queues[0];
+    loopback->endpoints[0].out = &loopback->queues[1];
+    loopback->endpoints[1].in = &loopback->queues[1];
+    loopback->endpoints[1].out = &loopback->queues[0];
+    return loopback;
+}
+
+void netplay_loopback_destroy(NetplayLoopback *loopback) {
+    free(loopback);
+}
+
+NetplayTransport netplay_loopback_transport(NetplayLoopback *loopback, uint8_t side) {
+    NetplayTransport transport = {&loopback->endpoints[side & 1], netplay_loopback_send, netplay_loopback_receive};
+    return transport;
+}
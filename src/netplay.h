@@ -0,0 +1,31 @@
+#ifndef MACNES_NETPLAY_H
+#define MACNES_NETPLAY_H
+
+#include "defs.h"
+
+// Two-player rollback session. The remote player's input is predicted as
+// their last confirmed input; when a real input arrives that differs from
+// what a frame was simulated with, the machine is restored to that frame's
+// state and re-simulated up to the present without video or audio output.
+// States for the last NETPLAY_HISTORY frames are kept in preallocated
+// buffers, and a session stalls rather than predict further ahead.
+
+Netplay* netplay_init(NES nes, uint8_t local_port, NetplayTransport transport);
+
+void netplay_destroy(Netplay *netplay);
+
+// Receives pending remote inputs and rolls back if a prediction was wrong.
+void netplay_poll(Netplay *netplay);
+
+// Polls, then runs the next frame with `buttons` as the local input. Returns
+// false without running a frame while waiting on the remote player.
+bool netplay_advance(Netplay *netplay, uint8_t buttons, NesFrame *out, NesFrameResult *result);
+
+// In-process transport pair: whatever one side sends, the other receives.
+NetplayLoopback* netplay_loopback_init();
+
+void netplay_loopback_destroy(NetplayLoopback *loopback);
+
+NetplayTransport netplay_loopback_transport(NetplayLoopback *loopback, uint8_t side);
+
+#endif
@@ -1,18 +1,138 @@
 #include <stdlib.h>
+#include <string.h>
 #include "ram.h"
 
+static void ram_map_private(RAM *ram, uint16_t page) {
+    ram->read_page[page] = ram->data + page * RAM_PAGE_SIZE;
+    ram->write_page[page] = ram->read_page[page];
+}
+
+static bool ram_page_private(RAM *ram, uint16_t page) {
+    return ram->data && ram->read_page[page] == ram->data + page * RAM_PAGE_SIZE;
+}
+
+static void ram_release_image(RAM *ram) {
+    if (!ram->image) return;
+    if (__atomic_sub_fetch(&ram->image->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(ram->image->data);
+        free(ram->image);
+    }
+    ram->image = NULL;
+}
+
 RAM* ram_init() {
-    return calloc(1, sizeof(RAM));
+    RAM *ram = (RAM*) calloc(1, sizeof(RAM));
+    if (!ram) return NULL;
+    ram->data = (uint8_t*) calloc(1, RAM_SIZE);
+    if (!ram->data) {
+        free(ram);
+        return NULL;
+    }
+    for (uint16_t page = 0; page < RAM_PAGE_COUNT; page++)
+        ram_map_private(ram, page);
+    return ram;
 }
 
 void ram_destroy(RAM *ram) {
+    if (!ram) return;
+    ram_release_image(ram);
+    free(ram->data);
     free(ram);
 }
 
+// First write to a page that is still shared with the image or has been
+// write-protected for dirty tracking. NULL when the private copy cannot be
+// allocated; the page then stays shared.
+static uint8_t* ram_fault(RAM *ram, uint16_t page) {
+    if (!ram_page_private(ram, page)) {
+        if (!ram->data) ram->data = (uint8_t*) malloc(RAM_SIZE);
+        if (!ram->data) return NULL;
+        uint8_t *shared = ram->read_page[page];
+        memcpy(ram->data + page * RAM_PAGE_SIZE, shared, RAM_PAGE_SIZE);
+    }
+    if (ram->track_dirty) ram->dirty[page >> 6] |= (uint64_t) 1 << (page & 63);
+    ram_map_private(ram, page);
+    return ram->write_page[page];
+}
+
 void ram_write(RAM *ram, uint16_t address, uint8_t data) {
-    ram->data[address] = data;
+    uint8_t *page = ram->write_page[address >> 8];
+    if (!page) page = ram_fault(ram, address >> 8);
+    if (page) page[address & 0xFF] = data;
 }
 
 uint8_t ram_read(RAM *ram, uint16_t address) {
-    return ram->data[address];
-}
\ No newline at end of file
+    return ram->read_page[address >> 8][address & 0xFF];
+}
+
+RAM* ram_fork(RAM *parent) {
+    RAM *child = (RAM*) calloc(1, sizeof(RAM));
+    if (!child) return NULL;
+
+    // The first fork hands the parent's storage over to a shared image and
+    // leaves the parent with every page read-only.
+    if (!parent->image) {
+        RamImage *image = (RamImage*) malloc(sizeof(RamImage));
+        if (!image) {
+            free(child);
+            return NULL;
+        }
+        image->refs = 1;
+        image->data = parent->data;
+        parent->data = NULL;
+        parent->image = image;
+        memset(parent->write_page, 0, sizeof(parent->write_page));
+    }
+
+    // Pages the parent has privately written since are copied, everything
+    // else is shared.
+    __atomic_add_fetch(&parent->image->refs, 1, __ATOMIC_RELAXED);
+    child->image = parent->image;
+    for (uint16_t page = 0; page < RAM_PAGE_COUNT; page++) {
+        child->read_page[page] = parent->read_page[page];
+        if (ram_page_private(parent, page) && !ram_fault(child, page)) {
+            ram_destroy(child);
+            return NULL;
+        }
+    }
+    return child;
+}
+
+void ram_save(RAM *ram, uint8_t *out) {
+    for (uint16_t page = 0; page < RAM_PAGE_COUNT; page++)
+        memcpy(out + page * RAM_PAGE_SIZE, ram->read_page[page], RAM_PAGE_SIZE);
+}
+
+bool ram_load(RAM *ram, const uint8_t *in) {
+    if (!ram->data) ram->data = (uint8_t*) malloc(RAM_SIZE);
+    if (!ram->data) return false;
+    memcpy(ram->data, in, RAM_SIZE);
+    for (uint16_t page = 0; page < RAM_PAGE_COUNT; page++)
+        ram_map_private(ram, page);
+    ram_release_image(ram);
+    if (ram->track_dirty) memset(ram->dirty, 0xFF, sizeof(ram->dirty));
+    return true;
+}
+
+void ram_track_dirty(RAM *ram, bool enabled) {
+    ram->track_dirty = enabled;
+    memset(ram->dirty, 0, sizeof(ram->dirty));
+    for (uint16_t page = 0; page < RAM_PAGE_COUNT; page++)
+        ram->write_page[page] = enabled || !ram_page_private(ram, page) ? NULL : ram->read_page[page];
+}
+
+bool ram_page_dirty(RAM *ram, uint16_t page) {
+    return (ram->dirty[page >> 6] >> (page & 63)) & 1;
+}
+
+void ram_dirty_clear(RAM *ram) {
+    for (uint16_t word = 0; word < RAM_DIRTY_WORDS; word++) {
+        uint64_t bits = ram->dirty[word];
+        while (bits) {
+            uint16_t page = (uint16_t) (word * 64 + __builtin_ctzll(bits));
+            ram->write_page[page] = NULL;
+            bits &= bits - 1;
+        }
+        ram->dirty[word] = 0;
+    }
+}
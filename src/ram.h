@@ -12,4 +12,26 @@ void ram_write(RAM *ram, uint16_t address, uint8_t data);
 
 uint8_t ram_read(RAM *ram, uint16_t address);
 
+// Copy-on-write fork. The child shares the parent's pages through a
+// refcounted image and copies a page the first time either side writes it.
+// NULL when the child's copies cannot be allocated. A later write whose copy
+// cannot be allocated is dropped and the page stays shared.
+RAM* ram_fork(RAM *parent);
+
+void ram_save(RAM *ram, uint8_t *out);
+
+// False, leaving the RAM as it was, when a machine that gave its storage to
+// a fork cannot allocate it again.
+bool ram_load(RAM *ram, const uint8_t *in);
+
+// Per-page dirty bitmap (ram->dirty, one bit per RAM_PAGE_SIZE bytes). Pages
+// are write-protected when tracking starts and on every clear, so only the
+// first write to a page takes the fault path; with tracking off the write
+// path is untouched.
+void ram_track_dirty(RAM *ram, bool enabled);
+
+bool ram_page_dirty(RAM *ram, uint16_t page);
+
+void ram_dirty_clear(RAM *ram);
+
 #endif
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include "ramwatch.h"
+
+RamWatch* ramwatch_init() {
+    RamWatch *watch = (RamWatch*) calloc(1, sizeof(RamWatch));
+    if (watch) watch->raw = true;
+    return watch;
+}
+
+void ramwatch_destroy(RamWatch *watch) {
+    if (!watch) return;
+    free(watch->addresses);
+    free(watch->features);
+    free(watch);
+}
+
+static bool ramwatch_reserve(void **items, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) return true;
+    size_t grown = *capacity ? *capacity * 2 : 16;
+    while (grown < needed) grown *= 2;
+    void *resized = realloc(*items, grown * size);
+    if (!resized) return false;
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+static bool ramwatch_push(RamWatch *watch, uint16_t address, uint8_t width, enum RamWatchDecode decode) {
+    if (!ramwatch_reserve((void**) &watch->addresses, &watch->address_capacity,
+                          watch->address_count + width, sizeof(uint16_t)))
+        return false;
+    if (!ramwatch_reserve((void**) &watch->features, &watch->feature_capacity,
+                          watch->feature_count + 1, sizeof(RamWatchFeature)))
+        return false;
+
+    RamWatchFeature *feature = &watch->features[watch->feature_count++];
+    feature->decode = decode;
+    feature->width = width;
+    feature->first = (uint32_t) watch->address_count;
+    for (uint8_t i = 0; i < width; i++)
+        watch->addresses[watch->address_count++] = (uint16_t) (address + i);
+    if (decode != RAMWATCH_U8) watch->raw = false;
+    return true;
+}
+
+bool ramwatch_add(RamWatch *watch, uint16_t address, uint16_t length, enum RamWatchDecode decode) {
+    switch (decode) {
+        case RAMWATCH_U8:
+        case RAMWATCH_U16LE: {
+            uint8_t width = decode == RAMWATCH_U8 ? 1 : 2;
+            for (uint16_t i = 0; i < length; i++)
+                if (!ramwatch_push(watch, (uint16_t) (address + i * width), width, decode))
+                    return false;
+            return true;
+        }
+        case RAMWATCH_BCD:
+        case RAMWATCH_DIGITS:
+            if (length == 0 || length > (decode == RAMWATCH_BCD ? 4 : 9)) return false;
+            return ramwatch_push(watch, address, (uint8_t) length, decode);
+        default:
+            return false;
+    }
+}
+
+static int32_t ramwatch_decode(const RamWatchFeature *feature, const uint8_t *bytes) {
+    int32_t value = 0;
+    switch (feature->decode) {
+        case RAMWATCH_U16LE:
+            return bytes[0] | (bytes[1] << 8);
+        case RAMWATCH_BCD:
+            for (uint8_t i = 0; i < feature->width; i++)
+                value = value * 100 + (bytes[i] >> 4) * 10 + (bytes[i] & 0x0F);
+            return value;
+        case RAMWATCH_DIGITS:
+            for (uint8_t i = 0; i < feature->width; i++)
+                value = value * 10 + bytes[i];
+            return value;
+        default:
+            return bytes[0];
+    }
+}
+
+void ramwatch_gather(const RamWatch *watch, const NES *machines, size_t count, int32_t *features) {
+    const uint16_t *addresses = watch->addresses;
+    size_t address_count = watch->address_count;
+    size_t feature_count = watch->feature_count;
+
+    if (watch->raw) {
+        for (size_t m = 0; m < count; m++) {
+            uint8_t *const *pages = machines[m].ram->read_page;
+            int32_t *out = features + m * feature_count;
+            for (size_t i = 0; i < address_count; i++)
+                out[i] = pages[addresses[i] >> 8][addresses[i] & 0xFF];
+        }
+        return;
+    }
+
+    uint8_t bytes[16];
+    for (size_t m = 0; m < count; m++) {
+        uint8_t *const *pages = machines[m].ram->read_page;
+        int32_t *out = features + m * feature_count;
+        for (size_t f = 0; f < feature_count; f++) {
+            const RamWatchFeature *feature = &watch->features[f];
+            const uint16_t *at = addresses + feature->first;
+            for (uint8_t i = 0; i < feature->width; i++)
+                bytes[i] = pages[at[i] >> 8][at[i] & 0xFF];
+            out[f] = ramwatch_decode(feature, bytes);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef MACNES_RAMWATCH_H
+#define MACNES_RAMWATCH_H
+
+#include "defs.h"
+
+// Watch list of RAM locations decoded into int32 features.
+//
+//   RAMWATCH_U8      `length` features, one per byte
+//   RAMWATCH_U16LE   `length` features, one per little-endian word
+//   RAMWATCH_BCD     one feature from `length` packed BCD bytes, MSB first
+//   RAMWATCH_DIGITS  one feature from `length` bytes holding 0-9, MSB first
+//
+// Rules are resolved into a flat address list when added, so gathering is a
+// single indexed pass over each machine's RAM.
+
+RamWatch* ramwatch_init();
+
+void ramwatch_destroy(RamWatch *watch);
+
+bool ramwatch_add(RamWatch *watch, uint16_t address, uint16_t length, enum RamWatchDecode decode);
+
+// Writes features[count][watch->feature_count] for a batch of machines.
+void ramwatch_gather(const RamWatch *watch, const NES *machines, size_t count, int32_t *features);
+
+#endif
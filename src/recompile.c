@@ -0,0 +1,300 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "recompile.h"
+#include "aot.h"
+#include "bus.h"
+#include "cpu.h"
+
+#define RECOMPILE_INSTRUCTION   0x01
+#define RECOMPILE_LEADER        0x02
+#define RECOMPILE_BLOCK_MAX     256
+#define RECOMPILE_WINDOW_SIZE   0x2000
+#define RECOMPILE_INCLUDE_MAX   4096
+
+typedef struct {
+    uint16_t        address;
+    uint8_t         opcode;
+    uint8_t         lo;
+    uint8_t         hi;
+    uint8_t         length;
+    CpuInstruction  instruction;
+} RecompileInstruction;
+
+
+
+
+// Decoding
+
+static bool recompile_is_branch(CpuOperation op) {
+    return op == i_BCC || op == i_BCS || op == i_BEQ || op == i_BMI
+        || op == i_BNE || op == i_BPL || op == i_BVC || op == i_BVS;
+}
+
+// Instructions after which the next pc is not simply the next instruction.
+static bool recompile_ends_block(CpuOperation op) {
+    return recompile_is_branch(op) || op == i_JMP || op == i_JSR
+        || op == i_RTS || op == i_RTI || op == i_BRK;
+}
+
+// Read-modify-write and store instructions, other than on the accumulator.
+static bool recompile_writes(const CpuInstruction *instruction) {
+    CpuOperation op = instruction->op;
+    if (op == i_STA || op == i_STX || op == i_STY || op == i_INC || op == i_DEC) return true;
+    return (op == i_ASL || op == i_LSR || op == i_ROL || op == i_ROR) && instruction->am != am_IMP;
+}
+
+static uint8_t recompile_length(CpuAddressMode am) {
+    if (am == am_IMP) return 1;
+    if (am == am_ABS || am == am_ABX || am == am_ABY || am == am_IND) return 3;
+    return 2;
+}
+
+// Decodes the instruction at `address` if all of it lies in one mapped
+// window of PRG ROM and the interpreter would not treat it as illegal.
+static bool recompile_decode(const Bus *bus, uint32_t address, RecompileInstruction *out) {
+    if (address < 0x8000 || address > 0xFFFF || !bus->read_map[address >> 8]) return false;
+    uint8_t opcode = bus->read_map[address >> 8][address & 0xFF];
+    CpuInstruction instruction = cpu_instruction(opcode);
+    if (instruction.op == i_XXX) return false;
+    uint8_t length = recompile_length(instruction.am);
+    uint32_t last = address + length - 1;
+    if (last > 0xFFFF || last / RECOMPILE_WINDOW_SIZE != address / RECOMPILE_WINDOW_SIZE) return false;
+    if (!bus->read_map[last >> 8]) return false;
+
+    out->address = (uint16_t) address;
+    out->opcode = opcode;
+    out->length = length;
+    out->instruction = instruction;
+    out->lo = length > 1 ? bus->read_map[(address + 1) >> 8][(address + 1) & 0xFF] : 0;
+    out->hi = length > 2 ? bus->read_map[(address + 2) >> 8][(address + 2) & 0xFF] : 0;
+    return true;
+}
+
+static uint16_t recompile_operand(const RecompileInstruction *instruction) {
+    return (uint16_t) ((instruction->hi << 8) | instruction->lo);
+}
+
+static uint16_t recompile_branch_target(const RecompileInstruction *instruction) {
+    return (uint16_t) (instruction->address + 2 + (int8_t) instruction->lo);
+}
+
+static void recompile_mark(uint8_t *flags, uint32_t *work, uint32_t *count, uint32_t address) {
+    if (address > 0xFFFF || (flags[address] & RECOMPILE_LEADER)) return;
+    flags[address] |= RECOMPILE_LEADER;
+    work[(*count)++] = address;
+}
+
+// Marks every decodable instruction reachable from the vectors, and the
+// addresses blocks must start at.
+static void recompile_discover(const Bus *bus, uint8_t *flags) {
+    uint32_t *work = (uint32_t*) malloc(0x10000 * sizeof(uint32_t));
+    if (!work) return;
+    uint32_t count = 0;
+    const uint16_t vectors[] = {0xFFFA, 0xFFFC, 0xFFFE};
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        const uint8_t *page = bus->read_map[vectors[i] >> 8];
+        if (!page) continue;
+        uint16_t offset = vectors[i] & 0xFF;
+        recompile_mark(flags, work, &count, page[offset] | (page[offset + 1] << 8));
+    }
+
+    while (count) {
+        uint32_t address = work[--count];
+        RecompileInstruction instruction;
+        while (!(flags[address] & RECOMPILE_INSTRUCTION) && recompile_decode(bus, address, &instruction)) {
+            flags[address] |= RECOMPILE_INSTRUCTION;
+            CpuOperation op = instruction.instruction.op;
+            uint32_t next = address + instruction.length;
+            if (recompile_is_branch(op)) {
+                recompile_mark(flags, work, &count, recompile_branch_target(&instruction));
+                recompile_mark(flags, work, &count, next);
+            } else if (op == i_JSR) {
+                recompile_mark(flags, work, &count, recompile_operand(&instruction));
+                recompile_mark(flags, work, &count, next);
+            } else if (op == i_JMP && instruction.instruction.am == am_ABS) {
+                recompile_mark(flags, work, &count, recompile_operand(&instruction));
+            } else if (recompile_writes(&instruction.instruction) && instruction.instruction.am == am_ABS
+                       && recompile_operand(&instruction) >= 0x8000) {
+                // Bank switches end the block; the code after them starts one.
+                recompile_mark(flags, work, &count, next);
+            }
+            if (recompile_ends_block(op) || next > 0xFFFF) break;
+            address = next;
+        }
+    }
+    free(work);
+}
+
+
+
+// Code generation
+
+// Mirrors cpu_execute for one instruction, with the operand fetch done at
+// compile time where the addressing mode allows. Returns true if the block
+// has to end after it.
+static bool recompile_instruction(FILE *out, const RecompileInstruction *instruction) {
+    const CpuInstruction *decoded = &instruction->instruction;
+    CpuAddressMode am = decoded->am;
+    uint16_t operand = recompile_operand(instruction);
+    uint16_t next = (uint16_t) (instruction->address + instruction->length);
+
+    fprintf(out, "    // $%04X %s %s\n", instruction->address,
+            cpu_function_name(decoded->op) + 2, cpu_function_name(am) + 3);
+    fprintf(out, "    cpu->opcode = 0x%02X;\n", instruction->opcode);
+    fprintf(out, "    cpu->status |= U;\n");
+    // Pointers live in RAM, so indirect operands are fetched at run time by
+    // the interpreter's own addressing mode, reading the operand from ROM.
+    bool indirect = am == am_IND || am == am_IZX || am == am_IZY;
+    fprintf(out, "    cpu->pc = 0x%04X;\n", indirect ? (uint16_t) (instruction->address + 1) : next);
+    fprintf(out, "    cpu->is_am_imm = false;\n");
+    fprintf(out, "    cpu->cycles = %u;\n", decoded->cycles);
+
+    const char *extra = NULL;
+    if (am == am_IMP)
+        fprintf(out, "    cpu->is_am_imm = true;\n");
+    else if (am == am_IMM)
+        fprintf(out, "    cpu->addr_abs = 0x%04X;\n", (uint16_t) (instruction->address + 1));
+    else if (am == am_ZP0)
+        fprintf(out, "    cpu->addr_abs = 0x%04X;\n", instruction->lo);
+    else if (am == am_ZPX || am == am_ZPY)
+        fprintf(out, "    cpu->addr_abs = (cpu->%c + 0x%02X) & 0x00FF;\n",
+                am == am_ZPX ? 'x' : 'y', instruction->lo);
+    else if (am == am_REL)
+        fprintf(out, "    cpu->addr_rel = 0x%04X;\n", (uint16_t) (int8_t) instruction->lo);
+    else if (am == am_ABS)
+        fprintf(out, "    cpu->addr_abs = 0x%04X;\n", operand);
+    else if (am == am_ABX || am == am_ABY) {
+        fprintf(out, "    cpu->addr_abs = 0x%04X + cpu->%c;\n", operand, am == am_ABX ? 'x' : 'y');
+        extra = "(cpu->addr_abs & 0xFF00) != 0x%02X00";
+    } else {
+        extra = "";
+    }
+
+    const char *op = cpu_function_name(decoded->op);
+    if (!extra) {
+        fprintf(out, "    %s(cpu);\n", op);
+    } else if (*extra) {
+        fprintf(out, "    extra = ");
+        fprintf(out, extra, instruction->hi);
+        fprintf(out, ";\n    cpu->cycles += extra & %s(cpu);\n", op);
+    } else {
+        fprintf(out, "    extra = %s(cpu);\n", cpu_function_name(am));
+        fprintf(out, "    cpu->cycles += extra & %s(cpu);\n", op);
+    }
+    fprintf(out, "    cpu->status |= U;\n");
+    fprintf(out, "    cpu->clock_count += cpu->cycles;\n");
+    fprintf(out, "    cpu->cycles = 0;\n");
+
+    if (recompile_ends_block(decoded->op)) return true;
+    if (!recompile_writes(decoded)) {
+        fprintf(out, "    if (cpu->clock_count >= until) return;\n");
+        return false;
+    }
+    // A write to cartridge space goes to the mapper and may switch banks.
+    if (am == am_ABS) return operand >= 0x8000;
+    if (am == am_ZP0 || am == am_ZPX || am == am_ZPY) {
+        fprintf(out, "    if (cpu->clock_count >= until) return;\n");
+        return false;
+    }
+    fprintf(out, "    if (cpu->clock_count >= until || cpu->addr_abs >= 0x8000) return;\n");
+    return false;
+}
+
+static bool recompile_needs_extra(const RecompileInstruction *instruction) {
+    CpuAddressMode am = instruction->instruction.am;
+    return am == am_ABX || am == am_ABY || am == am_IND || am == am_IZX || am == am_IZY;
+}
+
+// Emits the block starting at `start`. It runs until an instruction that
+// ends a block, the next leader, the end of its 8KB window, or code that
+// was not decoded, leaving pc at the next instruction either way.
+static uint32_t recompile_block(FILE *out, const Bus *bus, const uint8_t *flags, uint32_t start) {
+    RecompileInstruction instructions[RECOMPILE_BLOCK_MAX];
+    uint32_t count = 0;
+    uint32_t address = start;
+    while (count < RECOMPILE_BLOCK_MAX && recompile_decode(bus, address, &instructions[count])) {
+        const RecompileInstruction *instruction = &instructions[count++];
+        address += instruction->length;
+        if (recompile_ends_block(instruction->instruction.op)) break;
+        if (address > 0xFFFF || address / RECOMPILE_WINDOW_SIZE != start / RECOMPILE_WINDOW_SIZE) break;
+        if (!(flags[address] & RECOMPILE_INSTRUCTION) || (flags[address] & RECOMPILE_LEADER)) break;
+    }
+
+    bool extra = false;
+    for (uint32_t i = 0; i < count; i++) extra |= recompile_needs_extra(&instructions[i]);
+    fprintf(out, "static void block_%04X(CPU *cpu, uint64_t until) {\n", start);
+    if (extra) fprintf(out, "    uint8_t extra;\n");
+    uint32_t emitted = 0;
+    while (emitted < count) {
+        if (emitted) fprintf(out, "\n");
+        if (recompile_instruction(out, &instructions[emitted++])) break;
+    }
+    fprintf(out, "}\n\n");
+    return emitted;
+}
+
+bool recompile_cartridge(Cartridge *cartridge, FILE *out, RecompileStats *stats) {
+    Bus *bus = bus_init();
+    uint8_t *flags = (uint8_t*) calloc(0x10000, 1);
+    if (!bus || !flags || !bus_insert_cartridge(bus, cartridge, 0)) {
+        free(flags);
+        bus_destroy(bus);
+        return false;
+    }
+    recompile_discover(bus, flags);
+
+    RecompileStats totals = {0, 0, 0};
+    fprintf(out, "// Generated by macnes-recompile. Do not edit.\n\n");
+    fprintf(out, "#include \"defs.h\"\n#include \"cpu.h\"\n#include \"bus.h\"\n\n");
+    for (uint32_t address = 0x8000; address <= 0xFFFF; address++) {
+        if (flags[address] & RECOMPILE_INSTRUCTION) totals.bytes += recompile_length(
+                cpu_instruction(bus->read_map[address >> 8][address & 0xFF]).am);
+        if ((flags[address] & (RECOMPILE_INSTRUCTION | RECOMPILE_LEADER))
+                != (RECOMPILE_INSTRUCTION | RECOMPILE_LEADER)) continue;
+        totals.instructions += recompile_block(out, bus, flags, address);
+        totals.blocks++;
+    }
+
+    fprintf(out, "const AotBlock macnes_aot_blocks[] = {\n");
+    for (uint32_t address = 0x8000; address <= 0xFFFF; address++) {
+        if ((flags[address] & (RECOMPILE_INSTRUCTION | RECOMPILE_LEADER))
+                != (RECOMPILE_INSTRUCTION | RECOMPILE_LEADER)) continue;
+        uint32_t offset = (uint32_t) (bus->read_map[address >> 8] + (address & 0xFF) - cartridge->prg);
+        fprintf(out, "    {0x%04X, 0x%05X, block_%04X},\n", address, offset, address);
+    }
+    if (!totals.blocks) fprintf(out, "    {0, 0, NULL},\n");
+    fprintf(out, "};\n\n");
+    fprintf(out, "const uint32_t macnes_aot_count = %u;\n", totals.blocks);
+    fprintf(out, "const uint64_t macnes_aot_prg_hash = 0x%016llXULL;\n",
+            (unsigned long long) aot_prg_hash(cartridge->prg, cartridge->prg_size));
+    fprintf(out, "const uint64_t macnes_aot_prg_size = %llu;\n", (unsigned long long) cartridge->prg_size);
+
+    free(flags);
+    bus_destroy(bus);
+    if (stats) *stats = totals;
+    return totals.blocks > 0 && !ferror(out);
+}
+
+bool recompile_build(const char *source, const char *object, const char *include_dir) {
+    const char *compiler = getenv("CC");
+    if (!compiler || !*compiler) compiler = "cc";
+    char include[RECOMPILE_INCLUDE_MAX];
+    int length = snprintf(include, sizeof(include), "-I%s", include_dir);
+    if (length < 0 || (size_t) length >= sizeof(include)) return false;
+
+    // No shell, so paths reach the compiler exactly as given.
+    char *argv[] = {(char*) compiler, "-std=c99", "-O2", "-fPIC", "-shared", include,
+                    "-o", (char*) object, (char*) source, NULL};
+    extern char **environ;
+    pid_t pid;
+    if (posix_spawnp(&pid, compiler, NULL, NULL, argv, environ) != 0) return false;
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
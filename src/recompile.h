@@ -0,0 +1,28 @@
+#ifndef MACNES_RECOMPILE_H
+#define MACNES_RECOMPILE_H
+
+#include <stdio.h>
+#include "defs.h"
+
+// Static recompiler from 6502 to C. Code is discovered from the reset, NMI
+// and IRQ vectors by following fall-through, branch, JMP and JSR targets
+// through the PRG banks mapped at power-on, and every basic block becomes
+// one C function over the interpreter's CPU struct, its addressing mode
+// and operation functions, and the bus. Opcode dispatch is gone and
+// operands known at compile time are folded into the code; indirect jumps,
+// illegal opcodes, RAM and other banks are left to the interpreter.
+//
+// Blocks keep the interpreter's per-instruction semantics exactly: they
+// return once the clock reaches `until` and after any write to cartridge
+// space, since it may switch banks under them.
+
+// Writes C source for a cartridge to `out`. `stats` may be NULL. Returns
+// false if the mapper is not supported or nothing could be compiled.
+bool recompile_cartridge(Cartridge *cartridge, FILE *out, RecompileStats *stats);
+
+// Compiles generated source into a shared object for aot_load with $CC, or
+// cc if unset. The compiler is run directly, not through a shell, so $CC
+// names a single program. `include_dir` is the directory holding defs.h.
+bool recompile_build(const char *source, const char *object, const char *include_dir);
+
+#endif
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+#include "recompile.h"
+#include "cartridge.h"
+
+#ifndef MACNES_INCLUDE_DIR
+#define MACNES_INCLUDE_DIR "."
+#endif
+
+static void usage() {
+    fprintf(stderr, "usage: macnes-recompile [-I include_dir] rom output.c [output.so]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *include_dir = MACNES_INCLUDE_DIR;
+    const char *paths[3] = {NULL, NULL, NULL};
+    int count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) include_dir = argv[++i];
+        else if (argv[i][0] != '-' && count < 3) paths[count++] = argv[i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (count < 2) {
+        usage();
+        return 2;
+    }
+
+    enum CartridgeError error;
+    Cartridge *cartridge = cartridge_open(paths[0], &error);
+    if (!cartridge) {
+        fprintf(stderr, "%s: cannot load cartridge (error %d)\n", paths[0], (int) error);
+        return 1;
+    }
+    FILE *out = fopen(paths[1], "w");
+    if (!out) {
+        fprintf(stderr, "%s: cannot write\n", paths[1]);
+        cartridge_release(cartridge);
+        return 1;
+    }
+    RecompileStats stats;
+    bool ok = recompile_cartridge(cartridge, out, &stats);
+    ok = fclose(out) == 0 && ok;
+    cartridge_release(cartridge);
+    if (!ok) {
+        fprintf(stderr, "%s: nothing to recompile\n", paths[0]);
+        return 1;
+    }
+    printf("%u blocks, %u instructions, %u bytes of code\n",
+           stats.blocks, stats.instructions, stats.bytes);
+
+    if (paths[2] && !recompile_build(paths[1], paths[2], include_dir)) {
+        fprintf(stderr, "%s: compiler failed\n", paths[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "regress.h"
+#include "nes.h"
+#include "movie.h"
+#include "fingerprint.h"
+#include "cartridge.h"
+#include "romcache.h"
+
+#define REGRESS_PATH_MAX 4096
+
+static char* regress_strdup(const char *text) {
+    size_t size = strlen(text) + 1;
+    char *copy = (char*) malloc(size);
+    if (copy) memcpy(copy, text, size);
+    return copy;
+}
+
+Regress* regress_init() {
+    return (Regress*) calloc(1, sizeof(Regress));
+}
+
+void regress_destroy(Regress *regress) {
+    if (!regress) return;
+    for (size_t i = 0; i < regress->count; i++) {
+        free(regress->entries[i].rom);
+        free(regress->entries[i].movie);
+        free(regress->entries[i].hashes);
+    }
+    free(regress->entries);
+    free(regress->results);
+    free(regress);
+}
+
+bool regress_add(Regress *regress, const char *rom, const char *movie, uint32_t frames, const char *hashes) {
+    if (regress->count == regress->capacity) {
+        size_t grown = regress->capacity ? regress->capacity * 2 : 16;
+        RegressEntry *entries = (RegressEntry*) realloc(regress->entries, grown * sizeof(RegressEntry));
+        if (!entries) return false;
+        regress->entries = entries;
+        RegressResult *results = (RegressResult*) realloc(regress->results, grown * sizeof(RegressResult));
+        if (!results) return false;
+        regress->results = results;
+        regress->capacity = grown;
+    }
+    RegressEntry entry = {regress_strdup(rom), movie ? regress_strdup(movie) : NULL, regress_strdup(hashes), frames};
+    if (!entry.rom || !entry.hashes || (movie && !entry.movie)) {
+        free(entry.rom);
+        free(entry.movie);
+        free(entry.hashes);
+        return false;
+    }
+    regress->entries[regress->count] = entry;
+    memset(&regress->results[regress->count], 0, sizeof(RegressResult));
+    regress->count++;
+    return true;
+}
+
+// Joins `path` onto the directory part of `manifest` unless it is absolute.
+// Returns false if the result does not fit in REGRESS_PATH_MAX.
+static bool regress_resolve(char *out, const char *manifest, const char *path) {
+    const char *slash = strrchr(manifest, '/');
+    int length;
+    if (path[0] == '/' || !slash) length = snprintf(out, REGRESS_PATH_MAX, "%s", path);
+    else length = snprintf(out, REGRESS_PATH_MAX, "%.*s/%s", (int) (slash - manifest), manifest, path);
+    return length >= 0 && length < REGRESS_PATH_MAX;
+}
+
+bool regress_load(Regress *regress, const char *manifest, size_t *line) {
+    if (line) *line = 0;
+    FILE *file = fopen(manifest, "r");
+    if (!file) return false;
+
+    char text[3 * REGRESS_PATH_MAX];
+    char rom[REGRESS_PATH_MAX], movie[REGRESS_PATH_MAX], hashes[REGRESS_PATH_MAX];
+    char rom_path[REGRESS_PATH_MAX], movie_path[REGRESS_PATH_MAX], hashes_path[REGRESS_PATH_MAX];
+    unsigned long frames;
+    size_t number = 0;
+    bool ok = true;
+    while (ok && fgets(text, sizeof(text), file)) {
+        number++;
+        const char *start = text + strspn(text, " \t\r\n");
+        if (*start == '\0' || *start == '#') continue;
+
+        char extra;
+        if (sscanf(start, "%4095s %4095s %lu %4095s %c", rom, movie, &frames, hashes, &extra) != 4
+            || frames > UINT32_MAX
+            || !regress_resolve(rom_path, manifest, rom)
+            || !regress_resolve(movie_path, manifest, movie)
+            || !regress_resolve(hashes_path, manifest, hashes)) {
+            ok = false;
+            break;
+        }
+        ok = regress_add(regress, rom_path, strcmp(movie, "-") == 0 ? NULL : movie_path,
+                         (uint32_t) frames, hashes_path);
+    }
+    fclose(file);
+    if (!ok && line) *line = number;
+    return ok;
+}
+
+bool regress_load_rom(NES nes, RomCache *cache, const char *path) {
+    enum CartridgeError error;
+    Cartridge *cartridge = cache ? romcache_open(cache, path, &error) : cartridge_open(path, &error);
+    if (cartridge) {
+        bool inserted = nes_insert_cartridge(nes, cartridge);
+        cartridge_release(cartridge);
+        return inserted;
+    }
+    if (error != CARTRIDGE_ERROR_MAGIC) return false;
+
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    uint8_t image[0x8000];
+    size_t size = fread(image, 1, sizeof(image), file);
+    bool ok = size >= 6 && fgetc(file) == EOF;
+    fclose(file);
+    if (!ok) return false;
+
+    uint16_t base = (uint16_t) (0x10000 - size);
+    for (size_t i = 0; i < size; i++)
+        ram_write(nes.ram, (uint16_t) (base + i), image[i]);
+    nes_reset(nes);
+    return true;
+}
+
+static void regress_format_hash(char *out, StateHash hash) {
+    snprintf(out, 34, "%016llx%016llx\n", (unsigned long long) hash.hi, (unsigned long long) hash.lo);
+}
+
+static StateHash* regress_read_hashes(const char *path, uint32_t frames) {
+    FILE *file = fopen(path, "r");
+    if (!file) return NULL;
+    StateHash *hashes = (StateHash*) malloc((frames ? frames : 1) * sizeof(StateHash));
+    char text[64];
+    uint32_t count = 0;
+    while (hashes && count < frames && fgets(text, sizeof(text), file)) {
+        unsigned long long hi, lo;
+        if (strlen(text) < 32 || sscanf(text, "%16llx%16llx", &hi, &lo) != 2) break;
+        hashes[count].hi = hi;
+        hashes[count].lo = lo;
+        count++;
+    }
+    fclose(file);
+    if (count != frames) {
+        free(hashes);
+        return NULL;
+    }
+    return hashes;
+}
+
+static double regress_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+void regress_run_entry(const RegressEntry *entry, RomCache *cache, RegressResult *result, bool record) {
+    memset(result, 0, sizeof(RegressResult));
+    double start = regress_now();
+
+    NES nes = nes_init();
+    Movie *movie = NULL;
+    StateHash *expected = NULL;
+    FILE *output = NULL;
+    Fingerprint *fingerprint = NULL;
+
+    if (!regress_load_rom(nes, cache, entry->rom)) {
+        result->status = REGRESS_ERROR_ROM;
+    } else if (entry->movie && !(movie = movie_load(entry->movie))) {
+        result->status = REGRESS_ERROR_MOVIE;
+    } else if (record ? !(output = fopen(entry->hashes, "w"))
+                      : !(expected = regress_read_hashes(entry->hashes, entry->frames))) {
+        result->status = REGRESS_ERROR_HASHES;
+    } else if (!(fingerprint = fingerprint_init(nes))) {
+        result->status = REGRESS_ERROR_MEMORY;
+        if (output) fclose(output);
+    } else {
+        const NesInput idle = {{0, 0}};
+        char text[34];
+        for (uint32_t f = 0; f < entry->frames; f++) {
+            nes_run_frame(nes, movie && f < movie->length ? movie->inputs[f] : idle, NULL);
+            StateHash hash = fingerprint_update(fingerprint, nes);
+            if (record) {
+                regress_format_hash(text, hash);
+                fputs(text, output);
+            } else if (hash.lo != expected[f].lo || hash.hi != expected[f].hi) {
+                if (result->mismatches++ == 0) result->first_mismatch = f;
+            }
+        }
+        result->frames = entry->frames;
+        if (record) result->status = fclose(output) == 0 ? REGRESS_RECORDED : REGRESS_ERROR_HASHES;
+        else result->status = result->mismatches ? REGRESS_FAIL : REGRESS_PASS;
+    }
+
+    fingerprint_destroy(fingerprint);
+    free(expected);
+    movie_destroy(movie);
+    nes_shutdown(nes);
+    result->seconds = regress_now() - start;
+}
+
+
+
+// Parallel runs
+
+typedef struct {
+    Regress         *regress;
+    RomCache        *cache;
+    bool            record;
+    size_t          next;
+    pthread_mutex_t lock;
+} RegressQueue;
+
+static void* regress_worker(void *context) {
+    RegressQueue *queue = (RegressQueue*) context;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        size_t index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->regress->count) return NULL;
+        regress_run_entry(&queue->regress->entries[index], queue->cache, &queue->regress->results[index],
+                          queue->record);
+    }
+}
+
+unsigned regress_run(Regress *regress, unsigned threads, bool record) {
+    // Entries sharing a ROM share its mapping for the length of the run.
+    RegressQueue queue = {regress, romcache_init(NULL), record, 0, PTHREAD_MUTEX_INITIALIZER};
+    if (threads > regress->count) threads = (unsigned) regress->count;
+    if (threads == 0) threads = 1;
+
+    pthread_t *workers = (pthread_t*) calloc(threads, sizeof(pthread_t));
+    unsigned started = 0;
+    // The calling thread is always one of the workers.
+    while (workers && started + 1 < threads
+           && pthread_create(&workers[started], NULL, regress_worker, &queue) == 0)
+        started++;
+    regress_worker(&queue);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    romcache_destroy(queue.cache);
+    pthread_mutex_destroy(&queue.lock);
+    return started + 1;
+}
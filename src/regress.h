@@ -0,0 +1,38 @@
+#ifndef MACNES_REGRESS_H
+#define MACNES_REGRESS_H
+
+#include "defs.h"
+
+// Headless regression runs. A manifest has one entry per line,
+//
+//     <rom> <movie or -> <frames> <hashes>
+//
+// with blank lines and lines starting with '#' ignored and relative paths
+// taken from the manifest's directory. Each entry plays its movie (frames
+// past its end get no input) and hashes the machine after every frame; the
+// hashes file holds one 32-digit hex StateHash per line. Hashes are checked
+// as frames finish, so no frame is kept.
+
+Regress* regress_init();
+
+void regress_destroy(Regress *regress);
+
+bool regress_add(Regress *regress, const char *rom, const char *movie, uint32_t frames, const char *hashes);
+
+// Appends every entry of a manifest. Returns false on an unreadable file, a
+// malformed line or one whose resolved paths exceed the path limit, naming
+// the line in `line` if given.
+bool regress_load(Regress *regress, const char *manifest, size_t *line);
+
+// Inserts an iNES or NES 2.0 cartridge, through `cache` unless it is NULL,
+// or failing that loads a raw program image so that it ends at $FFFF,
+// vectors included, and resets the machine.
+bool regress_load_rom(NES nes, RomCache *cache, const char *path);
+
+// With `record`, the hashes files are written instead of checked.
+void regress_run_entry(const RegressEntry *entry, RomCache *cache, RegressResult *result, bool record);
+
+// Runs all entries on up to `threads` threads and returns how many it used.
+unsigned regress_run(Regress *regress, unsigned threads, bool record);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+#include "codec.h"
+#include "nes.h"
+
+Rewind* rewind_init(size_t budget, uint32_t frames, uint32_t keyframe_interval) {
+    Rewind *rewind = (Rewind*) calloc(1, sizeof(Rewind));
+    if (!rewind) return NULL;
+    rewind->budget = budget;
+    rewind->capacity = frames;
+    rewind->keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+    rewind->packed_capacity = codec_bound(sizeof(NesState));
+    rewind->buffer = (uint8_t*) malloc(budget);
+    rewind->entries = (RewindEntry*) calloc(frames, sizeof(RewindEntry));
+    rewind->keyframe = nes_state_init();
+    rewind->scratch = nes_state_init();
+    rewind->packed = (uint8_t*) malloc(rewind->packed_capacity);
+    if (!rewind->buffer || !rewind->entries || !rewind->keyframe || !rewind->scratch || !rewind->packed) {
+        rewind_destroy(rewind);
+        return NULL;
+    }
+    return rewind;
+}
+
+void rewind_destroy(Rewind *rewind) {
+    if (!rewind) return;
+    free(rewind->buffer);
+    free(rewind->entries);
+    nes_state_destroy(rewind->keyframe);
+    nes_state_destroy(rewind->scratch);
+    free(rewind->packed);
+    free(rewind);
+}
+
+static RewindEntry* rewind_entry(Rewind *rewind, uint32_t index) {
+    return &rewind->entries[(rewind->first + index) % rewind->capacity];
+}
+
+// Drops the oldest entry and any deltas that depended on it.
+static void rewind_evict(Rewind *rewind) {
+    do {
+        rewind->first = (rewind->first + 1) % rewind->capacity;
+        rewind->count--;
+    } while (rewind->count > 0 && !rewind_entry(rewind, 0)->keyframe);
+}
+
+static bool rewind_overlaps(const RewindEntry *entry, size_t offset, size_t size) {
+    return entry->offset < offset + size && offset < entry->offset + entry->size;
+}
+
+bool rewind_push(Rewind *rewind, NES nes) {
+    if (rewind->capacity == 0) return false;
+    nes_snapshot(nes, rewind->scratch);
+
+    bool keyframe = rewind->count == 0 || rewind->since_keyframe + 1 >= rewind->keyframe_interval;
+    size_t size = keyframe
+        ? codec_compress((const uint8_t*) rewind->scratch, sizeof(NesState),
+                         rewind->packed, rewind->packed_capacity)
+        : codec_compress_xor((const uint8_t*) rewind->scratch, (const uint8_t*) rewind->keyframe,
+                             sizeof(NesState), rewind->packed, rewind->packed_capacity);
+    if (size == 0 || size > rewind->budget) return false;
+
+    size_t offset = rewind->head;
+    if (offset + size > rewind->budget) {
+        // Wrapping abandons the tail, which holds the oldest entries.
+        while (rewind->count > 0 && rewind_entry(rewind, 0)->offset >= rewind->head)
+            rewind_evict(rewind);
+        offset = 0;
+    }
+    while (rewind->count > 0
+           && (rewind->count == rewind->capacity || rewind_overlaps(rewind_entry(rewind, 0), offset, size)))
+        rewind_evict(rewind);
+    // A delta whose keyframe was just evicted has nothing to apply to.
+    if (rewind->count == 0 && !keyframe) return rewind_push(rewind, nes);
+
+    memcpy(rewind->buffer + offset, rewind->packed, size);
+    RewindEntry *entry = rewind_entry(rewind, rewind->count++);
+    entry->offset = offset;
+    entry->size = (uint32_t) size;
+    entry->keyframe = keyframe;
+    rewind->head = offset + size;
+
+    if (keyframe) {
+        *rewind->keyframe = *rewind->scratch;
+        rewind->since_keyframe = 0;
+    } else {
+        rewind->since_keyframe++;
+    }
+    return true;
+}
+
+bool rewind_seek(Rewind *rewind, NES nes, uint32_t frames) {
+    if (frames >= rewind->count) return false;
+    uint32_t target = rewind->count - 1 - frames;
+    uint32_t key = target;
+    while (!rewind_entry(rewind, key)->keyframe) key--;
+
+    RewindEntry *entry = rewind_entry(rewind, key);
+    uint8_t *state = (uint8_t*) rewind->scratch;
+    if (codec_decompress(rewind->buffer + entry->offset, entry->size, state, sizeof(NesState)) != sizeof(NesState))
+        return false;
+    *rewind->keyframe = *rewind->scratch;
+    if (target != key) {
+        entry = rewind_entry(rewind, target);
+        if (codec_apply_xor(rewind->buffer + entry->offset, entry->size, state, sizeof(NesState))
+                != sizeof(NesState))
+            return false;
+    }
+    if (!nes_restore(nes, rewind->scratch)) return false;
+
+    rewind->count = target + 1;
+    rewind->since_keyframe = target - key;
+    entry = rewind_entry(rewind, target);
+    rewind->head = entry->offset + entry->size;
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef MACNES_REWIND_H
+#define MACNES_REWIND_H
+
+#include "defs.h"
+
+// Rewind history of up to `frames` states kept in `budget` bytes. Every
+// `keyframe_interval` pushes a full state is stored, the rest are XOR deltas
+// against that keyframe; all entries are zero-run compressed. The oldest
+// entries are evicted to make room, a keyframe together with its deltas.
+//
+// `budget` covers the compressed history only. Each instance also holds
+// two NesStates, a codec_bound(sizeof(NesState)) staging buffer and 16
+// bytes per frame of entries, about 260KB on top of the budget.
+
+Rewind* rewind_init(size_t budget, uint32_t frames, uint32_t keyframe_interval);
+
+void rewind_destroy(Rewind *rewind);
+
+bool rewind_push(Rewind *rewind, NES nes);
+
+// Restores the state pushed `frames` pushes ago (0 is the latest) and drops
+// everything newer. Returns false if it is no longer in the buffer.
+bool rewind_seek(Rewind *rewind, NES nes, uint32_t frames);
+
+#endif
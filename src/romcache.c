@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "romcache.h"
+#include "cartridge.h"
+
+#define ROMCACHE_NAME_MAX 256
+
+RomCache* romcache_init(const char *shm_prefix) {
+    RomCache *cache = (RomCache*) calloc(1, sizeof(RomCache));
+    if (!cache) return NULL;
+    if (shm_prefix) {
+        size_t size = strlen(shm_prefix) + 1;
+        cache->shm_prefix = (char*) malloc(size);
+        if (!cache->shm_prefix) {
+            free(cache);
+            return NULL;
+        }
+        memcpy(cache->shm_prefix, shm_prefix, size);
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void romcache_destroy(RomCache *cache) {
+    if (!cache) return;
+    for (size_t i = 0; i < cache->count; i++)
+        cartridge_release(cache->entries[i].cartridge);
+    free(cache->entries);
+    free(cache->files);
+    free(cache->shm_prefix);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+// Two independent multiply-xor streams over 8-byte words, with the tail
+// zero padded and the size folded in.
+static void romcache_hash(const uint8_t *data, size_t size, uint64_t hash[2]) {
+    uint64_t a = 0x243F6A8885A308D3ULL ^ size, b = 0x13198A2E03707344ULL;
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i < 8 ? size - i : 8);
+        a = (a ^ word) * 0x9E3779B97F4A7C15ULL;
+        a ^= a >> 29;
+        b = (b + word) * 0xC2B2AE3D27D4EB4FULL;
+        b ^= b >> 31;
+    }
+    hash[0] = a ^ (b >> 17);
+    hash[1] = b ^ (a << 13);
+}
+
+static void romcache_name(const RomCache *cache, const uint64_t hash[2], char *name) {
+    snprintf(name, ROMCACHE_NAME_MAX, "/%s-%016llx%016llx", cache->shm_prefix,
+             (unsigned long long) hash[0], (unsigned long long) hash[1]);
+}
+
+static void* romcache_map_segment(int fd, size_t size, const uint8_t *data) {
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return NULL;
+    if (memcmp(map, data, size) != 0) {
+        munmap(map, size);
+        return NULL;
+    }
+    return map;
+}
+
+// Maps the image's shared segment, creating and filling it if this process
+// is the first. Returns NULL if the segment cannot be used.
+static void* romcache_share(const RomCache *cache, const uint64_t hash[2], const uint8_t *data, size_t size) {
+    char name[ROMCACHE_NAME_MAX];
+    romcache_name(cache, hash, name);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0) {
+        bool filled = ftruncate(fd, (off_t) size) == 0;
+        void *writable = filled ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if (writable != MAP_FAILED) {
+            memcpy(writable, data, size);
+            munmap(writable, size);
+        } else {
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+    } else {
+        fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return NULL;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t) info.st_size != size) {
+            close(fd);
+            return NULL;
+        }
+    }
+    void *map = romcache_map_segment(fd, size, data);
+    close(fd);
+    return map;
+}
+
+static RomCacheEntry* romcache_find(RomCache *cache, const uint64_t hash[2], const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < cache->count; i++) {
+        RomCacheEntry *entry = &cache->entries[i];
+        if (entry->size == size && entry->hash[0] == hash[0] && entry->hash[1] == hash[1]
+            && memcmp(entry->cartridge->map, data, size) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static RomCacheFile romcache_file_key(const struct stat *info) {
+    RomCacheFile key = {(uint64_t) info->st_dev, (uint64_t) info->st_ino, (uint64_t) info->st_size,
+                        (int64_t) info->st_mtim.tv_sec, (int64_t) info->st_mtim.tv_nsec, NULL};
+    return key;
+}
+
+static RomCacheFile* romcache_find_file(RomCache *cache, const RomCacheFile *key) {
+    for (size_t i = 0; i < cache->file_count; i++) {
+        RomCacheFile *file = &cache->files[i];
+        if (file->device == key->device && file->inode == key->inode && file->size == key->size
+            && file->mtime_sec == key->mtime_sec && file->mtime_nsec == key->mtime_nsec)
+            return file;
+    }
+    return NULL;
+}
+
+static bool romcache_grow(void **items, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return true;
+    size_t grown = *capacity ? *capacity * 2 : 16;
+    void *resized = realloc(*items, grown * size);
+    if (!resized) return false;
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+static bool romcache_add(RomCache *cache, const RomCacheEntry *entry) {
+    if (!romcache_grow((void**) &cache->entries, &cache->capacity, cache->count, sizeof(RomCacheEntry)))
+        return false;
+    cache->entries[cache->count++] = *entry;
+    return true;
+}
+
+// Remembers which image a file holds. Failing only costs a hash next time.
+static void romcache_add_file(RomCache *cache, RomCacheFile *key, Cartridge *cartridge) {
+    if (!romcache_grow((void**) &cache->files, &cache->file_capacity, cache->file_count, sizeof(RomCacheFile)))
+        return;
+    key->cartridge = cartridge;
+    cache->files[cache->file_count++] = *key;
+}
+
+// Files seen before are found by identity without reading them; anything
+// else is mapped and hashed, and shares an image with equal contents.
+Cartridge* romcache_open(RomCache *cache, const char *path, enum CartridgeError *error) {
+    if (error) *error = CARTRIDGE_ERROR_IO;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    RomCacheFile key = romcache_file_key(&info);
+    pthread_mutex_lock(&cache->lock);
+    RomCacheFile *seen = romcache_find_file(cache, &key);
+    if (seen) {
+        Cartridge *cartridge = cartridge_retain(seen->cartridge);
+        pthread_mutex_unlock(&cache->lock);
+        close(fd);
+        if (error) *error = CARTRIDGE_OK;
+        return cartridge;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    size_t size = (size_t) info.st_size;
+    void *file = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) return NULL;
+    const uint8_t *data = (const uint8_t*) file;
+
+    RomCacheEntry entry = {{0, 0}, size, NULL, false};
+    romcache_hash(data, size, entry.hash);
+
+    pthread_mutex_lock(&cache->lock);
+    RomCacheEntry *found = romcache_find(cache, entry.hash, data, size);
+    if (found) {
+        Cartridge *cartridge = cartridge_retain(found->cartridge);
+        if (!romcache_find_file(cache, &key)) romcache_add_file(cache, &key, cartridge);
+        pthread_mutex_unlock(&cache->lock);
+        munmap(file, size);
+        if (error) *error = CARTRIDGE_OK;
+        return cartridge;
+    }
+
+    void *map = file;
+    if (cache->shm_prefix) {
+        void *shared = romcache_share(cache, entry.hash, data, size);
+        if (shared) {
+            munmap(file, size);
+            map = shared;
+            entry.shared = true;
+        }
+    }
+    // A cartridge that cannot be added is still returned, just not cached.
+    entry.cartridge = cartridge_from_map(map, size, error);
+    if (!entry.cartridge) {
+        munmap(map, size);
+        if (entry.shared) {
+            char name[ROMCACHE_NAME_MAX];
+            romcache_name(cache, entry.hash, name);
+            shm_unlink(name);
+        }
+    } else if (romcache_add(cache, &entry)) {
+        cartridge_retain(entry.cartridge);
+        romcache_add_file(cache, &key, entry.cartridge);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry.cartridge;
+}
+
+void romcache_trim(RomCache *cache) {
+    pthread_mutex_lock(&cache->lock);
+    size_t kept = 0;
+    for (size_t i = 0; i < cache->count; i++) {
+        RomCacheEntry *entry = &cache->entries[i];
+        if (__atomic_load_n(&entry->cartridge->refs, __ATOMIC_ACQUIRE) != 1) {
+            cache->entries[kept++] = *entry;
+            continue;
+        }
+        size_t files = 0;
+        for (size_t j = 0; j < cache->file_count; j++) {
+            if (cache->files[j].cartridge != entry->cartridge) cache->files[files++] = cache->files[j];
+        }
+        cache->file_count = files;
+        cartridge_release(entry->cartridge);
+    }
+    cache->count = kept;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void romcache_unlink(RomCache *cache) {
+    if (!cache->shm_prefix) return;
+    char name[ROMCACHE_NAME_MAX];
+    pthread_mutex_lock(&cache->lock);
+    for (size_t i = 0; i < cache->count; i++) {
+        if (!cache->entries[i].shared) continue;
+        romcache_name(cache, cache->entries[i].hash, name);
+        shm_unlink(name);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
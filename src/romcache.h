@@ -0,0 +1,35 @@
+#ifndef MACNES_ROMCACHE_H
+#define MACNES_ROMCACHE_H
+
+#include "defs.h"
+
+// Process-wide cache of cartridge images keyed by a 128-bit content hash,
+// so the same ROM opened through any path is mapped once and every machine
+// shares it. A file opened before, with the same device, inode, size and
+// modification time, is not read again. Safe to use from several threads.
+//
+// With a shared memory prefix, images are kept in named POSIX shared memory
+// segments "/<prefix>-<hash>", created by the first process on a host to
+// open an image and mapped read-only by the rest, so they all share one
+// physical copy. A segment whose contents do not match the file (a racing
+// writer or a stale segment) is ignored in favour of the file itself.
+
+// `shm_prefix` may be NULL for a cache that only maps files.
+RomCache* romcache_init(const char *shm_prefix);
+
+// Drops the cache's references; cartridges still in use stay valid.
+void romcache_destroy(RomCache *cache);
+
+// Returns a new reference to the cached cartridge for the file's contents,
+// opening and caching it on first use. Release it with cartridge_release.
+// Images that fail to parse are not cached and leave no shared segment.
+Cartridge* romcache_open(RomCache *cache, const char *path, enum CartridgeError *error);
+
+// Forgets images no machine holds any more.
+void romcache_trim(RomCache *cache);
+
+// Removes the shared memory segments of every cached image. Existing
+// mappings stay valid.
+void romcache_unlink(RomCache *cache);
+
+#endif
@@ -0,0 +1,37 @@
+#include <stdlib.h>
+#include "runahead.h"
+#include "nes.h"
+
+RunAhead* runahead_init(uint32_t frames) {
+    RunAhead *runahead = (RunAhead*) calloc(1, sizeof(RunAhead));
+    if (!runahead) return NULL;
+    runahead->frames = frames;
+    runahead->state = nes_state_init();
+    if (!runahead->state) {
+        free(runahead);
+        return NULL;
+    }
+    return runahead;
+}
+
+void runahead_destroy(RunAhead *runahead) {
+    if (!runahead) return;
+    nes_state_destroy(runahead->state);
+    free(runahead);
+}
+
+NesFrameResult runahead_frame(RunAhead *runahead, NES nes, NesInput input, NesFrame *out) {
+    if (runahead->frames == 0) return nes_run_frame(nes, input, out);
+
+    NesFrame audio = {NULL, out ? out->audio : NULL, out ? out->audio_capacity : 0};
+    NesFrameResult result = nes_run_frame(nes, input, &audio);
+    nes_snapshot(nes, runahead->state);
+
+    for (uint32_t i = 1; i < runahead->frames; i++)
+        nes_run_frame(nes, input, NULL);
+    NesFrame video = {out ? out->video : NULL, NULL, 0};
+    nes_run_frame(nes, input, &video);
+
+    nes_restore(nes, runahead->state);
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef MACNES_RUNAHEAD_H
+#define MACNES_RUNAHEAD_H
+
+#include "defs.h"
+
+// Run-ahead hides `frames` frames of the game's own input lag. Each call
+// advances the machine by exactly one frame, whose cycles, events and audio
+// are returned, then speculatively runs `frames` more with the same input
+// and shows the video of the last one before rolling back. The speculative
+// frames have no audio buffer, so they skip the resampler.
+
+RunAhead* runahead_init(uint32_t frames);
+
+void runahead_destroy(RunAhead *runahead);
+
+NesFrameResult runahead_frame(RunAhead *runahead, NES nes, NesInput input, NesFrame *out);
+
+#endif
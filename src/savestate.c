@@ -0,0 +1,320 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "savestate.h"
+#include "nes.h"
+#include "mapper.h"
+
+#define SAVESTATE_ALIGN_UP(x) (((x) + SAVESTATE_ALIGN - 1) & ~(size_t) (SAVESTATE_ALIGN - 1))
+#define SAVESTATE_CHUNKS 5
+#define SAVESTATE_TABLE_OFFSET sizeof(SaveStateHeader)
+#define SAVESTATE_CPU_OFFSET \
+    SAVESTATE_ALIGN_UP(SAVESTATE_TABLE_OFFSET + SAVESTATE_CHUNKS * sizeof(SaveStateChunk))
+#define SAVESTATE_CTRL_OFFSET SAVESTATE_ALIGN_UP(SAVESTATE_CPU_OFFSET + sizeof(SaveStateCpu))
+#define SAVESTATE_APU_OFFSET SAVESTATE_ALIGN_UP(SAVESTATE_CTRL_OFFSET + sizeof(SaveStateController))
+#define SAVESTATE_MAPR_OFFSET SAVESTATE_ALIGN_UP(SAVESTATE_APU_OFFSET + sizeof(SaveStateApu))
+#define SAVESTATE_RAM_OFFSET SAVESTATE_ALIGN_UP(SAVESTATE_MAPR_OFFSET + sizeof(SaveStateMapper))
+#define SAVESTATE_SIZE (SAVESTATE_RAM_OFFSET + RAM_SIZE)
+
+// The chunks are the file format: every byte is a named or reserved field,
+// so the checksum never covers compiler padding.
+_Static_assert(sizeof(SaveStateHeader) == 64, "SaveStateHeader layout");
+_Static_assert(sizeof(SaveStateChunk) == 16, "SaveStateChunk layout");
+_Static_assert(sizeof(SaveStateCpu) == 24 && offsetof(SaveStateCpu, clock_count) == 16, "SaveStateCpu layout");
+_Static_assert(sizeof(SaveStateController) == 8, "SaveStateController layout");
+_Static_assert(sizeof(SaveStateApu) == 32 + 4 * (RESAMPLER_TAPS + RESAMPLER_CHUNK)
+               && offsetof(SaveStateApu, pos) == 16 && offsetof(SaveStateApu, history) == 32,
+               "SaveStateApu layout");
+_Static_assert(sizeof(SaveStateMapper) == 40 && offsetof(SaveStateMapper, next_event) == 32,
+               "SaveStateMapper layout");
+
+static const char SAVESTATE_MAGIC[4] = {'M', 'N', 'E', 'S'};
+
+size_t savestate_size() {
+    return SAVESTATE_SIZE;
+}
+
+size_t savestate_head_size() {
+    return SAVESTATE_RAM_OFFSET;
+}
+
+// Four independent multiply-xor lanes over 8-byte words; size must be a
+// multiple of 32.
+static void savestate_hash(uint64_t lanes[4], const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, data + i + lane * 8, 8);
+            lanes[lane] = (lanes[lane] ^ word) * 0x9E3779B97F4A7C15ULL;
+            lanes[lane] ^= lanes[lane] >> 32;
+        }
+    }
+}
+
+static uint64_t savestate_checksum(const uint8_t *head, const uint8_t *ram) {
+    uint64_t lanes[4] = {1, 2, 3, 4};
+    savestate_hash(lanes, head + sizeof(SaveStateHeader), SAVESTATE_RAM_OFFSET - sizeof(SaveStateHeader));
+    savestate_hash(lanes, ram, RAM_SIZE);
+    return lanes[0] ^ (lanes[1] * 31) ^ (lanes[2] * 961) ^ (lanes[3] * 29791);
+}
+
+static void savestate_put_chunk(uint8_t *head, int index, uint32_t id, size_t offset, size_t size) {
+    SaveStateChunk chunk = {id, (uint32_t) size, offset};
+    memcpy(head + SAVESTATE_TABLE_OFFSET + index * sizeof(SaveStateChunk), &chunk, sizeof(chunk));
+}
+
+size_t savestate_encode_head(const NesState *state, uint8_t *head) {
+    memset(head, 0, SAVESTATE_RAM_OFFSET);
+
+    savestate_put_chunk(head, 0, SAVESTATE_CHUNK_CPU, SAVESTATE_CPU_OFFSET, sizeof(SaveStateCpu));
+    savestate_put_chunk(head, 1, SAVESTATE_CHUNK_CTRL, SAVESTATE_CTRL_OFFSET, sizeof(SaveStateController));
+    savestate_put_chunk(head, 2, SAVESTATE_CHUNK_APU, SAVESTATE_APU_OFFSET, sizeof(SaveStateApu));
+    savestate_put_chunk(head, 3, SAVESTATE_CHUNK_MAPR, SAVESTATE_MAPR_OFFSET, sizeof(SaveStateMapper));
+    savestate_put_chunk(head, 4, SAVESTATE_CHUNK_RAM, SAVESTATE_RAM_OFFSET, RAM_SIZE);
+
+    SaveStateCpu *cpu = (SaveStateCpu*) (head + SAVESTATE_CPU_OFFSET);
+    cpu->pc = state->cpu.pc;
+    cpu->addr_abs = state->cpu.addr_abs;
+    cpu->addr_rel = state->cpu.addr_rel;
+    cpu->a = state->cpu.a;
+    cpu->x = state->cpu.x;
+    cpu->y = state->cpu.y;
+    cpu->sp = state->cpu.sp;
+    cpu->status = state->cpu.status;
+    cpu->opcode = state->cpu.opcode;
+    cpu->cycles = state->cpu.cycles;
+    cpu->is_am_imm = state->cpu.is_am_imm;
+    cpu->clock_count = state->cpu.clock_count;
+
+    SaveStateController *controller = (SaveStateController*) (head + SAVESTATE_CTRL_OFFSET);
+    memcpy(controller->buttons, state->controller.buttons, sizeof(controller->buttons));
+    memcpy(controller->shift, state->controller.shift, sizeof(controller->shift));
+    controller->strobe = state->controller.strobe;
+    controller->polled = state->controller.polled;
+
+    SaveStateApu *apu = (SaveStateApu*) (head + SAVESTATE_APU_OFFSET);
+    apu->pulse1 = state->channels.pulse1;
+    apu->pulse2 = state->channels.pulse2;
+    apu->triangle = state->channels.triangle;
+    apu->noise = state->channels.noise;
+    apu->dmc = state->channels.dmc;
+    apu->acc_count = state->resampler.acc_count;
+    apu->acc = state->resampler.acc;
+    apu->pos = state->resampler.pos;
+    apu->fill = state->resampler.fill;
+    memcpy(apu->history, state->resampler.history, sizeof(apu->history));
+
+    const MapperState *mapper_state = &state->mapper;
+    SaveStateMapper *mapper = (SaveStateMapper*) (head + SAVESTATE_MAPR_OFFSET);
+    mapper->id = mapper_state->id;
+    mapper->bank = mapper_state->bank;
+    mapper->mirroring = mapper_state->mirroring;
+    mapper->irq = mapper_state->irq;
+    mapper->mmc1_shift = mapper_state->mmc1.shift;
+    mapper->mmc1_shift_count = mapper_state->mmc1.shift_count;
+    mapper->mmc1_control = mapper_state->mmc1.control;
+    memcpy(mapper->mmc1_chr, mapper_state->mmc1.chr, sizeof(mapper->mmc1_chr));
+    mapper->mmc1_prg = mapper_state->mmc1.prg;
+    mapper->mmc3_select = mapper_state->mmc3.select;
+    memcpy(mapper->mmc3_banks, mapper_state->mmc3.banks, sizeof(mapper->mmc3_banks));
+    mapper->mmc3_prg_ram = mapper_state->mmc3.prg_ram;
+    mapper->mmc3_irq_latch = mapper_state->mmc3.irq_latch;
+    mapper->mmc3_irq_counter = mapper_state->mmc3.irq_counter;
+    mapper->mmc3_irq_reload = mapper_state->mmc3.irq_reload;
+    mapper->mmc3_irq_enabled = mapper_state->mmc3.irq_enabled;
+    mapper->next_event = mapper_state->next_event;
+
+    SaveStateHeader *header = (SaveStateHeader*) head;
+    memcpy(header->magic, SAVESTATE_MAGIC, sizeof(SAVESTATE_MAGIC));
+    header->version = SAVESTATE_VERSION;
+    header->chunk_count = SAVESTATE_CHUNKS;
+    header->size = SAVESTATE_SIZE;
+    header->checksum = savestate_checksum(head, state->ram);
+    return SAVESTATE_RAM_OFFSET;
+}
+
+size_t savestate_encode(const NesState *state, uint8_t *out) {
+    savestate_encode_head(state, out);
+    memcpy(out + SAVESTATE_RAM_OFFSET, state->ram, RAM_SIZE);
+    return SAVESTATE_SIZE;
+}
+
+static bool savestate_write_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) return false;
+        data += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+enum SaveStateError savestate_save(NES nes, const char *path) {
+    NesState *state = nes_state_init();
+    uint8_t *head = (uint8_t*) malloc(SAVESTATE_RAM_OFFSET);
+    enum SaveStateError error = SAVESTATE_ERROR_IO;
+    if (state && head) {
+        nes_snapshot(nes, state);
+        savestate_encode_head(state, head);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            if (savestate_write_all(fd, head, SAVESTATE_RAM_OFFSET)
+                && savestate_write_all(fd, state->ram, RAM_SIZE))
+                error = SAVESTATE_OK;
+            if (close(fd) != 0) error = SAVESTATE_ERROR_IO;
+        }
+    }
+    free(head);
+    nes_state_destroy(state);
+    return error;
+}
+
+
+
+// Loading
+
+static const uint8_t* savestate_find_chunk(const uint8_t *base, const SaveStateHeader *header,
+                                           size_t size, uint32_t id, size_t chunk_size) {
+    for (uint16_t i = 0; i < header->chunk_count; i++) {
+        SaveStateChunk chunk;
+        memcpy(&chunk, base + SAVESTATE_TABLE_OFFSET + i * sizeof(SaveStateChunk), sizeof(chunk));
+        if (chunk.id != id) continue;
+        if (chunk.size != chunk_size || chunk.offset % SAVESTATE_ALIGN != 0
+            || chunk.offset > size || chunk.size > size - chunk.offset)
+            return NULL;
+        return base + chunk.offset;
+    }
+    return NULL;
+}
+
+static enum SaveStateError savestate_validate(SaveStateFile *file) {
+    const uint8_t *base = (const uint8_t*) file->map;
+    if (file->size < sizeof(SaveStateHeader)) return SAVESTATE_ERROR_MAGIC;
+    const SaveStateHeader *header = (const SaveStateHeader*) base;
+    if (memcmp(header->magic, SAVESTATE_MAGIC, sizeof(SAVESTATE_MAGIC)) != 0) return SAVESTATE_ERROR_MAGIC;
+    if (header->version != SAVESTATE_VERSION) return SAVESTATE_ERROR_VERSION;
+    if (header->size != file->size || file->size != SAVESTATE_SIZE) return SAVESTATE_ERROR_CORRUPT;
+    if (SAVESTATE_TABLE_OFFSET + header->chunk_count * sizeof(SaveStateChunk) > file->size)
+        return SAVESTATE_ERROR_CORRUPT;
+
+    file->header = header;
+    file->cpu = (const SaveStateCpu*) savestate_find_chunk(base, header, file->size,
+                                                           SAVESTATE_CHUNK_CPU, sizeof(SaveStateCpu));
+    file->controller = (const SaveStateController*) savestate_find_chunk(base, header, file->size,
+                                                                         SAVESTATE_CHUNK_CTRL,
+                                                                         sizeof(SaveStateController));
+    file->apu = (const SaveStateApu*) savestate_find_chunk(base, header, file->size,
+                                                           SAVESTATE_CHUNK_APU, sizeof(SaveStateApu));
+    file->mapper = (const SaveStateMapper*) savestate_find_chunk(base, header, file->size,
+                                                                 SAVESTATE_CHUNK_MAPR, sizeof(SaveStateMapper));
+    file->ram = savestate_find_chunk(base, header, file->size, SAVESTATE_CHUNK_RAM, RAM_SIZE);
+    if (!file->cpu || !file->controller || !file->apu || !file->mapper || file->ram != base + SAVESTATE_RAM_OFFSET)
+        return SAVESTATE_ERROR_CORRUPT;
+
+    if (savestate_checksum(base, file->ram) != header->checksum) return SAVESTATE_ERROR_CORRUPT;
+    return SAVESTATE_OK;
+}
+
+SaveStateFile* savestate_open(const char *path, enum SaveStateError *error) {
+    enum SaveStateError status = SAVESTATE_ERROR_IO;
+    SaveStateFile *file = (SaveStateFile*) calloc(1, sizeof(SaveStateFile));
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (file && fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0) {
+        file->size = (size_t) info.st_size;
+        file->map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file->map == MAP_FAILED) file->map = NULL;
+        else status = savestate_validate(file);
+    }
+    if (fd >= 0) close(fd);
+
+    if (error) *error = status;
+    if (status != SAVESTATE_OK) {
+        savestate_close(file);
+        return NULL;
+    }
+    return file;
+}
+
+void savestate_close(SaveStateFile *file) {
+    if (!file) return;
+    if (file->map) munmap(file->map, file->size);
+    free(file);
+}
+
+bool savestate_restore(NES nes, const SaveStateFile *file) {
+    if (!ram_load(nes.ram, file->ram)) return false;
+    CPU *cpu = nes.cpu;
+    cpu->pc = file->cpu->pc;
+    cpu->addr_abs = file->cpu->addr_abs;
+    cpu->addr_rel = file->cpu->addr_rel;
+    cpu->a = file->cpu->a;
+    cpu->x = file->cpu->x;
+    cpu->y = file->cpu->y;
+    cpu->sp = file->cpu->sp;
+    cpu->status = file->cpu->status;
+    cpu->opcode = file->cpu->opcode;
+    cpu->cycles = file->cpu->cycles;
+    cpu->is_am_imm = file->cpu->is_am_imm;
+    cpu->clock_count = file->cpu->clock_count;
+
+    Controller *controller = nes.controller;
+    memcpy(controller->buttons, file->controller->buttons, sizeof(controller->buttons));
+    memcpy(controller->shift, file->controller->shift, sizeof(controller->shift));
+    controller->strobe = file->controller->strobe != 0;
+    controller->polled = file->controller->polled != 0;
+
+    const SaveStateApu *apu = file->apu;
+    AudioChannels *channels = &nes.audio->channels;
+    channels->pulse1 = apu->pulse1;
+    channels->pulse2 = apu->pulse2;
+    channels->triangle = apu->triangle;
+    channels->noise = apu->noise;
+    channels->dmc = apu->dmc;
+    ResamplerState *resampler = &nes.audio->resampler->state;
+    resampler->acc_count = apu->acc_count;
+    resampler->acc = apu->acc;
+    resampler->pos = apu->pos;
+    resampler->fill = apu->fill;
+    memcpy(resampler->history, apu->history, sizeof(resampler->history));
+
+    const SaveStateMapper *mapper = file->mapper;
+    MapperState state = {
+        .id = mapper->id,
+        .bank = mapper->bank,
+        .mirroring = mapper->mirroring,
+        .irq = mapper->irq != 0,
+        .next_event = mapper->next_event,
+        .mmc1 = {
+            .shift = mapper->mmc1_shift,
+            .shift_count = mapper->mmc1_shift_count,
+            .control = mapper->mmc1_control,
+            .chr = {mapper->mmc1_chr[0], mapper->mmc1_chr[1]},
+            .prg = mapper->mmc1_prg,
+        },
+        .mmc3 = {
+            .select = mapper->mmc3_select,
+            .prg_ram = mapper->mmc3_prg_ram,
+            .irq_latch = mapper->mmc3_irq_latch,
+            .irq_counter = mapper->mmc3_irq_counter,
+            .irq_reload = mapper->mmc3_irq_reload != 0,
+            .irq_enabled = mapper->mmc3_irq_enabled != 0,
+        },
+    };
+    memcpy(state.mmc3.banks, mapper->mmc3_banks, sizeof(state.mmc3.banks));
+    mapper_restore(nes.bus, &state);
+    return true;
+}
+
+enum SaveStateError savestate_load(NES nes, const char *path) {
+    enum SaveStateError error;
+    SaveStateFile *file = savestate_open(path, &error);
+    if (!file) return error;
+    error = savestate_restore(nes, file) ? SAVESTATE_OK : SAVESTATE_ERROR_IO;
+    savestate_close(file);
+    return error;
+}
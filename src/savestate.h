@@ -0,0 +1,38 @@
+#ifndef MACNES_SAVESTATE_H
+#define MACNES_SAVESTATE_H
+
+#include "defs.h"
+
+// On-disk save state, version SAVESTATE_VERSION, little-endian:
+//
+//   SaveStateHeader     magic "MNES", version, total size, checksum
+//   SaveStateChunk[]    id, size and offset of every chunk
+//   chunks              CPU, CTRL, APU, MAPR, RAM, each SAVESTATE_ALIGN aligned
+//
+// Chunks are written field by field into fixed-width, explicitly padded
+// structs, never copied from the in-memory ones, so the layout does not
+// follow the compiler. The checksum covers everything after the header. RAM is the last chunk,
+// so the bytes before it (savestate_head_size) can be built separately and
+// the RAM written straight from a NesState. Loading maps the file and
+// restores from the chunks in place.
+
+size_t savestate_size();
+
+size_t savestate_head_size();
+
+size_t savestate_encode_head(const NesState *state, uint8_t *head);
+
+size_t savestate_encode(const NesState *state, uint8_t *out);
+
+enum SaveStateError savestate_save(NES nes, const char *path);
+
+SaveStateFile* savestate_open(const char *path, enum SaveStateError *error);
+
+void savestate_close(SaveStateFile *file);
+
+// False, leaving the machine untouched, as nes_restore.
+bool savestate_restore(NES nes, const SaveStateFile *file);
+
+enum SaveStateError savestate_load(NES nes, const char *path);
+
+#endif
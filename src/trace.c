@@ -0,0 +1,377 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+#include "codec.h"
+#include "bus.h"
+#include "cpu.h"
+
+#define TRACE_IDLE_NS 200000
+
+static const char TRACE_MAGIC[4] = {'M', 'N', 'T', 'R'};
+
+
+
+// Chunk encoding
+
+static bool trace_model_init(TraceModel *model) {
+    memset(model, 0, sizeof(*model));
+    model->next_pc = (uint16_t*) calloc(65536, sizeof(uint16_t));
+    model->last = (TraceRecord*) calloc(65536, sizeof(TraceRecord));
+    return model->next_pc && model->last;
+}
+
+static void trace_model_destroy(TraceModel *model) {
+    free(model->last);
+    free(model->next_pc);
+}
+
+static inline void trace_xor(TraceRecord *record, const TraceRecord *base) {
+    uint64_t words[2], other[2];
+    memcpy(words, record, sizeof(words));
+    memcpy(other, base, sizeof(other));
+    words[0] ^= other[0];
+    words[1] ^= other[1];
+    memcpy(record, words, sizeof(words));
+}
+
+// Leaves zeros wherever the model guessed right: the pc that followed the
+// previous one last time, the cycle delta and registers last seen at this
+// pc, and the instruction bytes there.
+static TraceRecord trace_encode(TraceModel *model, const TraceRecord *record) {
+    TraceRecord delta = *record;
+    delta.cycle = record->cycle - model->previous.cycle;
+    uint16_t predicted = model->next_pc[model->previous.pc];
+    model->next_pc[model->previous.pc] = record->pc;
+
+    TraceRecord encoded = delta;
+    trace_xor(&encoded, &model->last[record->pc]);
+    encoded.pc = record->pc ^ predicted;
+    model->last[record->pc] = delta;
+    model->previous = *record;
+    return encoded;
+}
+
+static TraceRecord trace_decode(TraceModel *model, const TraceRecord *encoded) {
+    uint16_t pc = encoded->pc ^ model->next_pc[model->previous.pc];
+    model->next_pc[model->previous.pc] = pc;
+
+    TraceRecord delta = *encoded;
+    trace_xor(&delta, &model->last[pc]);
+    delta.pc = pc;
+    model->last[pc] = delta;
+    TraceRecord record = delta;
+    record.cycle = delta.cycle + model->previous.cycle;
+    model->previous = record;
+    return record;
+}
+
+// Byte b of record i goes to planes[b * count + i], so each field's zeros
+// form one run. Planes are filled one at a time: interleaved, their
+// writes would all fall in the same cache sets.
+static void trace_split(const TraceRecord *records, uint32_t count, uint8_t *planes) {
+    const uint8_t *bytes = (const uint8_t*) records;
+    for (size_t b = 0; b < sizeof(TraceRecord); b++, planes += count)
+        for (uint32_t i = 0; i < count; i++) planes[i] = bytes[i * sizeof(TraceRecord) + b];
+}
+
+static void trace_join(const uint8_t *planes, uint32_t count, TraceRecord *records) {
+    uint8_t *bytes = (uint8_t*) records;
+    for (size_t b = 0; b < sizeof(TraceRecord); b++, planes += count)
+        for (uint32_t i = 0; i < count; i++) bytes[i * sizeof(TraceRecord) + b] = planes[i];
+}
+
+
+
+// Writer
+
+static bool trace_write_all(int fd, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t*) data;
+    while (size) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) return false;
+        bytes += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+// Encodes `count` records out of the ring, frees their slots and writes
+// them as one chunk.
+static void trace_write_chunk(Trace *trace, uint64_t tail, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++)
+        trace->staging[i] = trace_encode(&trace->model, &trace->ring[(tail + i) & trace->mask]);
+    __atomic_store_n(&trace->tail, tail + count, __ATOMIC_RELEASE);
+
+    size_t size = (size_t) count * sizeof(TraceRecord);
+    trace_split(trace->staging, count, trace->planes);
+    size_t packed = codec_compress(trace->planes, size, trace->packed, trace->packed_capacity);
+    uint32_t head[2] = {count, (uint32_t) packed};
+    if (!trace->failed && (!packed || !trace_write_all(trace->fd, head, sizeof(head))
+                           || !trace_write_all(trace->fd, trace->packed, packed)))
+        trace->failed = true;
+    trace->bytes += sizeof(head) + packed;
+}
+
+// Writes whole chunks as they fill, and the remainder once stopping.
+static void* trace_writer(void *context) {
+    Trace *trace = (Trace*) context;
+    const struct timespec idle = {0, TRACE_IDLE_NS};
+    for (;;) {
+        bool stopping = __atomic_load_n(&trace->stopping, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = trace->tail;
+        uint64_t available = head - tail;
+        if (available >= TRACE_CHUNK_RECORDS || (stopping && available)) {
+            trace_write_chunk(trace, tail, available < TRACE_CHUNK_RECORDS ? (uint32_t) available
+                                                                          : TRACE_CHUNK_RECORDS);
+            continue;
+        }
+        if (stopping) return NULL;
+        nanosleep(&idle, NULL);
+    }
+}
+
+static void trace_free(Trace *trace) {
+    trace_model_destroy(&trace->model);
+    free(trace->packed);
+    free(trace->planes);
+    free(trace->staging);
+    free(trace->ring);
+    free(trace);
+}
+
+Trace* trace_open(const char *path, uint32_t capacity) {
+    uint64_t size = TRACE_CHUNK_RECORDS;
+    while (size < capacity) size *= 2;
+
+    Trace *trace = (Trace*) calloc(1, sizeof(Trace));
+    if (!trace) return NULL;
+    trace->mask = size - 1;
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    trace->ring = (TraceRecord*) malloc(size * sizeof(TraceRecord));
+    trace->staging = (TraceRecord*) malloc(TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+    trace->planes = (uint8_t*) malloc(TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+    trace->packed_capacity = codec_bound(TRACE_CHUNK_RECORDS * sizeof(TraceRecord));
+    trace->packed = (uint8_t*) malloc(trace->packed_capacity);
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    bool model = trace_model_init(&trace->model);
+    if (trace->fd < 0 || !model || !trace->ring || !trace->staging || !trace->planes || !trace->packed
+        || !trace_write_all(trace->fd, &header, sizeof(header))
+        || pthread_create(&trace->writer, NULL, trace_writer, trace) != 0) {
+        if (trace->fd >= 0) close(trace->fd);
+        trace_free(trace);
+        return NULL;
+    }
+    trace->bytes = sizeof(header);
+    return trace;
+}
+
+bool trace_close(Trace *trace) {
+    if (!trace) return false;
+    __atomic_store_n(&trace->stopping, true, __ATOMIC_RELEASE);
+    pthread_join(trace->writer, NULL);
+    bool ok = !trace->failed;
+    if (close(trace->fd) != 0) ok = false;
+    trace_free(trace);
+    return ok;
+}
+
+
+
+// Recording
+
+static inline void trace_push(Trace *trace, const CPU *cpu) {
+    uint64_t head = trace->head;
+    if (head - trace->tail_seen > trace->mask) {
+        trace->tail_seen = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE);
+        while (head - trace->tail_seen > trace->mask) {
+            trace->stalls++;
+            sched_yield();
+            trace->tail_seen = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE);
+        }
+    }
+    TraceRecord *record = &trace->ring[head & trace->mask];
+    uint16_t pc = cpu->pc;
+    record->cycle = (uint32_t) cpu->clock_count;
+    record->pc = pc;
+    const uint8_t *page = cpu->bus->rom_map[pc >> 8];
+    if (page && (pc & 0xFF) < 0xFE) {
+        const uint8_t *code = page + (pc & 0xFF);
+        record->opcode = code[0];
+        record->operand[0] = code[1];
+        record->operand[1] = code[2];
+    } else {
+        record->opcode = bus_peek(cpu->bus, pc);
+        record->operand[0] = bus_peek(cpu->bus, (uint16_t) (pc + 1));
+        record->operand[1] = bus_peek(cpu->bus, (uint16_t) (pc + 2));
+    }
+    record->a = cpu->a;
+    record->x = cpu->x;
+    record->y = cpu->y;
+    record->status = cpu->status;
+    record->sp = cpu->sp;
+    record->reserved[0] = 0;
+    record->reserved[1] = 0;
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+uint8_t trace_step(Trace *trace, CPU *cpu) {
+    if (cpu->cycles == 0) trace_push(trace, cpu);
+    return cpu->tier == CPU_TIER_ACCURATE ? cpu_step_accurate(cpu) : cpu_step(cpu);
+}
+
+
+
+// Reading
+
+typedef bool (*TraceVisitor)(void *context, const TraceRecord *records, uint32_t count);
+
+// Calls `visit` with each chunk's records in turn.
+static bool trace_read(const char *path, TraceVisitor visit, void *context) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    TraceHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0
+        && header.version == TRACE_VERSION && header.record_size == sizeof(TraceRecord);
+
+    size_t chunk_size = TRACE_CHUNK_RECORDS * sizeof(TraceRecord);
+    size_t packed_capacity = codec_bound(chunk_size);
+    TraceRecord *records = (TraceRecord*) malloc(chunk_size);
+    uint8_t *planes = (uint8_t*) malloc(chunk_size);
+    uint8_t *packed = (uint8_t*) malloc(packed_capacity);
+    TraceModel model;
+    if (!trace_model_init(&model) || !records || !planes || !packed) ok = false;
+    uint32_t head[2];
+    while (ok && fread(head, sizeof(head), 1, file) == 1) {
+        size_t size = (size_t) head[0] * sizeof(TraceRecord);
+        if (!head[0] || head[0] > TRACE_CHUNK_RECORDS || head[1] > packed_capacity
+            || fread(packed, 1, head[1], file) != head[1]
+            || codec_decompress(packed, head[1], planes, size) != size) {
+            ok = false;
+            break;
+        }
+        trace_join(planes, head[0], records);
+        for (uint32_t i = 0; i < head[0]; i++) records[i] = trace_decode(&model, &records[i]);
+        ok = visit(context, records, head[0]);
+    }
+    if (ok && !feof(file)) ok = false;
+    trace_model_destroy(&model);
+    free(packed);
+    free(planes);
+    free(records);
+    fclose(file);
+    return ok;
+}
+
+typedef struct {
+    TraceRecord *records;
+    size_t      count;
+    size_t      capacity;
+} TraceList;
+
+static bool trace_append(void *context, const TraceRecord *records, uint32_t count) {
+    TraceList *list = (TraceList*) context;
+    if (list->count + count > list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : TRACE_CHUNK_RECORDS;
+        while (capacity < list->count + count) capacity *= 2;
+        TraceRecord *grown = (TraceRecord*) realloc(list->records, capacity * sizeof(TraceRecord));
+        if (!grown) return false;
+        list->records = grown;
+        list->capacity = capacity;
+    }
+    memcpy(list->records + list->count, records, count * sizeof(TraceRecord));
+    list->count += count;
+    return true;
+}
+
+TraceRecord* trace_load(const char *path, size_t *count) {
+    TraceList list = {NULL, 0, 0};
+    if (!trace_read(path, trace_append, &list)) {
+        free(list.records);
+        return NULL;
+    }
+    *count = list.count;
+    return list.records ? list.records : (TraceRecord*) malloc(sizeof(TraceRecord));
+}
+
+
+
+// Text log
+
+typedef struct {
+    FILE        *out;
+    uint64_t    clock;
+    bool        started;
+    const char  *mnemonics[256];
+    CpuAddressMode modes[256];
+} TraceLog;
+
+static void trace_operand(char *text, size_t size, const TraceLog *log, const TraceRecord *record) {
+    CpuAddressMode am = log->modes[record->opcode];
+    uint8_t lo = record->operand[0];
+    uint16_t word = (uint16_t) (lo | (record->operand[1] << 8));
+    const char *mnemonic = log->mnemonics[record->opcode];
+    if (am == am_IMP) {
+        bool accumulator = record->opcode == 0x0A || record->opcode == 0x2A
+                        || record->opcode == 0x4A || record->opcode == 0x6A;
+        snprintf(text, size, accumulator ? "%s A" : "%s", mnemonic);
+    }
+    else if (am == am_IMM) snprintf(text, size, "%s #$%02X", mnemonic, lo);
+    else if (am == am_ZP0) snprintf(text, size, "%s $%02X", mnemonic, lo);
+    else if (am == am_ZPX) snprintf(text, size, "%s $%02X,X", mnemonic, lo);
+    else if (am == am_ZPY) snprintf(text, size, "%s $%02X,Y", mnemonic, lo);
+    else if (am == am_REL) snprintf(text, size, "%s $%04X", mnemonic, (uint16_t) (record->pc + 2 + (int8_t) lo));
+    else if (am == am_ABS) snprintf(text, size, "%s $%04X", mnemonic, word);
+    else if (am == am_ABX) snprintf(text, size, "%s $%04X,X", mnemonic, word);
+    else if (am == am_ABY) snprintf(text, size, "%s $%04X,Y", mnemonic, word);
+    else if (am == am_IND) snprintf(text, size, "%s ($%04X)", mnemonic, word);
+    else if (am == am_IZX) snprintf(text, size, "%s ($%02X,X)", mnemonic, lo);
+    else snprintf(text, size, "%s ($%02X),Y", mnemonic, lo);
+}
+
+static bool trace_print(void *context, const TraceRecord *records, uint32_t count) {
+    TraceLog *log = (TraceLog*) context;
+    for (uint32_t i = 0; i < count; i++) {
+        const TraceRecord *record = &records[i];
+        if (!log->started) log->clock = record->cycle;
+        else log->clock += (uint32_t) (record->cycle - (uint32_t) log->clock);
+        log->started = true;
+
+        CpuAddressMode am = log->modes[record->opcode];
+        int length = am == am_IMP ? 1 : am == am_ABS || am == am_ABX || am == am_ABY || am == am_IND ? 3 : 2;
+        char bytes[16], text[32];
+        if (length == 1) snprintf(bytes, sizeof(bytes), "%02X", record->opcode);
+        else if (length == 2) snprintf(bytes, sizeof(bytes), "%02X %02X", record->opcode, record->operand[0]);
+        else snprintf(bytes, sizeof(bytes), "%02X %02X %02X", record->opcode, record->operand[0], record->operand[1]);
+        trace_operand(text, sizeof(text), log, record);
+        bool illegal = cpu_instruction(record->opcode).op == i_XXX;
+        if (fprintf(log->out, "%04X  %-8s %c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+                    record->pc, bytes, illegal ? '*' : ' ', text, record->a, record->x, record->y,
+                    record->status, record->sp, (unsigned long long) log->clock) < 0)
+            return false;
+    }
+    return true;
+}
+
+bool trace_convert(const char *path, FILE *out) {
+    TraceLog log;
+    memset(&log, 0, sizeof(log));
+    log.out = out;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        CpuInstruction instruction = cpu_instruction((uint8_t) opcode);
+        const char *name = cpu_function_name(instruction.op);
+        log.mnemonics[opcode] = name ? name + 2 : "NOP";
+        log.modes[opcode] = instruction.am;
+    }
+    return trace_read(path, trace_print, &log);
+}
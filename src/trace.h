@@ -0,0 +1,42 @@
+#ifndef MACNES_TRACE_H
+#define MACNES_TRACE_H
+
+#include <stdio.h>
+#include "defs.h"
+
+// Execution trace recorder. A traced machine appends one TraceRecord per
+// instruction to a single-producer ring, and a writer thread drains it into
+// a file in chunks:
+//
+//   header              TraceHeader
+//   chunk...            uint32 record count, uint32 packed size, then the
+//                       records packed with codec_compress (see codec.h)
+//
+// Before packing, each record is XORed with what a TraceModel predicts for
+// it, which in loops is nearly all of it, and the chunk is split into byte
+// planes so the zeros run together. Chunks must be read in order. The
+// machine only waits when the ring is full, counting it in `stalls`.
+
+// `capacity` records, rounded up to a power of two, at least one chunk.
+Trace* trace_open(const char *path, uint32_t capacity);
+
+// Writes out every record and closes the file. Returns false if any write
+// failed.
+bool trace_close(Trace *trace);
+
+// Records the instruction at pc, then runs cpu_step or cpu_step_accurate
+// for the machine's tier.
+uint8_t trace_step(Trace *trace, CPU *cpu);
+
+// Every record in a trace file, or NULL if it is malformed.
+TraceRecord* trace_load(const char *path, size_t *count);
+
+// Writes a trace as a nestest-style log, one line per instruction:
+//
+//   C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7
+//
+// Records carry no memory contents, so operands have no "= value" part, and
+// there are no PPU columns.
+bool trace_convert(const char *path, FILE *out);
+
+#endif
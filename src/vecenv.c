@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "vecenv.h"
+#include "nes.h"
+#include "ramwatch.h"
+
+#define VECENV_ALIGN 64
+
+VecEnv* vecenv_init(size_t count, const VecEnvConfig *config) {
+    VecEnv *env = (VecEnv*) calloc(1, sizeof(VecEnv));
+    if (!env) return NULL;
+    env->count = count;
+    env->config = *config;
+
+    if (config->observation == VECENV_OBS_RAM) {
+        uint16_t *addresses = (uint16_t*) malloc(config->ram_count * sizeof(uint16_t));
+        if (!addresses) {
+            free(env);
+            return NULL;
+        }
+        memcpy(addresses, config->ram_addresses, config->ram_count * sizeof(uint16_t));
+        env->config.ram_addresses = addresses;
+        env->observation_size = config->ram_count;
+    } else if (config->observation == VECENV_OBS_WATCH) {
+        env->config.ram_addresses = NULL;
+        env->config.ram_count = 0;
+        env->observation_size = config->watch->feature_count * sizeof(int32_t);
+    } else {
+        free(env);
+        return NULL;
+    }
+
+    size_t observations = count * env->observation_size;
+    env->rewards_offset = (observations + VECENV_ALIGN - 1) & ~(size_t) (VECENV_ALIGN - 1);
+    env->buffer_size = env->rewards_offset + count * sizeof(float);
+
+    env->machines = (NES*) calloc(count, sizeof(NES));
+    if (!env->machines) {
+        vecenv_destroy(env);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++)
+        env->machines[i] = nes_init();
+    return env;
+}
+
+void vecenv_destroy(VecEnv *env) {
+    if (!env) return;
+    if (env->machines) {
+        for (size_t i = 0; i < env->count; i++)
+            nes_shutdown(env->machines[i]);
+    }
+    free(env->machines);
+    free((void*) env->config.ram_addresses);
+    free(env);
+}
+
+void vecenv_reset(VecEnv *env) {
+    for (size_t i = 0; i < env->count; i++)
+        nes_reset(env->machines[i]);
+}
+
+uint8_t* vecenv_observations(VecEnv *env, void *buffer) {
+    (void) env;
+    return (uint8_t*) buffer;
+}
+
+float* vecenv_rewards(VecEnv *env, void *buffer) {
+    return (float*) ((uint8_t*) buffer + env->rewards_offset);
+}
+
+void vecenv_step(VecEnv *env, const NesInput *inputs, void *buffer) {
+    uint8_t *observations = vecenv_observations(env, buffer);
+    float *rewards = vecenv_rewards(env, buffer);
+
+    for (size_t i = 0; i < env->count; i++)
+        nes_run_frame(env->machines[i], inputs[i], NULL);
+
+    if (env->config.observation == VECENV_OBS_WATCH) {
+        ramwatch_gather(env->config.watch, env->machines, env->count, (int32_t*) observations);
+    } else if (env->config.observation == VECENV_OBS_RAM) {
+        const uint16_t *addresses = env->config.ram_addresses;
+        size_t ram_count = env->config.ram_count;
+        for (size_t i = 0; i < env->count; i++) {
+            uint8_t *const *pages = env->machines[i].ram->read_page;
+            uint8_t *observation = observations + i * env->observation_size;
+            for (size_t j = 0; j < ram_count; j++)
+                observation[j] = pages[addresses[j] >> 8][addresses[j] & 0xFF];
+        }
+    }
+
+    for (size_t i = 0; i < env->count; i++)
+        rewards[i] = env->config.reward ? env->config.reward(env->machines[i], env->config.reward_context) : 0.0f;
+}
+
+
+
+// Shared memory
+
+static void* vecenv_shm_map(const char *name, size_t size, int flags) {
+    int fd = shm_open(name, flags, 0600);
+    if (fd < 0) return NULL;
+    if ((flags & O_CREAT) && ftruncate(fd, (off_t) size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return buffer == MAP_FAILED ? NULL : buffer;
+}
+
+void* vecenv_shm_create(const char *name, size_t size) {
+    return vecenv_shm_map(name, size, O_RDWR | O_CREAT | O_EXCL);
+}
+
+void* vecenv_shm_open(const char *name, size_t size) {
+    return vecenv_shm_map(name, size, O_RDWR);
+}
+
+void vecenv_shm_close(void *buffer, size_t size) {
+    if (buffer) munmap(buffer, size);
+}
+
+void vecenv_shm_unlink(const char *name) {
+    shm_unlink(name);
+}
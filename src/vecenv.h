@@ -0,0 +1,37 @@
+#ifndef MACNES_VECENV_H
+#define MACNES_VECENV_H
+
+#include "defs.h"
+
+// Batch of machines stepped together. Each step writes into one caller
+// provided buffer laid out as
+//
+//     uint8_t observations[count][observation_size]
+//     float   rewards[count]          (at rewards_offset, 64-byte aligned)
+//
+// so both halves can be wrapped as tensors without copying. With
+// VECENV_OBS_RAM each observation row is the bytes at ram_addresses; with
+// VECENV_OBS_WATCH it is the watch's int32 features. The buffer may live in
+// POSIX shared memory, see vecenv_shm_create.
+
+VecEnv* vecenv_init(size_t count, const VecEnvConfig *config);
+
+void vecenv_destroy(VecEnv *env);
+
+void vecenv_reset(VecEnv *env);
+
+void vecenv_step(VecEnv *env, const NesInput *inputs, void *buffer);
+
+uint8_t* vecenv_observations(VecEnv *env, void *buffer);
+
+float* vecenv_rewards(VecEnv *env, void *buffer);
+
+void* vecenv_shm_create(const char *name, size_t size);
+
+void* vecenv_shm_open(const char *name, size_t size);
+
+void vecenv_shm_close(void *buffer, size_t size);
+
+void vecenv_shm_unlink(const char *name);
+
+#endif
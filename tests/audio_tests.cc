@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+extern "C" {
+    #include "audio.h"
+    #include "defs.h"
+}
+#define SUITE AUDIO
+
+// Mixer
+
+TEST(SUITE, check_audio_mix_silence) {
+    AudioChannels channels = {0, 0, 0, 0, 0};
+
+    EXPECT_FLOAT_EQ(0.0f, audio_mix(channels));
+}
+
+TEST(SUITE, check_audio_mix_pulse) {
+    AudioChannels channels = {15, 15, 0, 0, 0};
+
+    EXPECT_NEAR(95.52 / (8128.0 / 30 + 100.0), audio_mix(channels), 1e-6);
+}
+
+TEST(SUITE, check_audio_mix_tnd) {
+    AudioChannels channels = {0, 0, 15, 15, 127};
+
+    EXPECT_NEAR(163.67 / (24329.0 / 202 + 100.0), audio_mix(channels), 1e-6);
+}
+
+TEST(SUITE, check_audio_mix_clamps) {
+    AudioChannels loudest = {15, 15, 15, 15, 127};
+    AudioChannels over = {16, 200, 255, 16, 255};
+
+    EXPECT_FLOAT_EQ(audio_mix(loudest), audio_mix(over));
+}
+
+TEST(SUITE, check_audio_mix_block) {
+    AudioChannels channels[3] = {{1, 2, 3, 4, 5}, {15, 0, 7, 0, 64}, {0, 0, 0, 0, 0}};
+    float out[3];
+
+    audio_mix_block(channels, out, 3);
+
+    for (int i = 0; i < 3; i++)
+        EXPECT_FLOAT_EQ(audio_mix(channels[i]), out[i]);
+}
+
+
+
+// Resampler
+
+TEST(SUITE, check_resampler_output_count) {
+    Resampler *resampler = resampler_init(96000, 48000);
+    std::vector<float> in(9600, 0.5f);
+    std::vector<float> out(8000);
+
+    size_t produced = resampler_process(resampler, in.data(), in.size(), out.data(), out.size());
+
+    EXPECT_NEAR(4800, (double) produced, RESAMPLER_TAPS);
+
+    resampler_destroy(resampler);
+}
+
+TEST(SUITE, check_resampler_dc_gain) {
+    Resampler *resampler = resampler_init(1789773, 48000);
+    std::vector<float> in(29781, 0.25f);
+    std::vector<float> out(1024);
+
+    size_t produced = resampler_process(resampler, in.data(), in.size(), out.data(), out.size());
+
+    ASSERT_GT(produced, 700u);
+    for (size_t i = RESAMPLER_TAPS; i < produced; i++)
+        EXPECT_NEAR(0.25f, out[i], 1e-4);
+
+    resampler_destroy(resampler);
+}
+
+TEST(SUITE, check_resampler_hold_matches_process) {
+    Resampler *a = resampler_init(1789773, 44100);
+    Resampler *b = resampler_init(1789773, 44100);
+    std::vector<float> in(5000, 0.75f);
+    std::vector<float> out_a(256);
+    std::vector<float> out_b(256);
+
+    size_t produced_a = resampler_process(a, in.data(), in.size(), out_a.data(), out_a.size());
+    size_t produced_b = 0;
+    for (int i = 0; i < 1000; i++)
+        produced_b += resampler_hold(b, 0.75f, 5, out_b.data() + produced_b, out_b.size() - produced_b);
+
+    ASSERT_EQ(produced_a, produced_b);
+    for (size_t i = 0; i < produced_a; i++)
+        EXPECT_FLOAT_EQ(out_a[i], out_b[i]);
+
+    resampler_destroy(a);
+    resampler_destroy(b);
+}
+
+TEST(SUITE, check_resampler_overflow) {
+    Resampler *resampler = resampler_init(48000, 48000);
+    std::vector<float> in(1000, 1.0f);
+    float out[16];
+
+    size_t produced = resampler_process(resampler, in.data(), in.size(), out, 16);
+
+    EXPECT_GT(produced, 16u);
+
+    resampler_destroy(resampler);
+}
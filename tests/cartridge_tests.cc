@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "cartridge.h"
+}
+#define SUITE CARTRIDGE
+
+static std::string temp_path(const char *name) {
+    return std::string("/tmp/macnes-") + name + "-" + std::to_string(getpid()) + ".nes";
+}
+
+// NROM image with one 16KB PRG bank counting $10/$11 from $C000 (mirrored
+// to $8000) and one CHR bank filled with its page numbers.
+static std::vector<uint8_t> nrom_image() {
+    std::vector<uint8_t> image(16 + 16 * 1024 + 8 * 1024, 0);
+    const uint8_t header[] = {'N', 'E', 'S', 0x1A, 1, 1, 0x01, 0x00};
+    std::copy(header, header + sizeof(header), image.begin());
+    const uint8_t program[] = {0xE6, 0x10, 0xD0, 0xFC, 0xE6, 0x11, 0x4C, 0x00, 0xC0};
+    std::copy(program, program + sizeof(program), image.begin() + 16);
+    image[16 + 0x3FFC] = 0x00;
+    image[16 + 0x3FFD] = 0xC0;
+    for (int i = 0; i < 8 * 1024; i++)
+        image[16 + 16 * 1024 + i] = (uint8_t) (i / 1024);
+    return image;
+}
+
+static void write_file(const std::string &path, const std::vector<uint8_t> &data) {
+    FILE *f = fopen(path.c_str(), "wb");
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+
+TEST(SUITE, check_cartridge_ines_header) {
+    std::vector<uint8_t> image = nrom_image();
+    Cartridge cartridge;
+    ASSERT_EQ(CARTRIDGE_OK, cartridge_parse(image.data(), image.size(), &cartridge));
+    EXPECT_FALSE(cartridge.nes2);
+    EXPECT_EQ(0, cartridge.mapper);
+    EXPECT_EQ(MIRROR_VERTICAL, cartridge.mirroring);
+    EXPECT_EQ(image.data() + 16, cartridge.prg);
+    EXPECT_EQ(16u * 1024, cartridge.prg_size);
+    EXPECT_EQ(image.data() + 16 + 16 * 1024, cartridge.chr);
+    EXPECT_EQ(8u * 1024, cartridge.chr_size);
+    EXPECT_EQ(8u * 1024, cartridge.prg_ram_size);
+
+    // Text in the padding means byte 7 is not trusted for the mapper.
+    image[7] = 0x40;
+    ASSERT_EQ(CARTRIDGE_OK, cartridge_parse(image.data(), image.size(), &cartridge));
+    EXPECT_EQ(0x40, cartridge.mapper);
+    image[12] = 'D';
+    ASSERT_EQ(CARTRIDGE_OK, cartridge_parse(image.data(), image.size(), &cartridge));
+    EXPECT_EQ(0, cartridge.mapper);
+}
+
+TEST(SUITE, check_cartridge_nes2_header) {
+    std::vector<uint8_t> image(16 + 512 + 64 * 1024 + 24 * 1024, 0);
+    const uint8_t header[] = {'N', 'E', 'S', 0x1A, 4, 3, 0x46, 0x48, 0x31, 0x00, 0x07, 0x00};
+    std::copy(header, header + sizeof(header), image.begin());
+    Cartridge cartridge;
+    ASSERT_EQ(CARTRIDGE_OK, cartridge_parse(image.data(), image.size(), &cartridge));
+    EXPECT_TRUE(cartridge.nes2);
+    EXPECT_EQ(0x144, cartridge.mapper);
+    EXPECT_EQ(3, cartridge.submapper);
+    EXPECT_TRUE(cartridge.battery);
+    EXPECT_EQ(image.data() + 16 + 512, cartridge.prg);
+    EXPECT_EQ(64u * 1024, cartridge.prg_size);
+    EXPECT_EQ(24u * 1024, cartridge.chr_size);
+    EXPECT_EQ(8u * 1024, cartridge.prg_ram_size);
+
+    // Exponent-multiplier size: 2^15 * 3 = 96KB of CHR, more than is there.
+    image[5] = (15 << 2) | 1;
+    image[9] = 0xF0;
+    EXPECT_EQ(CARTRIDGE_ERROR_TRUNCATED, cartridge_parse(image.data(), image.size(), &cartridge));
+    image.resize(16 + 512 + 64 * 1024 + 96 * 1024);
+    ASSERT_EQ(CARTRIDGE_OK, cartridge_parse(image.data(), image.size(), &cartridge));
+    EXPECT_EQ(96u * 1024, cartridge.chr_size);
+
+    // 2^63 bytes of each, whose sum wraps to zero.
+    image[4] = 63 << 2;
+    image[5] = 63 << 2;
+    image[9] = 0xFF;
+    EXPECT_EQ(CARTRIDGE_ERROR_TRUNCATED, cartridge_parse(image.data(), image.size(), &cartridge));
+}
+
+TEST(SUITE, check_cartridge_errors) {
+    std::vector<uint8_t> image = nrom_image();
+    Cartridge cartridge;
+    EXPECT_EQ(CARTRIDGE_ERROR_TRUNCATED, cartridge_parse(image.data(), image.size() - 1, &cartridge));
+    image[4] = 0;
+    EXPECT_EQ(CARTRIDGE_ERROR_UNSUPPORTED, cartridge_parse(image.data(), image.size(), &cartridge));
+    image[0] = 'X';
+    EXPECT_EQ(CARTRIDGE_ERROR_MAGIC, cartridge_parse(image.data(), image.size(), &cartridge));
+
+    enum CartridgeError error;
+    EXPECT_EQ(nullptr, cartridge_open("/nonexistent/macnes.nes", &error));
+    EXPECT_EQ(CARTRIDGE_ERROR_IO, error);
+}
+
+TEST(SUITE, check_cartridge_shared_between_machines) {
+    std::string path = temp_path("cartridge");
+    write_file(path, nrom_image());
+    Cartridge *cartridge = cartridge_open(path.c_str(), NULL);
+    ASSERT_NE(nullptr, cartridge);
+
+    NES a = nes_init();
+    NES b = nes_init();
+    nes_insert_cartridge(a, cartridge);
+    nes_insert_cartridge(b, cartridge);
+    NES child = nes_fork(a);
+    cartridge_release(cartridge);
+    EXPECT_EQ(3u, cartridge->refs);
+
+    for (NES nes : {a, b, child}) {
+        EXPECT_EQ(cartridge->prg, nes.bus->read_map[0x80]);
+        EXPECT_EQ(cartridge->prg, nes.bus->read_map[0xC0]);
+        EXPECT_EQ(cartridge->chr + 3 * 1024, nes.bus->chr_map[3]);
+        EXPECT_EQ(0xE6, bus_read(nes.bus, 0x8000));
+        EXPECT_EQ(0xC0, bus_read(nes.bus, 0xFFFD));
+    }
+    EXPECT_EQ(0xC000, a.cpu->pc);
+
+    // ROM ignores writes.
+    bus_write(a.bus, 0xC000, 0xEA);
+    EXPECT_EQ(0xE6, bus_read(a.bus, 0xC000));
+
+    NesInput input = {{0, 0}};
+    nes_run_frame(a, input, NULL);
+    EXPECT_NE(0, ram_read(a.ram, 0x11));
+
+    nes_shutdown(a);
+    nes_shutdown(child);
+    EXPECT_EQ(1u, cartridge->refs);
+    EXPECT_EQ(0xE6, bus_read(b.bus, 0xC000));
+    nes_shutdown(b);
+    unlink(path.c_str());
+}
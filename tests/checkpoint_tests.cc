@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "savestate.h"
+    #include "checkpoint.h"
+}
+#include "test_machines.h"
+#define SUITE CHECKPOINT
+
+struct Completions {
+    std::vector<std::string> paths;
+    std::vector<int> errors;
+};
+
+static void record_completion(void *context, const char *path, int error) {
+    Completions *completions = (Completions*) context;
+    completions->paths.push_back(path);
+    completions->errors.push_back(error);
+}
+
+static std::vector<uint8_t> read_file(const std::string &path) {
+    std::vector<uint8_t> data;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return data;
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.insert(data.end(), buffer, buffer + read);
+    fclose(f);
+    return data;
+}
+
+static void check_backend(enum CheckpointBackend backend) {
+    Checkpoint *checkpoint = checkpoint_init(4, backend);
+    if (!checkpoint) GTEST_SKIP() << "backend unavailable";
+    EXPECT_EQ(backend, checkpoint->backend);
+
+    const int count = 24;
+    NES nes = counting_machine();
+
+    std::vector<NesState*> states;
+    std::vector<std::string> paths;
+    Completions completions;
+    NesInput input = {{0, 0}};
+    for (int i = 0; i < count; i++) {
+        nes_run_frame(nes, input, NULL);
+        states.push_back(nes_state_init());
+        nes_snapshot(nes, states.back());
+        paths.push_back("/tmp/macnes-checkpoint-" + std::to_string(getpid()) + "-" + std::to_string(i) + ".state");
+        ASSERT_TRUE(checkpoint_write(checkpoint, paths.back().c_str(), states.back(), record_completion, &completions));
+    }
+    ASSERT_TRUE(checkpoint_write(checkpoint, "/nonexistent/macnes.state", states[0], record_completion, &completions));
+    // Nothing calls back outside poll and drain.
+    EXPECT_TRUE(completions.paths.empty());
+    checkpoint_poll(checkpoint);
+    checkpoint_drain(checkpoint);
+    EXPECT_EQ(0u, checkpoint->pending);
+    ASSERT_EQ((size_t) count + 1, completions.paths.size());
+
+    std::vector<uint8_t> expected(savestate_size());
+    for (int i = 0; i < count; i++) {
+        savestate_encode(states[i], expected.data());
+        EXPECT_EQ(expected, read_file(paths[i]));
+        NES loaded = nes_init();
+        EXPECT_EQ(SAVESTATE_OK, savestate_load(loaded, paths[i].c_str()));
+        EXPECT_EQ(states[i]->cpu.clock_count, loaded.cpu->clock_count);
+        nes_shutdown(loaded);
+    }
+    for (size_t i = 0; i < completions.paths.size(); i++) {
+        if (completions.paths[i] == "/nonexistent/macnes.state") EXPECT_EQ(ENOENT, completions.errors[i]);
+        else EXPECT_EQ(0, completions.errors[i]);
+    }
+
+    checkpoint_destroy(checkpoint);
+    for (int i = 0; i < count; i++) {
+        unlink(paths[i].c_str());
+        nes_state_destroy(states[i]);
+    }
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_checkpoint_io_uring) {
+    check_backend(CHECKPOINT_IO_URING);
+}
+
+TEST(SUITE, check_checkpoint_threads) {
+    check_backend(CHECKPOINT_THREADS);
+}
+
+TEST(SUITE, check_checkpoint_destroy_waits) {
+    Checkpoint *checkpoint = checkpoint_init(2, CHECKPOINT_AUTO);
+    ASSERT_NE(nullptr, checkpoint);
+    NesState *state = nes_state_init();
+    Completions completions;
+    std::string path = "/tmp/macnes-checkpoint-" + std::to_string(getpid()) + ".state";
+    checkpoint_write(checkpoint, path.c_str(), state, record_completion, &completions);
+    checkpoint_destroy(checkpoint);
+    EXPECT_EQ(1u, completions.paths.size());
+    EXPECT_EQ(savestate_size(), read_file(path).size());
+    unlink(path.c_str());
+    nes_state_destroy(state);
+}
+
+TEST(SUITE, check_checkpoint_ring_failure) {
+    Checkpoint *checkpoint = checkpoint_init(2, CHECKPOINT_IO_URING);
+    if (!checkpoint) GTEST_SKIP() << "backend unavailable";
+    // A descriptor that is not a ring makes every io_uring_enter fail.
+    int ring = checkpoint->ring.fd;
+    checkpoint->ring.fd = open("/dev/null", O_RDONLY);
+    NesState *state = nes_state_init();
+    Completions completions;
+    std::string path = "/tmp/macnes-checkpoint-" + std::to_string(getpid()) + ".state";
+    for (int i = 0; i < 4; i++)
+        ASSERT_TRUE(checkpoint_write(checkpoint, path.c_str(), state, record_completion, &completions));
+    checkpoint_drain(checkpoint);
+    ASSERT_EQ(4u, completions.errors.size());
+    for (int error : completions.errors) EXPECT_NE(0, error);
+
+    checkpoint_destroy(checkpoint);
+    close(ring);
+    unlink(path.c_str());
+    nes_state_destroy(state);
+}
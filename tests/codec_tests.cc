@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+extern "C" {
+    #include "codec.h"
+}
+#define SUITE CODEC
+
+TEST(SUITE, check_codec_roundtrip) {
+    std::vector<uint8_t> in(5000, 0);
+    for (size_t i = 100; i < 140; i++) in[i] = (uint8_t) i;
+    in[2000] = 1;
+    in[2002] = 2;
+    in[4999] = 0xFF;
+    std::vector<uint8_t> packed(codec_bound(in.size()));
+    std::vector<uint8_t> out(in.size(), 0xAA);
+
+    size_t size = codec_compress(in.data(), in.size(), packed.data(), packed.size());
+    size_t produced = codec_decompress(packed.data(), size, out.data(), out.size());
+
+    EXPECT_LT(size, 80u);
+    EXPECT_EQ(in.size(), produced);
+    EXPECT_EQ(in, out);
+}
+
+TEST(SUITE, check_codec_incompressible) {
+    std::vector<uint8_t> in(1000);
+    for (size_t i = 0; i < in.size(); i++) in[i] = (uint8_t) (i * 7 + 1) | 1;
+    std::vector<uint8_t> packed(codec_bound(in.size()));
+    std::vector<uint8_t> out(in.size());
+
+    size_t size = codec_compress(in.data(), in.size(), packed.data(), packed.size());
+
+    EXPECT_LE(size, in.size() + 4);
+    EXPECT_EQ(in.size(), codec_decompress(packed.data(), size, out.data(), out.size()));
+    EXPECT_EQ(in, out);
+}
+
+TEST(SUITE, check_codec_xor_delta) {
+    std::vector<uint8_t> base(4096);
+    for (size_t i = 0; i < base.size(); i++) base[i] = (uint8_t) (i * 31);
+    std::vector<uint8_t> in = base;
+    in[10] ^= 0x55;
+    in[3000] = 0;
+    std::vector<uint8_t> packed(codec_bound(in.size()));
+
+    size_t size = codec_compress_xor(in.data(), base.data(), in.size(), packed.data(), packed.size());
+    std::vector<uint8_t> out = base;
+    size_t produced = codec_apply_xor(packed.data(), size, out.data(), out.size());
+
+    EXPECT_LT(size, 16u);
+    EXPECT_EQ(in.size(), produced);
+    EXPECT_EQ(in, out);
+}
+
+TEST(SUITE, check_codec_small_capacity) {
+    std::vector<uint8_t> in(64, 1);
+    uint8_t packed[8];
+
+    EXPECT_EQ(0u, codec_compress(in.data(), in.size(), packed, sizeof(packed)));
+}
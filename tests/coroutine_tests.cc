@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+extern "C" {
+    #include "defs.h"
+    #include "coroutine.h"
+}
+#define SUITE COROUTINE
+
+// Coroutines
+
+struct Counter {
+    Coroutine *self;
+    std::vector<int> *log;
+    int steps;
+};
+
+static void count_entry(void *context) {
+    Counter *counter = (Counter*) context;
+    double scale = 0.5;
+    for (int i = 0; i < counter->steps; i++) {
+        counter->log->push_back(i * 10 + (int) (scale * 2));
+        scale += 1.0;
+        coroutine_yield(counter->self);
+    }
+}
+
+TEST(SUITE, check_coroutine_resume_yield) {
+    std::vector<int> log;
+    Counter counter = {NULL, &log, 3};
+    Coroutine *coroutine = coroutine_init(count_entry, &counter, 0);
+    ASSERT_NE(nullptr, coroutine);
+    counter.self = coroutine;
+
+    EXPECT_TRUE(coroutine_resume(coroutine));
+    EXPECT_EQ(std::vector<int>({1}), log);
+    EXPECT_TRUE(coroutine_resume(coroutine));
+    EXPECT_TRUE(coroutine_resume(coroutine));
+    EXPECT_EQ(std::vector<int>({1, 13, 25}), log);
+    EXPECT_FALSE(coroutine_resume(coroutine));
+    EXPECT_FALSE(coroutine_resume(coroutine));
+    EXPECT_EQ(3u, log.size());
+
+    coroutine_destroy(coroutine);
+}
+
+TEST(SUITE, check_coroutine_interleaved) {
+    const int count = 64;
+    std::vector<int> logs[count];
+    Counter counters[count];
+    Coroutine *coroutines[count];
+    for (int i = 0; i < count; i++) {
+        counters[i] = {NULL, &logs[i], i % 5 + 1};
+        coroutines[i] = coroutine_init(count_entry, &counters[i], 16 * 1024);
+        ASSERT_NE(nullptr, coroutines[i]);
+        counters[i].self = coroutines[i];
+    }
+
+    int running = count;
+    while (running) {
+        running = 0;
+        for (int i = 0; i < count; i++) running += coroutine_resume(coroutines[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        ASSERT_EQ((size_t) (i % 5 + 1), logs[i].size());
+        EXPECT_EQ((i % 5) * 10 + (i % 5) * 2 + 1, logs[i].back());
+        coroutine_destroy(coroutines[i]);
+    }
+}
+
+
+
+// Scheduler
+
+struct Machine {
+    uint64_t timer;
+    uint64_t reads;
+    uint64_t stale;
+};
+
+// Counts one per cycle, only stopping when the reader is behind it.
+static void timer_entry(Scheduler *scheduler, uint32_t component, void *context) {
+    Machine *machine = (Machine*) context;
+    for (;;) {
+        scheduler_advance(scheduler, component, 1);
+        machine->timer++;
+        scheduler_sync(scheduler, component);
+    }
+}
+
+// Mostly private work in steps of three cycles, with a read of the timer
+// every tenth step that must see it caught up.
+static void reader_entry(Scheduler *scheduler, uint32_t component, void *context) {
+    Machine *machine = (Machine*) context;
+    for (uint64_t step = 0;; step++) {
+        if (step % 10 == 0) {
+            scheduler_sync(scheduler, component);
+            machine->reads++;
+            if (machine->timer < scheduler->components[component].clock) machine->stale++;
+        }
+        scheduler_advance(scheduler, component, 3);
+    }
+}
+
+TEST(SUITE, check_scheduler_sync) {
+    Scheduler *scheduler = scheduler_init();
+    Machine machine = {0, 0, 0};
+    ASSERT_EQ(0, scheduler_add(scheduler, reader_entry, &machine, 0));
+    ASSERT_EQ(1, scheduler_add(scheduler, timer_entry, &machine, 0));
+
+    scheduler_run(scheduler, 3000);
+    EXPECT_GE(scheduler->components[0].clock, 3000u);
+    EXPECT_GE(scheduler->components[1].clock, 3000u);
+    EXPECT_LT(scheduler->components[0].clock, 3000u + 30);
+    EXPECT_EQ(scheduler->components[1].clock, machine.timer);
+    EXPECT_EQ(100u, machine.reads);
+    EXPECT_EQ(0u, machine.stale);
+
+    // The reader only gives way at its reads.
+    EXPECT_LE(scheduler->switches, 2 * machine.reads + 2);
+
+    uint64_t switches = scheduler->switches;
+    scheduler_run(scheduler, 6000);
+    EXPECT_EQ(200u, machine.reads);
+    EXPECT_EQ(0u, machine.stale);
+    EXPECT_GT(scheduler->switches, switches);
+
+    scheduler_destroy(scheduler);
+}
+
+static void finite_entry(Scheduler *scheduler, uint32_t component, void *context) {
+    for (int i = 0; i < 5; i++) {
+        scheduler_advance(scheduler, component, 10);
+        scheduler_sync(scheduler, component);
+    }
+    (*(int*) context)++;
+}
+
+// Steps of ten cycles with a wait halfway, which a run must not end at.
+static void halves_entry(Scheduler *scheduler, uint32_t component, void *context) {
+    (void) context;
+    for (;;) {
+        scheduler_advance(scheduler, component, 5);
+        scheduler_wait(scheduler, component);
+        scheduler_advance(scheduler, component, 5);
+        scheduler_sync(scheduler, component);
+    }
+}
+
+TEST(SUITE, check_scheduler_wait) {
+    Scheduler *scheduler = scheduler_init();
+    Machine machine = {0, 0, 0};
+    ASSERT_EQ(0, scheduler_add(scheduler, timer_entry, &machine, 0));
+    ASSERT_EQ(1, scheduler_add(scheduler, halves_entry, NULL, 0));
+
+    for (uint64_t until : {3u, 1001u, 1007u}) {
+        scheduler_run(scheduler, until);
+        EXPECT_FALSE(scheduler->active);
+        EXPECT_FALSE(scheduler->components[1].busy);
+        EXPECT_EQ(0u, scheduler->components[1].clock % 10);
+        EXPECT_GE(scheduler->components[1].clock, until);
+        EXPECT_GE(machine.timer, until);
+    }
+    scheduler_destroy(scheduler);
+}
+
+TEST(SUITE, check_scheduler_finished_component) {
+    Scheduler *scheduler = scheduler_init();
+    int finished = 0;
+    Machine machine = {0, 0, 0};
+    ASSERT_EQ(0, scheduler_add(scheduler, finite_entry, &finished, 0));
+    ASSERT_EQ(1, scheduler_add(scheduler, timer_entry, &machine, 0));
+    scheduler_run(scheduler, 200);
+    EXPECT_EQ(1, finished);
+    EXPECT_EQ(50u, scheduler->components[0].clock);
+    EXPECT_EQ(200u, machine.timer);
+    scheduler_destroy(scheduler);
+}
@@ -1,10 +1,13 @@
 #include <gtest/gtest.h>
+#include <vector>
 
 extern "C" {
     #include "cpu.c"
     #include "defs.h"
     #include "nes.h"
+    #include "controller.h"
 }
+#include "test_machines.h"
 #define SUITE CPU
 
 // Flags
@@ -877,3 +880,390 @@ TEST(SUITE, check_i_clv) {
     nes_shutdown(nes);
 }
 
+
+
+
+// Execution
+
+TEST(SUITE, check_cpu_step) {
+    NES nes = nes_init();
+    CPU *cpu = nes.cpu;
+    ram_write(nes.ram, 0, 0xA9);
+    ram_write(nes.ram, 1, 0x42);
+
+    uint8_t cycles = cpu_step(cpu);
+
+    EXPECT_EQ(2, cycles);
+    EXPECT_EQ(0x42, cpu->a);
+    EXPECT_EQ(2, cpu->pc);
+    EXPECT_EQ(2u, cpu->clock_count);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_cpu_step_branch_taken) {
+    NES nes = nes_init();
+    CPU *cpu = nes.cpu;
+    ram_write(nes.ram, 0, 0xD0);
+    ram_write(nes.ram, 1, 0x02);
+
+    uint8_t cycles = cpu_step(cpu);
+
+    EXPECT_EQ(3, cycles);
+    EXPECT_EQ(4, cpu->pc);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_cpu_step_after_implied) {
+    NES nes = nes_init();
+    CPU *cpu = nes.cpu;
+    ram_write(nes.ram, 0, 0xE8);
+    ram_write(nes.ram, 1, 0xA5);
+    ram_write(nes.ram, 2, 0x10);
+    ram_write(nes.ram, 0x10, 0x33);
+
+    cpu_step(cpu);
+    cpu_step(cpu);
+
+    EXPECT_EQ(0x33, cpu->a);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_cpu_clock_matches_step) {
+    NES nes = nes_init();
+    CPU *cpu = nes.cpu;
+    ram_write(nes.ram, 0, 0xA9);
+    ram_write(nes.ram, 1, 0x42);
+
+    cpu_clock(cpu);
+
+    EXPECT_EQ(1, cpu->cycles);
+    EXPECT_EQ(1, cpu_step(cpu));
+    EXPECT_EQ(2u, cpu->clock_count);
+
+    nes_shutdown(nes);
+}
+
+
+
+// Fused dispatch
+
+// Loops over every fused pair, splitting some of them across frames.
+static const uint8_t PAIR_PROGRAM[] = {
+    0xA2, 0x00, 0xBD, 0x00, 0x80, 0x9D, 0x00, 0x02, 0xE8, 0xE0, 0x20, 0xD0, 0xF5, 0xA0, 0x04,
+    0x18, 0x69, 0x03, 0x99, 0x00, 0x03, 0x88, 0xD0, 0xF7, 0xA0, 0x03, 0x88, 0xD0, 0xFD, 0xE8,
+    0xD0, 0xE0,
+};
+
+TEST(SUITE, check_fused_matches_single) {
+    NES single = nes_init(), fused = nes_init();
+    load_program(single, PAIR_PROGRAM, sizeof(PAIR_PROGRAM));
+    load_program(fused, PAIR_PROGRAM, sizeof(PAIR_PROGRAM));
+    nes_set_dispatch(fused, CPU_DISPATCH_FUSED);
+    NesInput input = {{0, 0}};
+
+    for (int frame = 0; frame < 20; frame++) {
+        nes_run_frame(single, input, NULL);
+        nes_run_frame(fused, input, NULL);
+        ASSERT_EQ(single.cpu->clock_count, fused.cpu->clock_count);
+        ASSERT_EQ(single.cpu->pc, fused.cpu->pc);
+        ASSERT_EQ(single.cpu->opcode, fused.cpu->opcode);
+        ASSERT_EQ(single.cpu->a, fused.cpu->a);
+        ASSERT_EQ(single.cpu->x, fused.cpu->x);
+        ASSERT_EQ(single.cpu->y, fused.cpu->y);
+        ASSERT_EQ(single.cpu->status, fused.cpu->status);
+        ASSERT_EQ(ram_read(single.ram, 0x21F), ram_read(fused.ram, 0x21F));
+        ASSERT_EQ(ram_read(single.ram, 0x301), ram_read(fused.ram, 0x301));
+        ASSERT_EQ(ram_read(single.ram, 0x304), ram_read(fused.ram, 0x304));
+    }
+
+    // The mode belongs to the machine, not its state.
+    NesState *state = nes_state_init();
+    nes_snapshot(single, state);
+    nes_restore(fused, state);
+    EXPECT_EQ(CPU_DISPATCH_FUSED, fused.cpu->dispatch);
+    nes_state_destroy(state);
+
+    nes_shutdown(single);
+    nes_shutdown(fused);
+}
+
+TEST(SUITE, check_cpu_step_fused_stops_at_until) {
+    NES nes = nes_init();
+    const uint8_t program[] = {0x88, 0xD0, 0xFD};
+    load_program(nes, program, sizeof(program));
+    CPU *cpu = nes.cpu;
+    cpu_step(cpu);
+
+    EXPECT_EQ(5, cpu_step_fused(cpu, UINT64_MAX));
+    EXPECT_EQ(0x8000, cpu->pc);
+    EXPECT_EQ(0xD0, cpu->opcode);
+    EXPECT_EQ(2, cpu_step_fused(cpu, cpu->clock_count + 1));
+    EXPECT_EQ(0x8001, cpu->pc);
+    EXPECT_EQ(0xFE, cpu->y);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_profile_pairs) {
+    NES nes = nes_init();
+    const uint8_t program[] = {0xCA, 0xD0, 0xFD, 0x4C, 0x00, 0x80};
+    load_program(nes, program, sizeof(program));
+    CpuPairProfile *profile = (CpuPairProfile*) malloc(sizeof(CpuPairProfile));
+    cpu_profile_reset(profile);
+    nes_profile_pairs(nes, profile);
+    NesInput input = {{0, 0}};
+    nes_run_frame(nes, input, NULL);
+    nes_profile_pairs(nes, NULL);
+
+    CpuPairCount top[4];
+    ASSERT_EQ(4u, cpu_profile_top(profile, top, 4));
+    EXPECT_EQ(0xCA, top[0].first);
+    EXPECT_EQ(0xD0, top[0].second);
+    EXPECT_EQ(0xD0, top[1].first);
+    EXPECT_EQ(0xCA, top[1].second);
+    EXPECT_GT(top[1].count, 100u * top[2].count);
+    uint64_t total = 0;
+    for (int first = 0; first < 256; first++)
+        for (int second = 0; second < 256; second++) total += profile->counts[first][second];
+    EXPECT_EQ(top[0].count + top[1].count + top[2].count + top[3].count, total);
+
+    free(profile);
+    nes_shutdown(nes);
+}
+
+
+
+// Accuracy tiers
+
+TEST(SUITE, check_accurate_matches_fast) {
+    NES fast = nes_init(), accurate = nes_init();
+    load_program(fast, PAIR_PROGRAM, sizeof(PAIR_PROGRAM));
+    load_program(accurate, PAIR_PROGRAM, sizeof(PAIR_PROGRAM));
+    nes_set_tier(accurate, CPU_TIER_ACCURATE);
+    NesInput input = {{0, 0}};
+
+    for (int frame = 0; frame < 10; frame++) {
+        nes_run_frame(fast, input, NULL);
+        nes_run_frame(accurate, input, NULL);
+        ASSERT_EQ(fast.cpu->clock_count, accurate.cpu->clock_count);
+        ASSERT_EQ(fast.cpu->pc, accurate.cpu->pc);
+        ASSERT_EQ(fast.cpu->a, accurate.cpu->a);
+        ASSERT_EQ(fast.cpu->x, accurate.cpu->x);
+        ASSERT_EQ(fast.cpu->status, accurate.cpu->status);
+        ASSERT_EQ(ram_read(fast.ram, 0x10), ram_read(accurate.ram, 0x10));
+        ASSERT_EQ(ram_read(fast.ram, 0x11), ram_read(accurate.ram, 0x11));
+    }
+
+    NesState *state = nes_state_init();
+    nes_snapshot(fast, state);
+    nes_restore(accurate, state);
+    EXPECT_EQ(CPU_TIER_ACCURATE, accurate.cpu->tier);
+    nes_state_destroy(state);
+
+    nes_shutdown(fast);
+    nes_shutdown(accurate);
+}
+
+TEST(SUITE, check_accurate_dummy_read) {
+    // LDA $40FF,X with X = $17 reads $4016 before carrying into $4116,
+    // which shifts the pad on hardware. The read of $4016 after it then
+    // sees B rather than A.
+    const uint8_t program[] = {
+        0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40, 0xA2, 0x17,
+        0xBD, 0xFF, 0x40, 0xAD, 0x16, 0x40, 0x85, 0x10, 0x4C, 0x14, 0x80,
+    };
+    uint8_t results[2];
+    uint64_t cycles[2] = {0, 0};
+    for (int tier = 0; tier < 2; tier++) {
+        NES nes = nes_init();
+        load_program(nes, program, sizeof(program));
+        controller_set(nes.controller, 0, 0x01);
+        while (nes.cpu->pc != 0x8014) cycles[tier] += tier ? cpu_step_accurate(nes.cpu) : cpu_step(nes.cpu);
+        results[tier] = ram_read(nes.ram, 0x10);
+        nes_shutdown(nes);
+    }
+    EXPECT_EQ(0x41, results[0]);
+    EXPECT_EQ(0x40, results[1]);
+    EXPECT_EQ(cycles[0], cycles[1]);
+}
+
+// Strobes and latches pad 0 with A held, stores zero through `store`
+// (X = Y = 0, $20 pointing at $4016) and reads the pad into $10.
+static uint8_t store_then_read_pad(const std::vector<uint8_t> &store, bool accurate) {
+    std::vector<uint8_t> program = {
+        0xA9, 0x16, 0x85, 0x20, 0xA9, 0x40, 0x85, 0x21, 0xA2, 0x00, 0xA0, 0x00,
+        0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40,
+    };
+    program.insert(program.end(), store.begin(), store.end());
+    uint16_t end = (uint16_t) (0x8000 + program.size() + 5);
+    program.insert(program.end(), {0xAD, 0x16, 0x40, 0x85, 0x10, 0x4C, (uint8_t) end, (uint8_t) (end >> 8)});
+    NES nes = nes_init();
+    load_program(nes, program.data(), program.size());
+    controller_set(nes.controller, 0, 0x01);
+    while (nes.cpu->pc != end) accurate ? cpu_step_accurate(nes.cpu) : cpu_step(nes.cpu);
+    uint8_t result = ram_read(nes.ram, 0x10);
+    nes_shutdown(nes);
+    return result;
+}
+
+TEST(SUITE, check_accurate_store_dummy_read) {
+    // Stores read their target before writing it even without a page
+    // crossing, shifting the pad; writing 0 with the strobe low keeps
+    // the shifted state, so the next read sees B.
+    const std::vector<uint8_t> stores[] = {
+        {0x9D, 0x16, 0x40},   // STA $4016,X
+        {0x99, 0x16, 0x40},   // STA $4016,Y
+        {0x91, 0x20},         // STA ($20),Y
+    };
+    for (const std::vector<uint8_t> &store : stores) {
+        EXPECT_EQ(0x41, store_then_read_pad(store, false)) << std::hex << (int) store[0];
+        EXPECT_EQ(0x40, store_then_read_pad(store, true)) << std::hex << (int) store[0];
+    }
+}
+
+static uint64_t recorded_clock;
+static uint8_t recorded_data;
+
+static void record_event(Bus *bus, uint64_t clock) {
+    recorded_clock = clock;
+    recorded_data = bus_read(bus, 0x0200);
+    bus->mapper_state.next_event = MAPPER_NO_EVENT;
+}
+
+static void ignore_write(Bus *bus, uint16_t address, uint8_t data) {
+    (void) bus;
+    (void) address;
+    (void) data;
+}
+
+static const Mapper RECORDER = {0xFFFF, "recorder", NULL, ignore_write, NULL, record_event};
+
+TEST(SUITE, check_accurate_write_cycle) {
+    // Each instruction's last access writes $0200 with X = Y = 0: the
+    // event set for that cycle fires before it, still seeing $05.
+    struct {
+        uint8_t     bytes[3];
+        uint8_t     cycles;
+        uint8_t     result;
+    } cases[] = {
+        {{0x9D, 0x00, 0x02}, 5, 0x07},    // STA $0200,X
+        {{0x99, 0x00, 0x02}, 5, 0x07},    // STA $0200,Y
+        {{0x91, 0x20, 0xEA}, 6, 0x07},    // STA ($20),Y
+        {{0xFE, 0x00, 0x02}, 7, 0x06},    // INC $0200,X
+        {{0x1E, 0x00, 0x02}, 7, 0x0A},    // ASL $0200,X
+    };
+    for (const auto &c : cases) {
+        const uint8_t program[] = {
+            0xA9, 0x00, 0x85, 0x20, 0xA9, 0x02, 0x85, 0x21, 0xA2, 0x00, 0xA0, 0x00, 0xA9, 0x07,
+            c.bytes[0], c.bytes[1], c.bytes[2],
+        };
+        NES nes = nes_init();
+        load_program(nes, program, sizeof(program));
+        ram_write(nes.ram, 0x0200, 0x05);
+        while (nes.cpu->pc != 0x800E) cpu_step_accurate(nes.cpu);
+        uint64_t start = nes.cpu->clock_count;
+        nes.bus->mapper = &RECORDER;
+        nes.bus->mapper_state.next_event = start + c.cycles - 1;
+        recorded_clock = 0;
+
+        EXPECT_EQ(c.cycles, cpu_step_accurate(nes.cpu));
+        EXPECT_EQ(start + c.cycles - 1, recorded_clock) << std::hex << (int) c.bytes[0];
+        EXPECT_EQ(0x05, recorded_data) << std::hex << (int) c.bytes[0];
+        EXPECT_EQ(c.result, ram_read(nes.ram, 0x0200));
+
+        nes.bus->mapper = NULL;
+        nes_shutdown(nes);
+    }
+}
+
+
+
+// Instrumentation counters
+
+#if CPU_COUNTING
+
+TEST(SUITE, check_cpu_counters) {
+    NES nes = nes_init();
+    const uint8_t program[] = {
+        0xA2, 0x00,         // 8000 LDX #$00
+        0x3D, 0xFF, 0x80,   // 8002 AND $80FF,X
+        0xE8,               // 8005 INX
+        0xE0, 0x03,         // 8006 CPX #$03
+        0xD0, 0xF8,         // 8008 BNE $8002
+        0x4C, 0x0A, 0x80,   // 800A JMP $800A
+    };
+    load_program(nes, program, sizeof(program));
+    CpuCounters *counters = nes_counters(nes);
+    ASSERT_NE(nullptr, counters);
+    cpu_counters_reset(counters);
+    for (int i = 0; i < 15; i++) cpu_step(nes.cpu);
+    EXPECT_EQ(0x800Au, nes.cpu->pc);
+
+    EXPECT_EQ(14u, cpu_counters_instructions(counters));
+    EXPECT_EQ(3u, counters->executed[0x3D]);
+    EXPECT_EQ(1u, counters->executed[0x4C]);
+    EXPECT_EQ(2u, counters->page_crosses[0x3D]);
+    EXPECT_EQ(0u, counters->page_crosses[0xD0]);
+    EXPECT_EQ(2u, counters->taken[0xD0]);
+    EXPECT_EQ(1u, counters->not_taken[0xD0]);
+
+    // Indexed by cpu.h's am_ order, opcode fetches last.
+    EXPECT_EQ(0u, counters->reads[0]);
+    EXPECT_EQ(4u, counters->reads[1]);
+    EXPECT_EQ(3u, counters->reads[5]);
+    EXPECT_EQ(2u, counters->reads[6]);
+    EXPECT_EQ(9u, counters->reads[7]);
+    EXPECT_EQ(14u, counters->reads[CPU_MODE_COUNT]);
+
+    EXPECT_EQ(8u, counters->cycles[2]);
+    EXPECT_EQ(3u, counters->cycles[3]);
+    EXPECT_EQ(1u, counters->cycles[4]);
+    EXPECT_EQ(2u, counters->cycles[5]);
+
+    // Forks count on their own; totals combine machines.
+    NES child = nes_fork(nes);
+    EXPECT_NE(counters, nes_counters(child));
+    EXPECT_EQ(0u, cpu_counters_instructions(nes_counters(child)));
+    cpu_step(child.cpu);
+    CpuCounters total = {};
+    cpu_counters_add(&total, counters);
+    cpu_counters_add(&total, nes_counters(child));
+    EXPECT_EQ(15u, cpu_counters_instructions(&total));
+    EXPECT_EQ(2u, total.executed[0x4C]);
+    nes_shutdown(child);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_cpu_counters_fused_match) {
+    NES single = nes_init(), fused = nes_init();
+    load_program(single, PAIR_PROGRAM, sizeof(PAIR_PROGRAM));
+    load_program(fused, PAIR_PROGRAM, sizeof(PAIR_PROGRAM));
+    nes_set_dispatch(fused, CPU_DISPATCH_FUSED);
+    NesInput input = {{0, 0}};
+    for (int frame = 0; frame < 5; frame++) {
+        nes_run_frame(single, input, NULL);
+        nes_run_frame(fused, input, NULL);
+    }
+    const CpuCounters *a = nes_counters(single), *b = nes_counters(fused);
+    for (int opcode = 0; opcode < 256; opcode++) {
+        ASSERT_EQ(a->executed[opcode], b->executed[opcode]) << opcode;
+        ASSERT_EQ(a->taken[opcode], b->taken[opcode]) << opcode;
+    }
+    for (int mode = 0; mode <= CPU_MODE_COUNT; mode++) ASSERT_EQ(a->reads[mode], b->reads[mode]) << mode;
+    nes_shutdown(single);
+    nes_shutdown(fused);
+}
+
+#else
+
+TEST(SUITE, check_cpu_counters_compiled_out) {
+    NES nes = nes_init();
+    EXPECT_EQ(nullptr, nes_counters(nes));
+    nes_shutdown(nes);
+}
+
+#endif
@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "cartridge.h"
+    #include "debug.h"
+}
+#include "test_machines.h"
+#define SUITE DEBUG
+
+// UxROM: counts in X and $10, copies the first byte of the bank at $8000 to
+// $0200, then switches to bank X.
+static const std::vector<uint8_t> PROGRAM = {
+    0xA2, 0x00,             // C000 LDX #$00
+    0xE8,                   // C002 INX
+    0x86, 0x10,             // C003 STX $10
+    0xAD, 0x00, 0x80,       // C005 LDA $8000
+    0x8D, 0x00, 0x02,       // C008 STA $0200
+    0x8E, 0x00, 0x80,       // C00B STX $8000
+    0x4C, 0x02, 0xC0,       // C00E JMP $C002
+};
+
+// First byte of each 16KB bank: its number, or the program in the last one,
+// which is fixed at $C000.
+static uint8_t bank_start(int bank) {
+    return bank == 3 ? PROGRAM[0] : (uint8_t) bank;
+}
+
+static NES machine() {
+    std::vector<uint8_t> image = ines_image(2, 0x10000, 0x2000);
+    uint8_t *prg = image.data() + 16;
+    for (int bank = 0; bank < 3; bank++) prg[bank * 0x4000] = bank_start(bank);
+    std::copy(PROGRAM.begin(), PROGRAM.end(), prg + 0xC000);
+    prg[0xFFFC] = 0x00;
+    prg[0xFFFD] = 0xC0;
+    return machine_with(open_image("/tmp/macnes-debug-" + std::to_string(getpid()) + ".nes", image));
+}
+
+struct Hit {
+    DebugEvent  event;
+    uint16_t    address;
+    uint8_t     value;
+};
+
+struct Recorder {
+    std::vector<Hit>    hits;
+    bool                stop = false;
+};
+
+static bool record(void *context, enum DebugEvent event, uint16_t address, uint8_t value) {
+    Recorder *recorder = (Recorder*) context;
+    recorder->hits.push_back({event, address, value});
+    return recorder->stop;
+}
+
+static const NesInput NO_INPUT = {{0, 0}};
+
+TEST(SUITE, check_debug_watch_ram) {
+    NES plain = machine(), watched = machine();
+    Recorder recorder;
+    Debug *debug = debug_init(record, &recorder);
+    debug_watch(debug, 0x0010, DEBUG_WRITE);
+    debug_watch(debug, 0x0011, DEBUG_READ | DEBUG_WRITE);
+    nes_attach_debug(watched, debug);
+    EXPECT_EQ(BUS_TRAP_WATCH, watched.bus->trap_map[0x00]);
+
+    NesFrameResult a = nes_run_frame(plain, NO_INPUT, NULL);
+    NesFrameResult b = nes_run_frame(watched, NO_INPUT, NULL);
+    EXPECT_EQ(a.cycles, b.cycles);
+    EXPECT_EQ(0u, b.events & NES_EVENT_BREAK);
+    EXPECT_EQ(plain.cpu->x, watched.cpu->x);
+    EXPECT_EQ(bus_read(plain.bus, 0x0010), bus_read(watched.bus, 0x0010));
+
+    // One write per loop, each of the new count; $0011 is never touched.
+    ASSERT_FALSE(recorder.hits.empty());
+    for (size_t i = 0; i < recorder.hits.size(); i++) {
+        EXPECT_EQ(DEBUG_WRITE, recorder.hits[i].event);
+        EXPECT_EQ(0x0010, recorder.hits[i].address);
+        EXPECT_EQ((uint8_t) (i + 1), recorder.hits[i].value);
+    }
+    EXPECT_EQ(watched.cpu->x, recorder.hits.back().value);
+
+    debug_watch(debug, 0x0010, 0);
+    EXPECT_EQ(BUS_TRAP_WATCH, watched.bus->trap_map[0x00]);
+    debug_watch(debug, 0x0011, 0);
+    EXPECT_EQ(0, watched.bus->trap_map[0x00]);
+
+    debug_destroy(debug);
+    nes_shutdown(plain);
+    nes_shutdown(watched);
+}
+
+TEST(SUITE, check_debug_watch_rom) {
+    NES nes = machine();
+    Recorder recorder;
+    Debug *debug = debug_init(record, &recorder);
+    debug_watch(debug, 0x8000, DEBUG_READ | DEBUG_WRITE);
+    nes_attach_debug(nes, debug);
+    EXPECT_EQ(nullptr, nes.bus->read_map[0x80]);
+    nes_run_frame(nes, NO_INPUT, NULL);
+
+    // Reads see the bank selected by the previous loop, and writes to the
+    // trapped page still reach the mapper.
+    ASSERT_GT(recorder.hits.size(), 8u);
+    for (size_t i = 0; i + 1 < recorder.hits.size(); i += 2) {
+        uint8_t count = (uint8_t) (i / 2 + 1);
+        EXPECT_EQ(DEBUG_READ, recorder.hits[i].event);
+        EXPECT_EQ(bank_start((count - 1) & 3), recorder.hits[i].value);
+        EXPECT_EQ(DEBUG_WRITE, recorder.hits[i + 1].event);
+        EXPECT_EQ(count, recorder.hits[i + 1].value);
+    }
+
+    // Forks map the page directly; detaching restores it.
+    NES child = nes_fork(nes);
+    EXPECT_EQ(nes.bus->rom_map[0x80], child.bus->read_map[0x80]);
+    EXPECT_EQ(0, child.bus->trap_map[0x80]);
+    nes_shutdown(child);
+    uint8_t bank = recorder.hits.back().event == DEBUG_WRITE ? recorder.hits.back().value
+                                                             : recorder.hits[recorder.hits.size() - 2].value;
+    nes_attach_debug(nes, NULL);
+    EXPECT_EQ(nullptr, nes.bus->debug);
+    EXPECT_EQ(nes.bus->rom_map[0x80], nes.bus->read_map[0x80]);
+    EXPECT_EQ(bank_start(bank & 3), bus_read(nes.bus, 0x8000));
+
+    debug_destroy(debug);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_debug_breakpoint) {
+    NES nes = machine();
+    Recorder recorder;
+    recorder.stop = true;
+    Debug *debug = debug_init(record, &recorder);
+    debug_break(debug, 0xC00B, true);
+    nes_attach_debug(nes, debug);
+
+    NesFrameResult result = nes_run_frame(nes, NO_INPUT, NULL);
+    EXPECT_TRUE(result.events & NES_EVENT_BREAK);
+    EXPECT_EQ(0xC00B, nes.cpu->pc);
+    EXPECT_EQ(1, nes.cpu->x);
+    ASSERT_EQ(1u, recorder.hits.size());
+    EXPECT_EQ(DEBUG_EXECUTE, recorder.hits[0].event);
+    EXPECT_EQ(0xC00B, recorder.hits[0].address);
+    EXPECT_EQ(0x8E, recorder.hits[0].value);
+
+    // Resuming runs the stopped instruction and breaks on the next pass.
+    result = nes_run_frame(nes, NO_INPUT, NULL);
+    EXPECT_TRUE(result.events & NES_EVENT_BREAK);
+    EXPECT_EQ(0xC00B, nes.cpu->pc);
+    EXPECT_EQ(2, nes.cpu->x);
+
+    // Without it, the same frame runs to its end.
+    debug_break(debug, 0xC00B, false);
+    uint64_t before = nes.cpu->clock_count;
+    result = nes_run_frame(nes, NO_INPUT, NULL);
+    EXPECT_EQ(0u, result.events & NES_EVENT_BREAK);
+    EXPECT_EQ(before + result.cycles, nes.cpu->clock_count);
+    EXPECT_GE(nes.cpu->clock_count, NES_FRAME_CYCLES_X2 / 2);
+    EXPECT_LT(nes.cpu->clock_count, NES_FRAME_CYCLES_X2 / 2 + 8);
+
+    debug_destroy(debug);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_debug_watch_stops) {
+    NES nes = machine();
+    Recorder recorder;
+    recorder.stop = true;
+    Debug *debug = debug_init(record, &recorder);
+    debug_watch(debug, 0x0200, DEBUG_WRITE);
+    nes_attach_debug(nes, debug);
+
+    // The access finishes its instruction before the frame stops.
+    NesFrameResult result = nes_run_frame(nes, NO_INPUT, NULL);
+    EXPECT_TRUE(result.events & NES_EVENT_BREAK);
+    EXPECT_EQ(0xC00B, nes.cpu->pc);
+    EXPECT_EQ(0, bus_read(nes.bus, 0x0200));
+    ASSERT_EQ(1u, recorder.hits.size());
+
+    debug_destroy(debug);
+    EXPECT_EQ(nullptr, nes.bus->debug);
+    EXPECT_EQ(BUS_TRAP_IO, nes.bus->trap_map[0x40]);
+    EXPECT_EQ(0, nes.bus->trap_map[0x02]);
+    nes_shutdown(nes);
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "fingerprint.h"
+}
+#define SUITE FINGERPRINT
+
+static bool operator==(const StateHash &a, const StateHash &b) {
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+TEST(SUITE, check_fingerprint_stable) {
+    NES nes = nes_init();
+    Fingerprint *fingerprint = fingerprint_init(nes);
+
+    StateHash first = fingerprint_update(fingerprint, nes);
+    StateHash second = fingerprint_update(fingerprint, nes);
+
+    EXPECT_TRUE(first == second);
+
+    fingerprint_destroy(fingerprint);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_fingerprint_tracks_writes) {
+    NES nes = nes_init();
+    Fingerprint *fingerprint = fingerprint_init(nes);
+    StateHash before = fingerprint_update(fingerprint, nes);
+
+    ram_write(nes.ram, 0x0345, 1);
+    StateHash changed = fingerprint_update(fingerprint, nes);
+    ram_write(nes.ram, 0x0345, 0);
+    StateHash restored = fingerprint_update(fingerprint, nes);
+
+    EXPECT_FALSE(before == changed);
+    EXPECT_TRUE(before == restored);
+
+    fingerprint_destroy(fingerprint);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_fingerprint_matches_fresh) {
+    NES a = nes_init();
+    NES b = nes_init();
+    Fingerprint *incremental = fingerprint_init(a);
+    fingerprint_update(incremental, a);
+    ram_write(a.ram, 0x0010, 0x10);
+    ram_write(a.ram, 0x7000, 0x70);
+    ram_write(b.ram, 0x7000, 0x70);
+    ram_write(b.ram, 0x0010, 0x10);
+    a.cpu->a = b.cpu->a = 0x42;
+    a.cpu->clock_count = 1000;
+
+    Fingerprint *fresh = fingerprint_init(b);
+
+    EXPECT_TRUE(fingerprint_update(incremental, a) == fingerprint_update(fresh, b));
+
+    fingerprint_destroy(incremental);
+    fingerprint_destroy(fresh);
+    nes_shutdown(a);
+    nes_shutdown(b);
+}
+
+TEST(SUITE, check_fingerprint_registers_and_position) {
+    NES a = nes_init();
+    NES b = nes_init();
+    ram_write(a.ram, 0x0100, 1);
+    ram_write(b.ram, 0x0200, 1);
+    Fingerprint *fa = fingerprint_init(a);
+    Fingerprint *fb = fingerprint_init(b);
+
+    EXPECT_FALSE(fingerprint_update(fa, a) == fingerprint_update(fb, b));
+    ram_write(b.ram, 0x0200, 0);
+    ram_write(b.ram, 0x0100, 1);
+    EXPECT_TRUE(fingerprint_update(fa, a) == fingerprint_update(fb, b));
+    b.cpu->x = 1;
+    EXPECT_FALSE(fingerprint_update(fa, a) == fingerprint_update(fb, b));
+
+    fingerprint_destroy(fa);
+    fingerprint_destroy(fb);
+    nes_shutdown(a);
+    nes_shutdown(b);
+}
@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "cartridge.h"
+    #include "mapper.h"
+}
+#include "test_machines.h"
+#define SUITE MAPPER
+
+// Cartridge whose every PRG and CHR bank of `bank` bytes starts with its
+// bank number. `code` is copied to the last 8KB of PRG, which the reset
+// and IRQ vectors point at.
+static Cartridge* make_cartridge(uint8_t mapper, size_t prg_size, size_t chr_size,
+                                 const std::vector<uint8_t> &code = {}) {
+    std::vector<uint8_t> image = ines_image(mapper, prg_size, chr_size);
+    uint8_t *prg = image.data() + 16;
+    uint8_t *chr = prg + prg_size;
+    for (size_t i = 0; i < prg_size; i += 0x2000) prg[i] = (uint8_t) (i / 0x2000);
+    for (size_t i = 0; i < chr_size; i += 0x400) chr[i] = (uint8_t) (i / 0x400);
+    std::copy(code.begin(), code.end(), prg + prg_size - 0x2000);
+    prg[prg_size - 4] = 0x00;
+    prg[prg_size - 3] = 0xE0;
+    prg[prg_size - 2] = 0x10;
+    prg[prg_size - 1] = 0xE0;
+    return open_image("/tmp/macnes-mapper-" + std::to_string(getpid()) + ".nes", image);
+}
+
+// First byte of the 8KB PRG bank mapped at `address`.
+static uint8_t prg_at(NES nes, uint16_t address) {
+    return bus_read(nes.bus, address);
+}
+
+static uint8_t chr_at(NES nes, int page) {
+    return nes.bus->chr_map[page][0];
+}
+
+TEST(SUITE, check_mapper_unsupported) {
+    NES nes = nes_init();
+    Cartridge *cartridge = make_cartridge(0x55, 0x4000, 0x2000);
+    EXPECT_FALSE(nes_insert_cartridge(nes, cartridge));
+    EXPECT_EQ(nullptr, nes.bus->cartridge);
+    cartridge_release(cartridge);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_mapper_uxrom) {
+    NES nes = machine_with(make_cartridge(2, 8 * 0x4000, 0x2000));
+    EXPECT_EQ(0, prg_at(nes, 0x8000));
+    EXPECT_EQ(14, prg_at(nes, 0xC000));
+
+    bus_write(nes.bus, 0x8123, 3);
+    EXPECT_EQ(6, prg_at(nes, 0x8000));
+    EXPECT_EQ(7, prg_at(nes, 0xA000));
+    EXPECT_EQ(14, prg_at(nes, 0xC000));
+    EXPECT_EQ(nes.bus->cartridge->prg + 3 * 0x4000 + 0x100, nes.bus->read_map[0x81]);
+
+    // Out of range banks wrap.
+    bus_write(nes.bus, 0xFFFF, 9);
+    EXPECT_EQ(2, prg_at(nes, 0x8000));
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_mapper_cnrom) {
+    NES nes = machine_with(make_cartridge(3, 0x8000, 4 * 0x2000));
+    EXPECT_EQ(0, chr_at(nes, 0));
+    bus_write(nes.bus, 0x8000, 2);
+    EXPECT_EQ(16, chr_at(nes, 0));
+    EXPECT_EQ(23, chr_at(nes, 7));
+    EXPECT_EQ(0, prg_at(nes, 0x8000));
+    nes_shutdown(nes);
+}
+
+static void mmc1_load(NES nes, uint16_t address, uint8_t value) {
+    for (int i = 0; i < 5; i++)
+        bus_write(nes.bus, address, (uint8_t) (value >> i));
+}
+
+TEST(SUITE, check_mapper_mmc1) {
+    NES nes = machine_with(make_cartridge(1, 8 * 0x4000, 4 * 0x2000));
+    // Power-on: 16KB mode with the last bank fixed at $C000.
+    EXPECT_EQ(0, prg_at(nes, 0x8000));
+    EXPECT_EQ(14, prg_at(nes, 0xC000));
+
+    mmc1_load(nes, 0xE000, 5);
+    EXPECT_EQ(10, prg_at(nes, 0x8000));
+    EXPECT_EQ(14, prg_at(nes, 0xC000));
+
+    // Fix the first bank, switch $C000, 4KB CHR.
+    mmc1_load(nes, 0x8000, 0x18);
+    EXPECT_EQ(0, prg_at(nes, 0x8000));
+    EXPECT_EQ(10, prg_at(nes, 0xC000));
+    mmc1_load(nes, 0xA000, 3);
+    mmc1_load(nes, 0xC000, 6);
+    EXPECT_EQ(12, chr_at(nes, 0));
+    EXPECT_EQ(24, chr_at(nes, 4));
+
+    // 32KB mode ignores the low bank bit.
+    mmc1_load(nes, 0x8000, 0x00);
+    EXPECT_EQ(8, prg_at(nes, 0x8000));
+    EXPECT_EQ(10, prg_at(nes, 0xC000));
+    EXPECT_EQ(8, chr_at(nes, 0));
+
+    // A write with bit 7 set drops the partial load and restores mode 3.
+    bus_write(nes.bus, 0x8000, 1);
+    bus_write(nes.bus, 0x8000, 0x80);
+    EXPECT_EQ(0, nes.bus->mapper_state.mmc1.shift_count);
+    EXPECT_EQ(10, prg_at(nes, 0x8000));
+    EXPECT_EQ(14, prg_at(nes, 0xC000));
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_mapper_mmc1_small_prg) {
+    NES nes = machine_with(make_cartridge(1, 0x4000, 0x2000));
+    EXPECT_EQ(0, prg_at(nes, 0x8000));
+    EXPECT_EQ(0, prg_at(nes, 0xC000));
+
+    // 32KB mode on a 16KB cartridge mirrors it, with one-screen mirroring.
+    mmc1_load(nes, 0x8000, 0x00);
+    EXPECT_EQ(0, prg_at(nes, 0x8000));
+    EXPECT_EQ(1, prg_at(nes, 0xA000));
+    EXPECT_EQ(0, prg_at(nes, 0xC000));
+    EXPECT_EQ(1, prg_at(nes, 0xE000));
+    EXPECT_EQ(nes.bus->read_map[0x85], nes.bus->read_map[0xC5]);
+    EXPECT_EQ(MIRROR_SINGLE_LOWER, nes.bus->mapper_state.mirroring);
+    mmc1_load(nes, 0x8000, 0x01);
+    EXPECT_EQ(MIRROR_SINGLE_UPPER, nes.bus->mapper_state.mirroring);
+    mmc1_load(nes, 0x8000, 0x02);
+    EXPECT_EQ(MIRROR_VERTICAL, nes.bus->mapper_state.mirroring);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_mapper_mmc3_banks) {
+    NES nes = machine_with(make_cartridge(4, 4 * 0x4000, 8 * 0x2000));
+    bus_write(nes.bus, 0x8000, 6);
+    bus_write(nes.bus, 0x8001, 3);
+    bus_write(nes.bus, 0x8000, 7);
+    bus_write(nes.bus, 0x8001, 4);
+    EXPECT_EQ(3, prg_at(nes, 0x8000));
+    EXPECT_EQ(4, prg_at(nes, 0xA000));
+    EXPECT_EQ(6, prg_at(nes, 0xC000));
+    EXPECT_EQ(7, prg_at(nes, 0xE000));
+
+    bus_write(nes.bus, 0x8000, 0x46);
+    EXPECT_EQ(6, prg_at(nes, 0x8000));
+    EXPECT_EQ(3, prg_at(nes, 0xC000));
+
+    bus_write(nes.bus, 0x8000, 0x00);
+    bus_write(nes.bus, 0x8001, 10);
+    bus_write(nes.bus, 0x8000, 0x02);
+    bus_write(nes.bus, 0x8001, 33);
+    EXPECT_EQ(10, chr_at(nes, 0));
+    EXPECT_EQ(11, chr_at(nes, 1));
+    EXPECT_EQ(33, chr_at(nes, 4));
+    bus_write(nes.bus, 0x8000, 0x80);
+    EXPECT_EQ(10, chr_at(nes, 4));
+    EXPECT_EQ(33, chr_at(nes, 0));
+
+    // Restoring a snapshot remaps the banks it recorded.
+    NesState *state = nes_state_init();
+    nes_snapshot(nes, state);
+    bus_write(nes.bus, 0x8000, 0x06);
+    bus_write(nes.bus, 0x8001, 0);
+    EXPECT_EQ(0, prg_at(nes, 0x8000));
+    nes_restore(nes, state);
+    EXPECT_EQ(3, prg_at(nes, 0x8000));
+    EXPECT_EQ(6, prg_at(nes, 0xC000));
+    EXPECT_EQ(33, chr_at(nes, 0));
+    nes_state_destroy(state);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_mapper_mmc3_scanline_schedule) {
+    NES nes = machine_with(make_cartridge(4, 0x8000, 0x2000));
+    Bus *bus = nes.bus;
+    // Dot 260 of line 0, then of every line up to 239 and line 261.
+    EXPECT_EQ(87u, bus->mapper_state.next_event);
+    std::vector<uint64_t> events;
+    while (events.size() < 242) {
+        events.push_back(bus->mapper_state.next_event);
+        mapper_event(bus, bus->mapper_state.next_event);
+    }
+    EXPECT_EQ((uint64_t) ((239 * 341 + 260) * 2 / 3 + 1) / 2, events[239]);
+    EXPECT_EQ((uint64_t) ((261 * 341 + 260) * 2 / 3 + 1) / 2, events[240]);
+    EXPECT_EQ((uint64_t) (NES_FRAME_CYCLES_X2 + 173 + 1) / 2, events[241]);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_mapper_mmc3_irq) {
+    const std::vector<uint8_t> code = {
+        0x78,                   // SEI
+        0xA9, 0x07,             // LDA #7
+        0x8D, 0x00, 0xC0,       // STA $C000    latch
+        0x8D, 0x01, 0xC0,       // STA $C001    reload
+        0x8D, 0x01, 0xE0,       // STA $E001    enable
+        0x58,                   // CLI
+        0x4C, 0x0D, 0xE0,       // JMP *
+        0xE6, 0x30,             // INC $30      IRQ at $E010
+        0x8D, 0x00, 0xE0,       // STA $E000    acknowledge
+        0x8D, 0x01, 0xE0,       // STA $E001
+        0x40,                   // RTI
+    };
+    // 241 counter clocks per frame, one IRQ every eighth. The accurate tier
+    // gets its events from the scheduler's mapper component, switching to it
+    // and back once per event.
+    for (CpuTier tier : {CPU_TIER_FAST, CPU_TIER_ACCURATE}) {
+        NES nes = machine_with(make_cartridge(4, 0x8000, 0x2000, code));
+        nes_set_tier(nes, tier);
+        NesInput input = {{0, 0}};
+        nes_run_frame(nes, input, NULL);
+        EXPECT_EQ(30, ram_read(nes.ram, 0x30));
+        nes_run_frame(nes, input, NULL);
+        EXPECT_EQ(60, ram_read(nes.ram, 0x30));
+        if (tier == CPU_TIER_ACCURATE) {
+            ASSERT_NE(nullptr, nes.bus->scheduler);
+            EXPECT_LE(nes.bus->scheduler->switches, 2u * 2 * 242 + 4);
+        }
+        nes_shutdown(nes);
+    }
+}
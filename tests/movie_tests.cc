@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "movie.h"
+}
+#include "test_machines.h"
+#define SUITE MOVIE
+
+static Movie* recorded_movie(uint32_t frames) {
+    Movie *movie = movie_init();
+    for (uint32_t f = 0; f < frames; f++) {
+        NesInput input = {{(uint8_t) (f % 3 == 0 ? BUTTON_A : 0), (uint8_t) (f % 5 < 2 ? BUTTON_A : 0)}};
+        movie_append(movie, input);
+    }
+    return movie;
+}
+
+struct Sample {
+    uint64_t clock_count;
+    uint16_t pc;
+    uint8_t  one;
+    uint8_t  two;
+};
+
+static Sample sample(NES nes) {
+    return {nes.cpu->clock_count, nes.cpu->pc, ram_read(nes.ram, 0x20), ram_read(nes.ram, 0x21)};
+}
+
+static void expect_sample(const Sample &expected, NES nes) {
+    Sample actual = sample(nes);
+    EXPECT_EQ(expected.clock_count, actual.clock_count);
+    EXPECT_EQ(expected.pc, actual.pc);
+    EXPECT_EQ(expected.one, actual.one);
+    EXPECT_EQ(expected.two, actual.two);
+}
+
+TEST(SUITE, check_movie_seek_matches_straight_replay) {
+    const uint32_t frames = 100;
+    Movie *movie = recorded_movie(frames);
+
+    NES reference = two_player_machine();
+    std::vector<Sample> expected;
+    for (uint32_t f = 0; f < frames; f++) {
+        expected.push_back(sample(reference));
+        nes_run_frame(reference, movie->inputs[f], NULL);
+    }
+    expected.push_back(sample(reference));
+
+    NES nes = two_player_machine();
+    MoviePlayer *player = movie_player_init(nes, movie, 16);
+    ASSERT_TRUE(movie_player_seek(player, 40));
+    expect_sample(expected[40], nes);
+    EXPECT_EQ(3u, player->keyframe_count);
+
+    while (movie_player_step(player, NULL, NULL)) {}
+    EXPECT_EQ(frames, player->frame);
+    expect_sample(expected[frames], nes);
+    EXPECT_EQ(7u, player->keyframe_count);
+
+    for (uint32_t target : {37u, 5u, 96u, 0u, 64u, 65u, 63u, 100u}) {
+        ASSERT_TRUE(movie_player_seek(player, target));
+        EXPECT_EQ(target, player->frame);
+        expect_sample(expected[target], nes);
+    }
+    EXPECT_FALSE(movie_player_seek(player, frames + 1));
+
+    movie_player_destroy(player);
+    nes_shutdown(nes);
+    nes_shutdown(reference);
+    movie_destroy(movie);
+}
+
+TEST(SUITE, check_movie_save_and_load) {
+    std::string path = std::string("/tmp/macnes-movie-") + std::to_string(getpid()) + ".mnm";
+    Movie *movie = recorded_movie(50);
+    ASSERT_TRUE(movie_save(movie, path.c_str()));
+
+    Movie *loaded = movie_load(path.c_str());
+    ASSERT_NE(nullptr, loaded);
+    ASSERT_EQ(movie->length, loaded->length);
+    for (uint32_t f = 0; f < movie->length; f++) {
+        EXPECT_EQ(movie->inputs[f].buttons[0], loaded->inputs[f].buttons[0]);
+        EXPECT_EQ(movie->inputs[f].buttons[1], loaded->inputs[f].buttons[1]);
+    }
+
+    // A length past the end of the file.
+    FILE *f = fopen(path.c_str(), "r+b");
+    uint32_t length = 0x7FFFFFFF;
+    fseek(f, offsetof(MovieHeader, length), SEEK_SET);
+    fwrite(&length, sizeof(length), 1, f);
+    fclose(f);
+    EXPECT_EQ(nullptr, movie_load(path.c_str()));
+
+    f = fopen(path.c_str(), "r+b");
+    fputc('X', f);
+    fclose(f);
+    EXPECT_EQ(nullptr, movie_load(path.c_str()));
+    EXPECT_EQ(nullptr, movie_load("/nonexistent/macnes.mnm"));
+
+    unlink(path.c_str());
+    movie_destroy(loaded);
+    movie_destroy(movie);
+}
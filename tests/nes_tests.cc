@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+}
+#include "test_machines.h"
+#define SUITE NES
+
+TEST(SUITE, check_run_frame_cycles) {
+    NES nes = nes_init();
+    load_program(nes, {0x4C, 0x00, 0x80});
+    NesInput input = {{0, 0}};
+
+    NesFrameResult first = nes_run_frame(nes, input, NULL);
+    NesFrameResult second = nes_run_frame(nes, input, NULL);
+
+    EXPECT_NEAR(29780.5, first.cycles, 8);
+    EXPECT_NEAR(NES_FRAME_CYCLES_X2, first.cycles + second.cycles, 3);
+    EXPECT_EQ(0u, first.events);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_run_frame_audio) {
+    NES nes = nes_init();
+    load_program(nes, {0x4C, 0x00, 0x80});
+    NesInput input = {{0, 0}};
+    std::vector<float> audio(1024);
+    NesFrame out = {NULL, audio.data(), audio.size()};
+
+    NesFrameResult result = nes_run_frame(nes, input, &out);
+    result = nes_run_frame(nes, input, &out);
+
+    EXPECT_NEAR(NES_AUDIO_RATE / 60.0988, (double) result.audio_samples, 2);
+    EXPECT_FALSE(result.events & NES_EVENT_AUDIO_OVERRUN);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_run_frame_audio_overrun) {
+    NES nes = nes_init();
+    load_program(nes, {0x4C, 0x00, 0x80});
+    NesInput input = {{0, 0}};
+    float audio[64];
+    NesFrame out = {NULL, audio, 64};
+
+    NesFrameResult result = nes_run_frame(nes, input, &out);
+
+    EXPECT_EQ(64u, result.audio_samples);
+    EXPECT_TRUE(result.events & NES_EVENT_AUDIO_OVERRUN);
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_run_frame_silent) {
+    NES nes = nes_init();
+    load_program(nes, {0x4C, 0x00, 0x80});
+    NesInput input = {{0, 0}};
+    std::vector<float> audio(1024);
+    NesFrame out = {NULL, audio.data(), audio.size()};
+    nes_run_frame(nes, input, &out);
+    ResamplerState before = nes.audio->resampler->state;
+
+    NesFrame video = {NULL, NULL, 0};
+    EXPECT_EQ(0u, nes_run_frame(nes, input, NULL).audio_samples);
+    EXPECT_EQ(0u, nes_run_frame(nes, input, &video).audio_samples);
+    EXPECT_EQ(0, memcmp(&before, &nes.audio->resampler->state, sizeof(before)));
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_run_frame_input) {
+    NES nes = nes_init();
+    // Strobe the pad, then shift eight buttons into $00..$07.
+    load_program(nes, {
+        0xA9, 0x01,         // LDA #$01
+        0x8D, 0x16, 0x40,   // STA $4016
+        0xA9, 0x00,         // LDA #$00
+        0x8D, 0x16, 0x40,   // STA $4016
+        0xA2, 0x00,         // LDX #$00
+        0xAD, 0x16, 0x40,   // LDA $4016
+        0x29, 0x01,         // AND #$01
+        0x95, 0x00,         // STA $00,X
+        0xE8,               // INX
+        0xE0, 0x08,         // CPX #$08
+        0xD0, 0xF4,         // BNE -12
+        0x4C, 0x18, 0x80,   // JMP $8018
+    });
+    NesInput input = {{BUTTON_A | BUTTON_START | BUTTON_RIGHT, 0}};
+
+    NesFrameResult result = nes_run_frame(nes, input, NULL);
+
+    EXPECT_TRUE(result.events & NES_EVENT_INPUT_POLLED);
+    uint8_t expected[8] = {1, 0, 0, 1, 0, 0, 0, 1};
+    for (int i = 0; i < 8; i++)
+        EXPECT_EQ(expected[i], ram_read(nes.ram, i));
+
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_snapshot_restore) {
+    NES nes = nes_init();
+    // Counts frames in $10/$11 forever.
+    load_program(nes, COUNTING_PROGRAM);
+    NesInput input = {{BUTTON_A, 0}};
+    NesState *state = nes_state_init();
+    nes_run_frame(nes, input, NULL);
+
+    nes_snapshot(nes, state);
+    nes_run_frame(nes, input, NULL);
+    CPU expected_cpu = *nes.cpu;
+    uint8_t expected_lo = ram_read(nes.ram, 0x10);
+    uint8_t expected_hi = ram_read(nes.ram, 0x11);
+    nes_run_frame(nes, input, NULL);
+    nes_restore(nes, state);
+    nes_run_frame(nes, input, NULL);
+
+    EXPECT_EQ(expected_cpu.pc, nes.cpu->pc);
+    EXPECT_EQ(expected_cpu.clock_count, nes.cpu->clock_count);
+    EXPECT_EQ(expected_lo, ram_read(nes.ram, 0x10));
+    EXPECT_EQ(expected_hi, ram_read(nes.ram, 0x11));
+    EXPECT_EQ(nes.bus, nes.cpu->bus);
+
+    nes_state_destroy(state);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_fork) {
+    NES parent = nes_init();
+    load_program(parent, COUNTING_PROGRAM);
+    NesInput input = {{0, 0}};
+    nes_run_frame(parent, input, NULL);
+
+    NES child = nes_fork(parent);
+    nes_run_frame(child, input, NULL);
+    nes_run_frame(parent, input, NULL);
+
+    EXPECT_EQ(parent.cpu->pc, child.cpu->pc);
+    EXPECT_EQ(parent.cpu->clock_count, child.cpu->clock_count);
+    EXPECT_EQ(ram_read(parent.ram, 0x10), ram_read(child.ram, 0x10));
+    EXPECT_EQ(child.bus, child.cpu->bus);
+    EXPECT_NE(parent.ram->read_page[0], child.ram->read_page[0]);
+    EXPECT_EQ(parent.ram->read_page[0x80], child.ram->read_page[0x80]);
+
+    nes_shutdown(child);
+    nes_shutdown(parent);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "netplay.h"
+}
+#include "test_machines.h"
+#define SUITE NETPLAY
+
+static uint8_t player_one(uint32_t frame) {
+    return frame % 3 == 0 ? BUTTON_A : 0;
+}
+
+static uint8_t player_two(uint32_t frame) {
+    return frame % 2 == 1 ? BUTTON_A : 0;
+}
+
+TEST(SUITE, check_netplay_converges_after_rollback) {
+    NES reference = two_player_machine();
+    NES nes_a = two_player_machine();
+    NES nes_b = two_player_machine();
+    NetplayLoopback *loopback = netplay_loopback_init();
+    Netplay *a = netplay_init(nes_a, 0, netplay_loopback_transport(loopback, 0));
+    Netplay *b = netplay_init(nes_b, 1, netplay_loopback_transport(loopback, 1));
+    const uint32_t frames = 40;
+
+    for (uint32_t f = 0; f < frames; f++) {
+        NesInput input = {{player_one(f), player_two(f)}};
+        nes_run_frame(reference, input, NULL);
+    }
+    while (a->frame < frames || b->frame < frames) {
+        for (int i = 0; i < 4 && a->frame < frames; i++)
+            ASSERT_TRUE(netplay_advance(a, player_one(a->frame), NULL, NULL));
+        for (int i = 0; i < 4 && b->frame < frames; i++)
+            ASSERT_TRUE(netplay_advance(b, player_two(b->frame), NULL, NULL));
+    }
+    netplay_poll(a);
+    netplay_poll(b);
+
+    EXPECT_GT(a->rollbacks + b->rollbacks, 0u);
+    EXPECT_EQ(frames, a->confirmed);
+    EXPECT_EQ(frames, b->confirmed);
+    for (NES nes : {nes_a, nes_b}) {
+        EXPECT_EQ(reference.cpu->clock_count, nes.cpu->clock_count);
+        EXPECT_EQ(reference.cpu->pc, nes.cpu->pc);
+        EXPECT_EQ(ram_read(reference.ram, 0x20), ram_read(nes.ram, 0x20));
+        EXPECT_EQ(ram_read(reference.ram, 0x21), ram_read(nes.ram, 0x21));
+    }
+
+    netplay_destroy(a);
+    netplay_destroy(b);
+    netplay_loopback_destroy(loopback);
+    nes_shutdown(reference);
+    nes_shutdown(nes_a);
+    nes_shutdown(nes_b);
+}
+
+TEST(SUITE, check_netplay_stalls) {
+    NES nes = two_player_machine();
+    NetplayLoopback *loopback = netplay_loopback_init();
+    Netplay *netplay = netplay_init(nes, 0, netplay_loopback_transport(loopback, 0));
+
+    uint32_t advanced = 0;
+    while (netplay_advance(netplay, 0, NULL, NULL) && advanced < 100)
+        advanced++;
+
+    EXPECT_EQ(NETPLAY_HISTORY - 1u, advanced);
+
+    netplay_destroy(netplay);
+    netplay_loopback_destroy(loopback);
+    nes_shutdown(nes);
+}
@@ -24,4 +24,125 @@ TEST(SUITE, check_ram_read) {
     ram->data[address] = expected_data;
 
     EXPECT_EQ(expected_data, ram_read(ram, address));
-}
\ No newline at end of file
+}
+
+TEST(SUITE, check_ram_fork_shares_pages) {
+    RAM *parent = ram_init();
+    ram_write(parent, 0x0210, 0x42);
+
+    RAM *child = ram_fork(parent);
+
+    EXPECT_EQ(0x42, ram_read(child, 0x0210));
+    for (int page = 0; page < RAM_PAGE_COUNT; page++)
+        EXPECT_EQ(parent->read_page[page], child->read_page[page]);
+
+    ram_destroy(child);
+    ram_destroy(parent);
+}
+
+TEST(SUITE, check_ram_fork_copy_on_write) {
+    RAM *parent = ram_init();
+    ram_write(parent, 0x0210, 0x42);
+    RAM *child = ram_fork(parent);
+
+    ram_write(child, 0x0211, 0x11);
+    ram_write(parent, 0x0212, 0x22);
+
+    EXPECT_EQ(0x42, ram_read(child, 0x0210));
+    EXPECT_EQ(0x11, ram_read(child, 0x0211));
+    EXPECT_EQ(0x00, ram_read(child, 0x0212));
+    EXPECT_EQ(0x00, ram_read(parent, 0x0211));
+    EXPECT_EQ(0x22, ram_read(parent, 0x0212));
+    EXPECT_NE(parent->read_page[2], child->read_page[2]);
+    EXPECT_EQ(parent->read_page[3], child->read_page[3]);
+
+    ram_destroy(child);
+    ram_destroy(parent);
+}
+
+TEST(SUITE, check_ram_fork_outlives_parent) {
+    RAM *parent = ram_init();
+    ram_write(parent, 0x1234, 0x56);
+    RAM *child = ram_fork(parent);
+    ram_write(parent, 0x2000, 0x01);
+    RAM *grandchild = ram_fork(parent);
+
+    ram_destroy(parent);
+
+    EXPECT_EQ(0x56, ram_read(child, 0x1234));
+    EXPECT_EQ(0x00, ram_read(child, 0x2000));
+    EXPECT_EQ(0x01, ram_read(grandchild, 0x2000));
+
+    ram_destroy(child);
+    ram_destroy(grandchild);
+}
+
+TEST(SUITE, check_ram_save_load) {
+    RAM *parent = ram_init();
+    ram_write(parent, 0x0300, 0x33);
+    RAM *child = ram_fork(parent);
+    uint8_t *bytes = (uint8_t*) calloc(1, RAM_SIZE);
+
+    ram_save(child, bytes);
+    bytes[0x0300] = 0x44;
+    ram_load(child, bytes);
+
+    EXPECT_EQ(0x44, ram_read(child, 0x0300));
+    EXPECT_EQ(0x33, ram_read(parent, 0x0300));
+    EXPECT_EQ(NULL, child->image);
+
+    free(bytes);
+    ram_destroy(child);
+    ram_destroy(parent);
+}
+
+TEST(SUITE, check_ram_dirty_disabled) {
+    RAM *ram = ram_init();
+
+    ram_write(ram, 0x0400, 1);
+
+    EXPECT_FALSE(ram_page_dirty(ram, 4));
+    EXPECT_NE(nullptr, ram->write_page[4]);
+
+    ram_destroy(ram);
+}
+
+TEST(SUITE, check_ram_dirty_tracking) {
+    RAM *ram = ram_init();
+    ram_track_dirty(ram, true);
+
+    ram_write(ram, 0x0400, 1);
+    ram_write(ram, 0x04FF, 2);
+    ram_write(ram, 0xC000, 3);
+
+    EXPECT_TRUE(ram_page_dirty(ram, 0x04));
+    EXPECT_TRUE(ram_page_dirty(ram, 0xC0));
+    EXPECT_FALSE(ram_page_dirty(ram, 0x05));
+    EXPECT_EQ(2, ram_read(ram, 0x04FF));
+
+    ram_dirty_clear(ram);
+    ram_write(ram, 0x0500, 4);
+
+    EXPECT_FALSE(ram_page_dirty(ram, 0x04));
+    EXPECT_TRUE(ram_page_dirty(ram, 0x05));
+    EXPECT_EQ(nullptr, ram->write_page[0x04]);
+
+    ram_destroy(ram);
+}
+
+TEST(SUITE, check_ram_dirty_forked) {
+    RAM *parent = ram_init();
+    ram_track_dirty(parent, true);
+    ram_write(parent, 0x0100, 1);
+    ram_dirty_clear(parent);
+    RAM *child = ram_fork(parent);
+
+    ram_write(parent, 0x0101, 2);
+
+    EXPECT_TRUE(ram_page_dirty(parent, 0x01));
+    EXPECT_EQ(1, ram_read(child, 0x0100));
+    EXPECT_EQ(0, ram_read(child, 0x0101));
+
+    ram_destroy(child);
+    ram_destroy(parent);
+}
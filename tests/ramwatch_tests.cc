@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "ramwatch.h"
+}
+#define SUITE RAMWATCH
+
+TEST(SUITE, check_ramwatch_add) {
+    RamWatch *watch = ramwatch_init();
+
+    EXPECT_TRUE(ramwatch_add(watch, 0x10, 3, RAMWATCH_U8));
+    EXPECT_TRUE(ramwatch_add(watch, 0x20, 2, RAMWATCH_U16LE));
+    EXPECT_TRUE(ramwatch_add(watch, 0x30, 3, RAMWATCH_BCD));
+    EXPECT_FALSE(ramwatch_add(watch, 0x30, 5, RAMWATCH_BCD));
+
+    EXPECT_EQ(6u, watch->feature_count);
+    EXPECT_EQ(10u, watch->address_count);
+    EXPECT_FALSE(watch->raw);
+
+    ramwatch_destroy(watch);
+}
+
+TEST(SUITE, check_ramwatch_gather_raw) {
+    NES machines[2] = {nes_init(), nes_init()};
+    ram_write(machines[0].ram, 0x75, 3);
+    ram_write(machines[1].ram, 0x75, 7);
+    ram_write(machines[1].ram, 0x76, 9);
+    RamWatch *watch = ramwatch_init();
+    ramwatch_add(watch, 0x75, 2, RAMWATCH_U8);
+    int32_t features[4];
+
+    ramwatch_gather(watch, machines, 2, features);
+
+    EXPECT_TRUE(watch->raw);
+    EXPECT_EQ(3, features[0]);
+    EXPECT_EQ(0, features[1]);
+    EXPECT_EQ(7, features[2]);
+    EXPECT_EQ(9, features[3]);
+
+    ramwatch_destroy(watch);
+    nes_shutdown(machines[0]);
+    nes_shutdown(machines[1]);
+}
+
+TEST(SUITE, check_ramwatch_gather_decode) {
+    NES nes = nes_init();
+    ram_write(nes.ram, 0x07DD, 0x01);
+    ram_write(nes.ram, 0x07DE, 0x02);
+    ram_write(nes.ram, 0x07DF, 0x03);
+    ram_write(nes.ram, 0x0100, 0x12);
+    ram_write(nes.ram, 0x0101, 0x34);
+    ram_write(nes.ram, 0xFFFF, 0xCD);
+    ram_write(nes.ram, 0x0000, 0xAB);
+    RamWatch *watch = ramwatch_init();
+    ramwatch_add(watch, 0x07DD, 3, RAMWATCH_DIGITS);
+    ramwatch_add(watch, 0x0100, 2, RAMWATCH_BCD);
+    ramwatch_add(watch, 0xFFFF, 1, RAMWATCH_U16LE);
+    int32_t features[3];
+
+    ramwatch_gather(watch, &nes, 1, features);
+
+    EXPECT_EQ(123, features[0]);
+    EXPECT_EQ(1234, features[1]);
+    EXPECT_EQ(0xABCD, features[2]);
+
+    ramwatch_destroy(watch);
+    nes_shutdown(nes);
+}
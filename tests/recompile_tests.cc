@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "cartridge.h"
+    #include "recompile.h"
+    #include "aot.h"
+}
+#include "test_machines.h"
+#define SUITE RECOMPILE
+
+static std::string temp_path(const char *suffix) {
+    return "/tmp/macnes-recompile-" + std::to_string(getpid()) + suffix;
+}
+
+// Cartridge with `code` placed at PRG offsets; the reset vector points at
+// $C000, the start of the last 16KB bank.
+static Cartridge* make_cartridge(uint8_t mapper, size_t prg_size,
+                                 const std::vector<std::pair<size_t, std::vector<uint8_t>>> &code) {
+    std::vector<uint8_t> image = ines_image(mapper, prg_size, 0x2000);
+    uint8_t *prg = image.data() + 16;
+    for (const auto &part : code) std::copy(part.second.begin(), part.second.end(), prg + part.first);
+    prg[prg_size - 4] = 0x00;
+    prg[prg_size - 3] = 0xC0;
+    return open_image(temp_path(".nes"), image);
+}
+
+static Aot* compile(Cartridge *cartridge, RecompileStats *stats) {
+    std::string source = temp_path(".c"), object = temp_path(".so");
+    FILE *f = fopen(source.c_str(), "w");
+    bool ok = recompile_cartridge(cartridge, f, stats);
+    fclose(f);
+    ok = ok && recompile_build(source.c_str(), object.c_str(), MACNES_INCLUDE_DIR);
+    Aot *aot = ok ? aot_load(object.c_str()) : NULL;
+    unlink(source.c_str());
+    unlink(object.c_str());
+    return aot;
+}
+
+// Runs the cartridge interpreted and with `aot` side by side, checking the
+// registers, clock and RAM agree after every frame.
+static void expect_same_as_interpreter(Cartridge *cartridge, const Aot *aot, int frames) {
+    NES interpreted = nes_init(), compiled = nes_init();
+    ASSERT_TRUE(nes_insert_cartridge(interpreted, cartridge));
+    ASSERT_TRUE(nes_insert_cartridge(compiled, cartridge));
+    ASSERT_TRUE(nes_attach_aot(compiled, aot));
+    NesInput input = {{0, 0}};
+    for (int frame = 0; frame < frames; frame++) {
+        nes_run_frame(interpreted, input, NULL);
+        nes_run_frame(compiled, input, NULL);
+        const CPU *a = interpreted.cpu, *b = compiled.cpu;
+        ASSERT_EQ(a->clock_count, b->clock_count) << "frame " << frame;
+        ASSERT_EQ(a->pc, b->pc) << "frame " << frame;
+        ASSERT_EQ(a->a, b->a);
+        ASSERT_EQ(a->x, b->x);
+        ASSERT_EQ(a->y, b->y);
+        ASSERT_EQ(a->sp, b->sp);
+        ASSERT_EQ(a->status, b->status);
+        for (uint16_t address = 0; address < 0x0800; address++)
+            ASSERT_EQ(bus_read(interpreted.bus, address), bus_read(compiled.bus, address))
+                << "frame " << frame << " address " << address;
+    }
+    nes_shutdown(interpreted);
+    nes_shutdown(compiled);
+}
+
+// Copies a routine to RAM and calls it, then calls a ROM routine that
+// crosses pages with indexed reads, writes zero page indexed and returns
+// through an indirect jump; also reads through a zero page pointer.
+static const std::vector<uint8_t> NROM_PROGRAM = {
+    0xA2, 0x00,             // C000 LDX #$00
+    0xBD, 0x00, 0xC1,       // C002 LDA $C100,X
+    0x9D, 0x00, 0x03,       // C005 STA $0300,X
+    0xE8,                   // C008 INX
+    0xE0, 0x08,             // C009 CPX #$08
+    0xD0, 0xF5,             // C00B BNE $C002
+    0x20, 0x00, 0x03,       // C00D JSR $0300
+    0x20, 0x30, 0xC0,       // C010 JSR $C030
+    0xA4, 0x11,             // C013 LDY $11
+    0xB1, 0x20,             // C015 LDA ($20),Y
+    0x18,                   // C017 CLC
+    0x79, 0xF0, 0x00,       // C018 ADC $00F0,Y
+    0x85, 0x12,             // C01B STA $12
+    0x4C, 0x0D, 0xC0,       // C01D JMP $C00D
+};
+
+static const std::vector<uint8_t> NROM_SUBROUTINE = {
+    0xE6, 0x11,             // C030 INC $11
+    0xA6, 0x11,             // C032 LDX $11
+    0xBD, 0x80, 0xC0,       // C034 LDA $C080,X
+    0x95, 0x40,             // C037 STA $40,X
+    0x6C, 0x50, 0xC0,       // C039 JMP ($C050)
+    0x00, 0x00, 0x00, 0x00,
+    0xA5, 0x11,             // C040 LDA $11
+    0x29, 0x0F,             // C042 AND #$0F
+    0xD0, 0x02,             // C044 BNE $C048
+    0xE6, 0x13,             // C046 INC $13
+    0x60,                   // C048 RTS
+};
+
+static Cartridge* nrom_cartridge() {
+    return make_cartridge(0, 0x4000, {{0x0000, NROM_PROGRAM}, {0x0030, NROM_SUBROUTINE},
+                                      {0x0050, {0x40, 0xC0}}, {0x0100, {0xE6, 0x10, 0x60}}});
+}
+
+TEST(SUITE, check_recompile_source) {
+    Cartridge *cartridge = nrom_cartridge();
+    std::string source = temp_path(".c");
+    FILE *f = fopen(source.c_str(), "w");
+    RecompileStats stats;
+    ASSERT_TRUE(recompile_cartridge(cartridge, f, &stats));
+    fclose(f);
+    unlink(source.c_str());
+    cartridge_release(cartridge);
+
+    // Blocks start at C000, C002, C00D, C010, C013 and C030. The code at
+    // C040 is only reached through JMP ($C050) and is not found.
+    EXPECT_EQ(6u, stats.blocks);
+    EXPECT_EQ(19u, stats.instructions);
+    EXPECT_EQ(44u, stats.bytes);
+}
+
+TEST(SUITE, check_recompile_matches_interpreter) {
+    Cartridge *cartridge = nrom_cartridge();
+    RecompileStats stats;
+    Aot *aot = compile(cartridge, &stats);
+    ASSERT_NE(nullptr, aot);
+    EXPECT_EQ(stats.blocks, aot->count);
+    expect_same_as_interpreter(cartridge, aot, 30);
+
+    // Only discovered ROM code is compiled; the routine copied to RAM and
+    // the target of the indirect jump are interpreted.
+    NES nes = nes_init();
+    ASSERT_TRUE(nes_insert_cartridge(nes, cartridge));
+    ASSERT_TRUE(nes_attach_aot(nes, aot));
+    EXPECT_NE(nullptr, aot_find(aot, nes.bus, 0xC00D));
+    EXPECT_EQ(nullptr, aot_find(aot, nes.bus, 0xC00E));
+    EXPECT_EQ(nullptr, aot_find(aot, nes.bus, 0xC040));
+    EXPECT_EQ(nullptr, aot_find(aot, nes.bus, 0x0300));
+    nes_shutdown(nes);
+
+    aot_unload(aot);
+    cartridge_release(cartridge);
+}
+
+TEST(SUITE, check_recompile_bank_switching) {
+    // UxROM: the fixed bank calls $8000 in bank 0, then in bank 1. Only
+    // bank 0 is mapped there at power-on, so only its routine is compiled.
+    Cartridge *cartridge = make_cartridge(2, 0x10000, {
+        {0xC000, {0xA9, 0x00, 0x8D, 0x00, 0x80, 0x20, 0x00, 0x80,
+                  0xA9, 0x01, 0x8D, 0x00, 0x80, 0x20, 0x00, 0x80, 0x4C, 0x00, 0xC0}},
+        {0x0000, {0xE6, 0x10, 0x60}},
+        {0x4000, {0xE6, 0x11, 0x60}},
+    });
+    Aot *aot = compile(cartridge, NULL);
+    ASSERT_NE(nullptr, aot);
+    expect_same_as_interpreter(cartridge, aot, 10);
+
+    NES nes = nes_init();
+    ASSERT_TRUE(nes_insert_cartridge(nes, cartridge));
+    ASSERT_TRUE(nes_attach_aot(nes, aot));
+    EXPECT_NE(nullptr, aot_find(aot, nes.bus, 0x8000));
+    bus_write(nes.bus, 0x8000, 1);
+    EXPECT_EQ(nullptr, aot_find(aot, nes.bus, 0x8000));
+    nes_shutdown(nes);
+
+    aot_unload(aot);
+    cartridge_release(cartridge);
+}
+
+TEST(SUITE, check_recompile_other_rom) {
+    Cartridge *cartridge = nrom_cartridge();
+    Aot *aot = compile(cartridge, NULL);
+    ASSERT_NE(nullptr, aot);
+    Cartridge *other = make_cartridge(0, 0x4000, {{0x0000, {0x4C, 0x00, 0xC0}}});
+
+    NES nes = nes_init();
+    ASSERT_TRUE(nes_insert_cartridge(nes, other));
+    EXPECT_FALSE(nes_attach_aot(nes, aot));
+    EXPECT_EQ(nullptr, nes.bus->aot);
+    ASSERT_TRUE(nes_insert_cartridge(nes, cartridge));
+    EXPECT_TRUE(nes_attach_aot(nes, aot));
+    nes_insert_cartridge(nes, other);
+    EXPECT_EQ(nullptr, nes.bus->aot);
+    nes_shutdown(nes);
+
+    aot_unload(aot);
+    cartridge_release(other);
+    cartridge_release(cartridge);
+}
+
+TEST(SUITE, check_recompile_build_paths) {
+    Cartridge *cartridge = nrom_cartridge();
+    std::string marker = "macnes-injected-" + std::to_string(getpid());
+    std::string base = temp_path(("-it's'; touch '" + marker + "'; '").c_str());
+    std::string source = base + ".c", object = base + ".so";
+    FILE *f = fopen(source.c_str(), "w");
+    ASSERT_NE(nullptr, f);
+    ASSERT_TRUE(recompile_cartridge(cartridge, f, NULL));
+    fclose(f);
+
+    // Quotes and separators in paths are passed through, not interpreted.
+    EXPECT_TRUE(recompile_build(source.c_str(), object.c_str(), MACNES_INCLUDE_DIR));
+    EXPECT_EQ(0, access(object.c_str(), F_OK));
+    EXPECT_NE(0, access(marker.c_str(), F_OK));
+
+    unlink(source.c_str());
+    unlink(object.c_str());
+    unlink(marker.c_str());
+    cartridge_release(cartridge);
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "movie.h"
+    #include "regress.h"
+}
+#include "test_machines.h"
+#define SUITE REGRESS
+
+static std::string temp_dir() {
+    std::string dir = "/tmp/macnes-regress-" + std::to_string(getpid());
+    mkdir(dir.c_str(), 0755);
+    return dir;
+}
+
+// 32KB image that adds button A of each pad into $20/$21 forever.
+// A raw 32KB program image, not iNES, running TWO_PLAYER_PROGRAM.
+static void write_rom(const std::string &path) {
+    std::vector<uint8_t> image(0x8000, 0);
+    std::copy(TWO_PLAYER_PROGRAM.begin(), TWO_PLAYER_PROGRAM.end(), image.begin());
+    image[0x7FFC] = 0x00;
+    image[0x7FFD] = 0x80;
+    write_file(path, image);
+}
+
+static void write_movie(const std::string &path, uint32_t frames, uint32_t changed) {
+    Movie *movie = movie_init();
+    for (uint32_t f = 0; f < frames; f++) {
+        NesInput input = {{(uint8_t) (f % 4 == 0 ? BUTTON_A : 0), (uint8_t) (f == changed ? BUTTON_A : 0)}};
+        movie_append(movie, input);
+    }
+    movie_save(movie, path.c_str());
+    movie_destroy(movie);
+}
+
+static void write_text(const std::string &path, const std::string &text) {
+    FILE *f = fopen(path.c_str(), "w");
+    fputs(text.c_str(), f);
+    fclose(f);
+}
+
+TEST(SUITE, check_regress_record_then_check) {
+    std::string dir = temp_dir();
+    write_rom(dir + "/game.bin");
+    write_movie(dir + "/play.mnm", 30, UINT32_MAX);
+    write_text(dir + "/manifest", "# corpus\n\ngame.bin play.mnm 40 play.hashes\ngame.bin - 10 idle.hashes\n");
+
+    Regress *regress = regress_init();
+    ASSERT_TRUE(regress_load(regress, (dir + "/manifest").c_str(), NULL));
+    ASSERT_EQ(2u, regress->count);
+    EXPECT_EQ(dir + "/game.bin", regress->entries[0].rom);
+    EXPECT_EQ(nullptr, regress->entries[1].movie);
+
+    regress_run(regress, 4, true);
+    EXPECT_EQ(REGRESS_RECORDED, regress->results[0].status);
+    EXPECT_EQ(REGRESS_RECORDED, regress->results[1].status);
+
+    EXPECT_EQ(2u, regress_run(regress, 4, false));
+    EXPECT_EQ(REGRESS_PASS, regress->results[0].status);
+    EXPECT_EQ(REGRESS_PASS, regress->results[1].status);
+    EXPECT_EQ(40u, regress->results[0].frames);
+
+    write_movie(dir + "/play.mnm", 30, 17);
+    regress_run(regress, 1, false);
+    EXPECT_EQ(REGRESS_FAIL, regress->results[0].status);
+    EXPECT_EQ(17u, regress->results[0].first_mismatch);
+    EXPECT_EQ(23u, regress->results[0].mismatches);
+    EXPECT_EQ(REGRESS_PASS, regress->results[1].status);
+
+    regress_destroy(regress);
+    for (const char *name : {"game.bin", "play.mnm", "manifest", "play.hashes", "idle.hashes"})
+        unlink((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+}
+
+TEST(SUITE, check_regress_errors) {
+    std::string dir = temp_dir();
+    write_rom(dir + "/game.bin");
+    write_text(dir + "/short.hashes", "00000000000000000000000000000000\n");
+    write_text(dir + "/manifest",
+               "missing.bin - 1 x.hashes\n"
+               "game.bin missing.mnm 1 x.hashes\n"
+               "game.bin - 2 short.hashes\n");
+    write_text(dir + "/broken", "game.bin - 1 x.hashes\ngame.bin - x.hashes\n");
+
+    Regress *regress = regress_init();
+    size_t line;
+    EXPECT_FALSE(regress_load(regress, (dir + "/broken").c_str(), &line));
+    EXPECT_EQ(2u, line);
+    regress_destroy(regress);
+
+    // Each name fits sscanf's field width but not once joined onto `dir`.
+    write_text(dir + "/long", "# long\n" + std::string(4090, 'r') + " - 1 x.hashes\n");
+    regress = regress_init();
+    EXPECT_FALSE(regress_load(regress, (dir + "/long").c_str(), &line));
+    EXPECT_EQ(2u, line);
+    EXPECT_EQ(0u, regress->count);
+    regress_destroy(regress);
+
+    regress = regress_init();
+    ASSERT_TRUE(regress_load(regress, (dir + "/manifest").c_str(), NULL));
+    regress_run(regress, 2, false);
+    EXPECT_EQ(REGRESS_ERROR_ROM, regress->results[0].status);
+    EXPECT_EQ(REGRESS_ERROR_MOVIE, regress->results[1].status);
+    EXPECT_EQ(REGRESS_ERROR_HASHES, regress->results[2].status);
+    regress_destroy(regress);
+
+    for (const char *name : {"game.bin", "short.hashes", "manifest", "broken", "long"})
+        unlink((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "rewind.h"
+}
+#include "test_machines.h"
+#define SUITE REWIND
+
+TEST(SUITE, check_rewind_seek) {
+    NES nes = counting_machine();
+    Rewind *rewind = rewind_init(1 << 20, 64, 8);
+    NesInput input = {{0, 0}};
+    uint64_t clocks[20];
+    uint8_t counters[20];
+    for (int i = 0; i < 20; i++) {
+        nes_run_frame(nes, input, NULL);
+        clocks[i] = nes.cpu->clock_count;
+        counters[i] = ram_read(nes.ram, 0x11);
+        ASSERT_TRUE(rewind_push(rewind, nes));
+    }
+
+    ASSERT_TRUE(rewind_seek(rewind, nes, 6));
+    EXPECT_EQ(clocks[13], nes.cpu->clock_count);
+    EXPECT_EQ(counters[13], ram_read(nes.ram, 0x11));
+    EXPECT_EQ(14u, rewind->count);
+
+    ASSERT_TRUE(rewind_seek(rewind, nes, 13));
+    EXPECT_EQ(clocks[0], nes.cpu->clock_count);
+    EXPECT_FALSE(rewind_seek(rewind, nes, 1));
+
+    rewind_destroy(rewind);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_rewind_push_after_seek) {
+    NES nes = counting_machine();
+    Rewind *rewind = rewind_init(1 << 20, 64, 4);
+    NesInput input = {{0, 0}};
+    for (int i = 0; i < 10; i++) {
+        nes_run_frame(nes, input, NULL);
+        rewind_push(rewind, nes);
+    }
+    rewind_seek(rewind, nes, 3);
+    uint64_t clock = nes.cpu->clock_count;
+
+    for (int i = 0; i < 5; i++) {
+        nes_run_frame(nes, input, NULL);
+        rewind_push(rewind, nes);
+    }
+    ASSERT_TRUE(rewind_seek(rewind, nes, 5));
+
+    EXPECT_EQ(clock, nes.cpu->clock_count);
+
+    rewind_destroy(rewind);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_rewind_truncated_delta) {
+    NES nes = counting_machine();
+    Rewind *rewind = rewind_init(1 << 20, 64, 8);
+    NesInput input = {{0, 0}};
+    for (int i = 0; i < 4; i++) {
+        nes_run_frame(nes, input, NULL);
+        ASSERT_TRUE(rewind_push(rewind, nes));
+    }
+    uint64_t clock = nes.cpu->clock_count;
+
+    // A delta cut short fails the seek and leaves the machine alone.
+    rewind->entries[rewind->first + 3].size /= 2;
+    EXPECT_FALSE(rewind_seek(rewind, nes, 0));
+    EXPECT_EQ(clock, nes.cpu->clock_count);
+    EXPECT_EQ(4u, rewind->count);
+
+    rewind_destroy(rewind);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_rewind_budget) {
+    NES nes = counting_machine();
+    Rewind *rewind = rewind_init(4096, 1000, 10);
+    NesInput input = {{0, 0}};
+    uint64_t last = 0;
+    for (int i = 0; i < 300; i++) {
+        nes_run_frame(nes, input, NULL);
+        last = nes.cpu->clock_count;
+        ASSERT_TRUE(rewind_push(rewind, nes));
+    }
+
+    EXPECT_GT(rewind->count, 10u);
+    EXPECT_LT(rewind->count, 300u);
+    EXPECT_TRUE(rewind->entries[rewind->first].keyframe);
+
+    ASSERT_TRUE(rewind_seek(rewind, nes, rewind->count - 1));
+    ASSERT_TRUE(rewind_seek(rewind, nes, 0));
+    EXPECT_LT(nes.cpu->clock_count, last);
+
+    rewind_destroy(rewind);
+    nes_shutdown(nes);
+}
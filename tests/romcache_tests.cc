@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "cartridge.h"
+    #include "romcache.h"
+}
+#include "test_machines.h"
+#define SUITE ROMCACHE
+
+static std::string temp_path(const char *name) {
+    return std::string("/tmp/macnes-") + name + "-" + std::to_string(getpid()) + ".nes";
+}
+
+static void write_rom(const std::string &path, uint8_t fill) {
+    write_file(path, ines_image(0, 0x4000, 0x2000, fill));
+}
+
+TEST(SUITE, check_romcache_shares_by_content) {
+    std::string a = temp_path("rom-a"), b = temp_path("rom-b"), c = temp_path("rom-c");
+    write_rom(a, 0x11);
+    write_rom(b, 0x11);
+    write_rom(c, 0x22);
+
+    RomCache *cache = romcache_init(NULL);
+    Cartridge *first = romcache_open(cache, a.c_str(), NULL);
+    Cartridge *copy = romcache_open(cache, b.c_str(), NULL);
+    Cartridge *other = romcache_open(cache, c.c_str(), NULL);
+    ASSERT_NE(nullptr, first);
+    EXPECT_EQ(first, copy);
+    EXPECT_NE(first, other);
+    EXPECT_EQ(2u, cache->count);
+    EXPECT_EQ(3u, cache->file_count);
+    EXPECT_EQ(3u, first->refs);
+
+    // A file seen before is not read again: rewritten in place with its old
+    // modification time, it still gives the cached image.
+    struct stat info;
+    ASSERT_EQ(0, stat(c.c_str(), &info));
+    write_rom(c, 0x11);
+    struct timespec times[2] = {info.st_atim, info.st_mtim};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, c.c_str(), times, 0));
+    Cartridge *again = romcache_open(cache, c.c_str(), NULL);
+    EXPECT_EQ(other, again);
+    EXPECT_EQ(3u, cache->file_count);
+    cartridge_release(again);
+
+    enum CartridgeError error;
+    EXPECT_EQ(nullptr, romcache_open(cache, "/nonexistent/macnes.nes", &error));
+    EXPECT_EQ(CARTRIDGE_ERROR_IO, error);
+
+    NES nes = nes_init();
+    nes_insert_cartridge(nes, first);
+    cartridge_release(first);
+    cartridge_release(copy);
+    cartridge_release(other);
+
+    // Only the image still inserted survives a trim.
+    romcache_trim(cache);
+    ASSERT_EQ(1u, cache->count);
+    EXPECT_EQ(nes.bus->cartridge, cache->entries[0].cartridge);
+    EXPECT_EQ(2u, cache->file_count);
+
+    romcache_destroy(cache);
+    EXPECT_EQ(0x11, bus_read(nes.bus, 0x8000));
+    nes_shutdown(nes);
+    for (const std::string &path : {a, b, c})
+        unlink(path.c_str());
+}
+
+TEST(SUITE, check_romcache_shared_memory_across_processes) {
+    std::string path = temp_path("rom-shm");
+    write_rom(path, 0x33);
+    std::string prefix = "macnes-test-" + std::to_string(getpid());
+
+    RomCache *cache = romcache_init(prefix.c_str());
+    Cartridge *cartridge = romcache_open(cache, path.c_str(), NULL);
+    ASSERT_NE(nullptr, cartridge);
+    EXPECT_TRUE(cache->entries[0].shared);
+
+    // A second process maps the segment this one created.
+    pid_t child = fork();
+    if (child == 0) {
+        RomCache *other = romcache_init(prefix.c_str());
+        Cartridge *mapped = romcache_open(other, path.c_str(), NULL);
+        bool ok = mapped && other->entries[0].shared && mapped->prg[0] == 0x33;
+        _exit(ok ? 0 : 1);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    romcache_destroy(cache);
+
+    // A segment whose contents differ from the file is not trusted.
+    std::string segment;
+    DIR *dir = opendir("/dev/shm");
+    ASSERT_NE(nullptr, dir);
+    while (struct dirent *file = readdir(dir)) {
+        if (std::string(file->d_name).rfind(prefix + "-", 0) == 0) segment = std::string("/") + file->d_name;
+    }
+    closedir(dir);
+    ASSERT_FALSE(segment.empty());
+    int fd = shm_open(segment.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    uint8_t garbage = 0xEE;
+    ASSERT_EQ(1, pwrite(fd, &garbage, 1, 16));
+    close(fd);
+
+    cache = romcache_init(prefix.c_str());
+    Cartridge *reopened = romcache_open(cache, path.c_str(), NULL);
+    ASSERT_NE(nullptr, reopened);
+    EXPECT_FALSE(cache->entries[0].shared);
+    EXPECT_EQ(0x33, reopened->prg[0]);
+    EXPECT_EQ(0xEE, cartridge->prg[0]);
+    cartridge_release(reopened);
+    romcache_destroy(cache);
+
+    shm_unlink(segment.c_str());
+    cartridge_release(cartridge);
+    unlink(path.c_str());
+}
+
+TEST(SUITE, check_romcache_rejected_image_leaves_no_segment) {
+    std::string path = temp_path("rom-bad");
+    write_rom(path, 0x55);
+    FILE *f = fopen(path.c_str(), "r+b");
+    fseek(f, 4, SEEK_SET);
+    fputc(0, f);
+    fclose(f);
+    std::string prefix = "macnes-bad-" + std::to_string(getpid());
+
+    RomCache *cache = romcache_init(prefix.c_str());
+    enum CartridgeError error;
+    EXPECT_EQ(nullptr, romcache_open(cache, path.c_str(), &error));
+    EXPECT_EQ(CARTRIDGE_ERROR_UNSUPPORTED, error);
+    EXPECT_EQ(0u, cache->count);
+    EXPECT_EQ(0u, cache->file_count);
+
+    DIR *dir = opendir("/dev/shm");
+    ASSERT_NE(nullptr, dir);
+    while (struct dirent *file = readdir(dir))
+        EXPECT_NE(0u, std::string(file->d_name).rfind(prefix + "-", 0)) << file->d_name;
+    closedir(dir);
+
+    romcache_destroy(cache);
+    unlink(path.c_str());
+}
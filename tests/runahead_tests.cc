@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "runahead.h"
+}
+#include "test_machines.h"
+#define SUITE RUNAHEAD
+
+TEST(SUITE, check_runahead_advances_one_frame) {
+    NES plain = counting_machine();
+    NES ahead = counting_machine();
+    RunAhead *runahead = runahead_init(2);
+    NesInput input = {{0, 0}};
+    std::vector<float> audio_plain(1024);
+    std::vector<float> audio_ahead(1024);
+    NesFrame out_plain = {NULL, audio_plain.data(), audio_plain.size()};
+    NesFrame out_ahead = {NULL, audio_ahead.data(), audio_ahead.size()};
+
+    for (int i = 0; i < 5; i++) {
+        NesFrameResult expected = nes_run_frame(plain, input, &out_plain);
+        NesFrameResult result = runahead_frame(runahead, ahead, input, &out_ahead);
+        EXPECT_EQ(expected.cycles, result.cycles);
+        EXPECT_EQ(expected.audio_samples, result.audio_samples);
+    }
+
+    EXPECT_EQ(plain.cpu->clock_count, ahead.cpu->clock_count);
+    EXPECT_EQ(plain.cpu->pc, ahead.cpu->pc);
+    EXPECT_EQ(ram_read(plain.ram, 0x11), ram_read(ahead.ram, 0x11));
+
+    runahead_destroy(runahead);
+    nes_shutdown(plain);
+    nes_shutdown(ahead);
+}
+
+TEST(SUITE, check_runahead_disabled) {
+    NES nes = counting_machine();
+    RunAhead *runahead = runahead_init(0);
+    NesInput input = {{0, 0}};
+
+    NesFrameResult result = runahead_frame(runahead, nes, input, NULL);
+
+    EXPECT_EQ(result.cycles, nes.cpu->clock_count);
+
+    runahead_destroy(runahead);
+    nes_shutdown(nes);
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "savestate.h"
+}
+#include "test_machines.h"
+#define SUITE SAVESTATE
+
+static std::string temp_path(const char *name) {
+    return std::string("/tmp/macnes-") + name + "-" + std::to_string(getpid()) + ".state";
+}
+
+static NES running_machine() {
+    NES nes = counting_machine();
+    NesInput input = {{BUTTON_START, 0}};
+    for (int i = 0; i < 3; i++)
+        nes_run_frame(nes, input, NULL);
+    return nes;
+}
+
+static void corrupt(const std::string &path, long offset, uint8_t value) {
+    FILE *f = fopen(path.c_str(), "r+b");
+    fseek(f, offset, SEEK_SET);
+    fwrite(&value, 1, 1, f);
+    fclose(f);
+}
+
+TEST(SUITE, check_savestate_layout) {
+    EXPECT_EQ(64u, sizeof(SaveStateHeader));
+    EXPECT_EQ(0u, savestate_head_size() % SAVESTATE_ALIGN);
+    EXPECT_EQ(savestate_head_size() + RAM_SIZE, savestate_size());
+}
+
+TEST(SUITE, check_savestate_roundtrip) {
+    NES source = running_machine();
+    NES target = nes_init();
+    std::string path = temp_path("roundtrip");
+
+    ASSERT_EQ(SAVESTATE_OK, savestate_save(source, path.c_str()));
+    ASSERT_EQ(SAVESTATE_OK, savestate_load(target, path.c_str()));
+
+    EXPECT_EQ(source.cpu->pc, target.cpu->pc);
+    EXPECT_EQ(source.cpu->a, target.cpu->a);
+    EXPECT_EQ(source.cpu->clock_count, target.cpu->clock_count);
+    EXPECT_EQ(source.controller->buttons[0], target.controller->buttons[0]);
+    EXPECT_EQ(ram_read(source.ram, 0x10), ram_read(target.ram, 0x10));
+    EXPECT_EQ(ram_read(source.ram, 0x11), ram_read(target.ram, 0x11));
+
+    NesInput input = {{0, 0}};
+    nes_run_frame(source, input, NULL);
+    nes_run_frame(target, input, NULL);
+    EXPECT_EQ(source.cpu->clock_count, target.cpu->clock_count);
+    EXPECT_EQ(ram_read(source.ram, 0x11), ram_read(target.ram, 0x11));
+
+    remove(path.c_str());
+    nes_shutdown(source);
+    nes_shutdown(target);
+}
+
+TEST(SUITE, check_savestate_encode_matches_file) {
+    NES nes = running_machine();
+    std::string path = temp_path("encode");
+    NesState *state = nes_state_init();
+    nes_snapshot(nes, state);
+    std::vector<uint8_t> encoded(savestate_size());
+    savestate_encode(state, encoded.data());
+    savestate_save(nes, path.c_str());
+
+    enum SaveStateError error;
+    SaveStateFile *file = savestate_open(path.c_str(), &error);
+
+    ASSERT_NE(nullptr, file);
+    EXPECT_EQ(SAVESTATE_OK, error);
+    EXPECT_EQ(0, memcmp(encoded.data(), file->map, encoded.size()));
+
+    savestate_close(file);
+    remove(path.c_str());
+    nes_state_destroy(state);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_savestate_ignores_padding) {
+    NES nes = running_machine();
+    NesState *state = nes_state_init();
+    nes_snapshot(nes, state);
+    std::vector<uint8_t> clean(savestate_size()), dirty(savestate_size());
+    savestate_encode(state, clean.data());
+    uint8_t *padding = (uint8_t*) &state->mapper + offsetof(MapperState, irq) + 1;
+    memset(padding, 0xA5, offsetof(MapperState, next_event) - offsetof(MapperState, irq) - 1);
+    savestate_encode(state, dirty.data());
+
+    EXPECT_EQ(0, memcmp(clean.data(), dirty.data(), clean.size()));
+
+    nes_state_destroy(state);
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_savestate_rejects_version) {
+    NES nes = running_machine();
+    std::string path = temp_path("version");
+    savestate_save(nes, path.c_str());
+    corrupt(path, 4, SAVESTATE_VERSION + 1);
+
+    EXPECT_EQ(SAVESTATE_ERROR_VERSION, savestate_load(nes, path.c_str()));
+    ASSERT_EQ(0, truncate(path.c_str(), (off_t) savestate_head_size()));
+    EXPECT_EQ(SAVESTATE_ERROR_VERSION, savestate_load(nes, path.c_str()));
+
+    remove(path.c_str());
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_savestate_rejects_corruption) {
+    NES nes = running_machine();
+    std::string path = temp_path("corrupt");
+    savestate_save(nes, path.c_str());
+    corrupt(path, (long) savestate_head_size() + 0x500, 0x77);
+
+    EXPECT_EQ(SAVESTATE_ERROR_CORRUPT, savestate_load(nes, path.c_str()));
+    corrupt(path, 0, 'X');
+    EXPECT_EQ(SAVESTATE_ERROR_MAGIC, savestate_load(nes, path.c_str()));
+    EXPECT_EQ(SAVESTATE_ERROR_IO, savestate_load(nes, "/nonexistent/macnes.state"));
+
+    remove(path.c_str());
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_savestate_rejects_chunk_table) {
+    NES nes = running_machine();
+    std::string path = temp_path("table");
+    savestate_save(nes, path.c_str());
+    corrupt(path, 6, 0xFF);
+    corrupt(path, 7, 0xFF);
+
+    EXPECT_EQ(SAVESTATE_ERROR_CORRUPT, savestate_load(nes, path.c_str()));
+    corrupt(path, 6, 0);
+    corrupt(path, 7, 0);
+    EXPECT_EQ(SAVESTATE_ERROR_CORRUPT, savestate_load(nes, path.c_str()));
+
+    remove(path.c_str());
+    nes_shutdown(nes);
+}
@@ -0,0 +1,87 @@
+#ifndef MACNES_TEST_MACHINES_H
+#define MACNES_TEST_MACHINES_H
+
+// Machines, programs and ROM images shared by the test files.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "cartridge.h"
+}
+
+// Counts in $10/$11 forever.
+inline const std::vector<uint8_t> COUNTING_PROGRAM = {0xE6, 0x10, 0xD0, 0xFC, 0xE6, 0x11, 0x4C, 0x00, 0x80};
+
+// Adds button A of each pad into $20/$21 on every iteration.
+inline const std::vector<uint8_t> TWO_PLAYER_PROGRAM = {
+    0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00, 0x8D, 0x16, 0x40,
+    0xAD, 0x16, 0x40, 0x29, 0x01, 0x18, 0x65, 0x20, 0x85, 0x20,
+    0xAD, 0x17, 0x40, 0x29, 0x01, 0x18, 0x65, 0x21, 0x85, 0x21,
+    0x4C, 0x00, 0x80,
+};
+
+// Copies `program` into RAM at $8000, points the reset vector at it and
+// resets the machine.
+inline void load_program(NES nes, const uint8_t *program, size_t size) {
+    for (size_t i = 0; i < size; i++) ram_write(nes.ram, (uint16_t) (0x8000 + i), program[i]);
+    ram_write(nes.ram, 0xFFFC, 0x00);
+    ram_write(nes.ram, 0xFFFD, 0x80);
+    nes_reset(nes);
+}
+
+inline void load_program(NES nes, const std::vector<uint8_t> &program) {
+    load_program(nes, program.data(), program.size());
+}
+
+inline NES counting_machine() {
+    NES nes = nes_init();
+    load_program(nes, COUNTING_PROGRAM);
+    return nes;
+}
+
+inline NES two_player_machine() {
+    NES nes = nes_init();
+    load_program(nes, TWO_PLAYER_PROGRAM);
+    return nes;
+}
+
+// iNES image for `mapper` whose PRG and CHR are filled with `fill`. The
+// caller places code and vectors at image.data() + 16, the start of PRG.
+inline std::vector<uint8_t> ines_image(uint8_t mapper, size_t prg_size, size_t chr_size, uint8_t fill = 0) {
+    std::vector<uint8_t> image(16 + prg_size + chr_size, fill);
+    const uint8_t header[16] = {'N', 'E', 'S', 0x1A, (uint8_t) (prg_size / 0x4000), (uint8_t) (chr_size / 0x2000),
+                                (uint8_t) (mapper << 4), (uint8_t) (mapper & 0xF0)};
+    std::copy(header, header + sizeof(header), image.begin());
+    return image;
+}
+
+inline void write_file(const std::string &path, const std::vector<uint8_t> &data) {
+    FILE *f = fopen(path.c_str(), "wb");
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+
+// Opens `image` through a file at `path`, removed again once it is mapped.
+inline Cartridge* open_image(const std::string &path, const std::vector<uint8_t> &image) {
+    write_file(path, image);
+    Cartridge *cartridge = cartridge_open(path.c_str(), NULL);
+    unlink(path.c_str());
+    return cartridge;
+}
+
+// A new machine with `cartridge` inserted, taking over the caller's reference.
+inline NES machine_with(Cartridge *cartridge) {
+    NES nes = nes_init();
+    EXPECT_TRUE(nes_insert_cartridge(nes, cartridge));
+    cartridge_release(cartridge);
+    return nes;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "cartridge.h"
+    #include "trace.h"
+}
+#include "test_machines.h"
+#define SUITE TRACE
+
+static std::string temp_path(const char *suffix) {
+    return "/tmp/macnes-trace-" + std::to_string(getpid()) + suffix;
+}
+
+static const std::vector<uint8_t> PROGRAM = {
+    0xA2, 0x00,             // C000 LDX #$00
+    0xE8,                   // C002 INX
+    0x8A,                   // C003 TXA
+    0x0A,                   // C004 ASL A
+    0x95, 0x10,             // C005 STA $10,X
+    0xE0, 0x40,             // C007 CPX #$40
+    0xD0, 0xF7,             // C009 BNE $C002
+    0x4C, 0x00, 0xC0,       // C00B JMP $C000
+};
+
+static NES machine() {
+    std::vector<uint8_t> image = ines_image(0, 0x4000, 0x2000);
+    uint8_t *prg = image.data() + 16;
+    std::copy(PROGRAM.begin(), PROGRAM.end(), prg);
+    prg[0x3FFC] = 0x00;
+    prg[0x3FFD] = 0xC0;
+    return machine_with(open_image(temp_path(".nes"), image));
+}
+
+static const NesInput NO_INPUT = {{0, 0}};
+
+// Traces `frames` frames of the program into `path`.
+static NES traced_run(const std::string &path, int frames, uint32_t capacity) {
+    NES nes = machine();
+    Trace *trace = trace_open(path.c_str(), capacity);
+    EXPECT_NE(nullptr, trace);
+    nes_trace(nes, trace);
+    for (int frame = 0; frame < frames; frame++) nes_run_frame(nes, NO_INPUT, NULL);
+    nes_trace(nes, NULL);
+    EXPECT_TRUE(trace_close(trace));
+    return nes;
+}
+
+TEST(SUITE, check_trace_records) {
+    std::string path = temp_path(".trace");
+    NES traced = traced_run(path, 3, 0);
+    size_t count = 0;
+    TraceRecord *records = trace_load(path.c_str(), &count);
+    ASSERT_NE(nullptr, records);
+    EXPECT_GT(count, (size_t) TRACE_CHUNK_RECORDS);
+
+    // The same instructions stepped one at a time.
+    NES reference = machine();
+    CPU *cpu = reference.cpu;
+    size_t index = 0;
+    while (cpu->clock_count < traced.cpu->clock_count) {
+        if (cpu->cycles == 0) {
+            ASSERT_LT(index, count);
+            const TraceRecord &record = records[index++];
+            ASSERT_EQ(cpu->pc, record.pc) << "record " << index;
+            ASSERT_EQ((uint32_t) cpu->clock_count, record.cycle);
+            ASSERT_EQ(bus_read(reference.bus, cpu->pc), record.opcode);
+            ASSERT_EQ(cpu->a, record.a);
+            ASSERT_EQ(cpu->x, record.x);
+            ASSERT_EQ(cpu->y, record.y);
+            ASSERT_EQ(cpu->status, record.status);
+            ASSERT_EQ(cpu->sp, record.sp);
+        }
+        cpu_step(cpu);
+    }
+    EXPECT_EQ(count, index);
+    EXPECT_EQ(traced.cpu->clock_count, cpu->clock_count);
+
+    // Deltas between records are mostly zero bytes.
+    struct stat st;
+    ASSERT_EQ(0, stat(path.c_str(), &st));
+    EXPECT_LT((size_t) st.st_size, count * sizeof(TraceRecord) / 4);
+
+    free(records);
+    unlink(path.c_str());
+    nes_shutdown(reference);
+    nes_shutdown(traced);
+}
+
+TEST(SUITE, check_trace_small_ring) {
+    std::string path = temp_path(".trace");
+    NES nes = machine();
+    Trace *trace = trace_open(path.c_str(), 1);
+    ASSERT_NE(nullptr, trace);
+    EXPECT_EQ((uint64_t) TRACE_CHUNK_RECORDS - 1, trace->mask);
+    nes_trace(nes, trace);
+    for (int frame = 0; frame < 10; frame++) nes_run_frame(nes, NO_INPUT, NULL);
+    uint64_t pushed = trace->head;
+    EXPECT_TRUE(trace_close(trace));
+
+    size_t count = 0;
+    TraceRecord *records = trace_load(path.c_str(), &count);
+    ASSERT_NE(nullptr, records);
+    EXPECT_EQ(pushed, count);
+    for (size_t i = 1; i < count; i++) ASSERT_LT(records[i - 1].cycle, records[i].cycle);
+    free(records);
+    unlink(path.c_str());
+    nes_shutdown(nes);
+}
+
+TEST(SUITE, check_trace_convert) {
+    std::string path = temp_path(".trace"), log = temp_path(".log");
+    NES nes = traced_run(path, 1, 0);
+    FILE *out = fopen(log.c_str(), "w");
+    ASSERT_TRUE(trace_convert(path.c_str(), out));
+    fclose(out);
+
+    std::vector<std::string> lines;
+    FILE *in = fopen(log.c_str(), "r");
+    char line[256];
+    while (fgets(line, sizeof(line), in)) lines.push_back(line);
+    fclose(in);
+    ASSERT_GT(lines.size(), 9u);
+    EXPECT_EQ("C000  A2 00     LDX #$00                        A:00 X:00 Y:00 P:20 SP:FD CYC:8\n", lines[0]);
+    EXPECT_EQ("C002  E8        INX                             A:00 X:00 Y:00 P:22 SP:FD CYC:10\n", lines[1]);
+    EXPECT_EQ("C003  8A        TXA                             A:00 X:01 Y:00 P:20 SP:FD CYC:12\n", lines[2]);
+    EXPECT_EQ("C004  0A        ASL A                           A:01 X:01 Y:00 P:20 SP:FD CYC:14\n", lines[3]);
+    EXPECT_EQ("C005  95 10     STA $10,X                       A:02 X:01 Y:00 P:20 SP:FD CYC:16\n", lines[4]);
+    EXPECT_EQ("C007  E0 40     CPX #$40                        A:02 X:01 Y:00 P:20 SP:FD CYC:20\n", lines[5]);
+    EXPECT_EQ("C009  D0 F7     BNE $C002                       A:02 X:01 Y:00 P:A0 SP:FD CYC:22\n", lines[6]);
+    EXPECT_EQ(lines.size(), (size_t) std::count_if(lines.begin(), lines.end(),
+                                                    [](const std::string &l) { return l.size() > 48; }));
+
+    EXPECT_FALSE(trace_convert(log.c_str(), stdout));
+    unlink(path.c_str());
+    unlink(log.c_str());
+    nes_shutdown(nes);
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+    #include "defs.h"
+    #include "nes.h"
+    #include "vecenv.h"
+    #include "ramwatch.h"
+}
+#define SUITE VECENV
+
+// Latches pad 1 and copies button A into $20 every iteration.
+static const uint8_t PROGRAM[] = {
+    0xA9, 0x01,         // LDA #$01
+    0x8D, 0x16, 0x40,   // STA $4016
+    0xA9, 0x00,         // LDA #$00
+    0x8D, 0x16, 0x40,   // STA $4016
+    0xAD, 0x16, 0x40,   // LDA $4016
+    0x29, 0x01,         // AND #$01
+    0x85, 0x20,         // STA $20
+    0xE6, 0x21,         // INC $21
+    0x4C, 0x00, 0x80,   // JMP $8000
+};
+
+static void load_program(VecEnv *env) {
+    for (size_t i = 0; i < env->count; i++) {
+        NES nes = env->machines[i];
+        for (size_t j = 0; j < sizeof(PROGRAM); j++)
+            ram_write(nes.ram, 0x8000 + j, PROGRAM[j]);
+        ram_write(nes.ram, 0xFFFC, 0x00);
+        ram_write(nes.ram, 0xFFFD, 0x80);
+    }
+    vecenv_reset(env);
+}
+
+static float reward_a(NES nes, void *context) {
+    return ram_read(nes.ram, 0x20) * *(float*) context;
+}
+
+TEST(SUITE, check_vecenv_layout) {
+    uint16_t addresses[3] = {0x20, 0x21, 0x22};
+    VecEnvConfig config = {VECENV_OBS_RAM, addresses, 3, NULL, NULL, NULL};
+    VecEnv *env = vecenv_init(5, &config);
+
+    EXPECT_EQ(3u, env->observation_size);
+    EXPECT_EQ(64u, env->rewards_offset);
+    EXPECT_EQ(64u + 5 * sizeof(float), env->buffer_size);
+
+    vecenv_destroy(env);
+}
+
+TEST(SUITE, check_vecenv_step_ram) {
+    uint16_t addresses[2] = {0x20, 0x00};
+    float scale = 2.5f;
+    VecEnvConfig config = {VECENV_OBS_RAM, addresses, 2, NULL, reward_a, &scale};
+    VecEnv *env = vecenv_init(4, &config);
+    load_program(env);
+    std::vector<uint8_t> buffer(env->buffer_size);
+    NesInput inputs[4] = {{{BUTTON_A, 0}}, {{0, 0}}, {{BUTTON_A | BUTTON_B, 0}}, {{BUTTON_B, 0}}};
+
+    vecenv_step(env, inputs, buffer.data());
+
+    uint8_t *observations = vecenv_observations(env, buffer.data());
+    float *rewards = vecenv_rewards(env, buffer.data());
+    uint8_t expected[4] = {1, 0, 1, 0};
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(expected[i], observations[i * 2]);
+        EXPECT_EQ(0, observations[i * 2 + 1]);
+        EXPECT_FLOAT_EQ(expected[i] * 2.5f, rewards[i]);
+    }
+
+    vecenv_destroy(env);
+}
+
+TEST(SUITE, check_vecenv_shared_memory) {
+    uint16_t addresses[1] = {0x20};
+    VecEnvConfig config = {VECENV_OBS_RAM, addresses, 1, NULL, NULL, NULL};
+    VecEnv *env = vecenv_init(2, &config);
+    load_program(env);
+    std::string name = "/macnes-vecenv-test-" + std::to_string(getpid());
+    void *writer = vecenv_shm_create(name.c_str(), env->buffer_size);
+    void *reader = vecenv_shm_open(name.c_str(), env->buffer_size);
+    ASSERT_NE(nullptr, writer);
+    ASSERT_NE(nullptr, reader);
+    NesInput inputs[2] = {{{0, 0}}, {{BUTTON_A, 0}}};
+
+    vecenv_step(env, inputs, writer);
+
+    EXPECT_EQ(0, vecenv_observations(env, reader)[0]);
+    EXPECT_EQ(1, vecenv_observations(env, reader)[1]);
+
+    vecenv_shm_close(writer, env->buffer_size);
+    vecenv_shm_close(reader, env->buffer_size);
+    vecenv_shm_unlink(name.c_str());
+    vecenv_destroy(env);
+}
+
+TEST(SUITE, check_vecenv_step_watch) {
+    RamWatch *watch = ramwatch_init();
+    ramwatch_add(watch, 0x20, 1, RAMWATCH_U8);
+    ramwatch_add(watch, 0x20, 1, RAMWATCH_U16LE);
+    VecEnvConfig config = {VECENV_OBS_WATCH, NULL, 0, watch, NULL, NULL};
+    VecEnv *env = vecenv_init(2, &config);
+    load_program(env);
+    std::vector<uint8_t> buffer(env->buffer_size);
+    NesInput inputs[2] = {{{BUTTON_A, 0}}, {{0, 0}}};
+
+    vecenv_step(env, inputs, buffer.data());
+
+    int32_t *features = (int32_t*) vecenv_observations(env, buffer.data());
+    EXPECT_EQ(8u, env->observation_size);
+    EXPECT_EQ(1, features[0]);
+    EXPECT_EQ(1 | (env->machines[0].ram->data[0x21] << 8), features[1]);
+    EXPECT_EQ(0, features[2]);
+
+    vecenv_destroy(env);
+    ramwatch_destroy(watch);
+}